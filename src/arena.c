@@ -0,0 +1,104 @@
+/*
+ * Bump allocator for per-image data
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "arena.h"
+
+#define CHUNK_SIZE  (256 * 1024)
+#define ALIGN       16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;    /* of the whole mapping */
+};
+
+static struct arena_chunk *new_chunk(size_t size) {
+    long page = sysconf(_SC_PAGESIZE);
+    struct arena_chunk *chunk;
+
+    size = (size + page - 1) & ~(size_t)(page - 1);
+    if ((chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        perror("Cannot allocate memory");
+        exit(1);
+    }
+    chunk->size = size;
+    return chunk;
+}
+
+/* Returns zeroed memory, since fresh anonymous mappings already are. */
+void *arena_alloc(struct arena *arena, size_t size) {
+    const size_t header = (sizeof(struct arena_chunk) + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    struct arena_chunk *chunk;
+    byte *ret;
+
+    size = (size + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+
+    if (size <= arena->left) {
+        ret = arena->next;
+        arena->next += size;
+        arena->left -= size;
+        return ret;
+    }
+
+    if (size > CHUNK_SIZE / 4) {
+        /* Big allocations (e.g. flags for a large section) get a chunk of
+         * their own, so that we keep using the current one. */
+        chunk = new_chunk(header + size);
+        if (arena->chunks) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->chunks = chunk;
+        }
+        return (byte *)chunk + header;
+    }
+
+    chunk = new_chunk(CHUNK_SIZE);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (byte *)chunk + header + size;
+    arena->left = chunk->size - header - size;
+    return (byte *)chunk + header;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len) {
+    char *ret = arena_alloc(arena, len + 1);
+    memcpy(ret, str, len);
+    return ret;
+}
+
+void arena_free(struct arena *arena) {
+    struct arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        munmap(chunk, chunk->size);
+    }
+    memset(arena, 0, sizeof(*arena));
+}
@@ -0,0 +1,19 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include "semblance.h"
+
+/* Everything we read out of an image lives as long as the image does, so
+ * it's carved out of one of these and released all at once. Start from a
+ * zeroed struct. */
+struct arena {
+    struct arena_chunk *chunks;
+    byte *next;         /* free space in the current chunk */
+    size_t left;
+};
+
+extern void *arena_alloc(struct arena *arena, size_t size);
+extern char *arena_strndup(struct arena *arena, const char *str, size_t len);
+extern void arena_free(struct arena *arena);
+
+#endif /* __ARENA_H */
@@ -0,0 +1,349 @@
+/*
+ * Control flow graph construction
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "cfg.h"
+#include "x86_instr.h"
+
+/* what we remember about the end of each block until all blocks are known */
+struct block_exit {
+    dword target;
+    byte has_target;
+    byte falls_through;
+    byte is_func;
+};
+
+static unsigned find_block(const struct cfg *cfg, dword addr) {
+    unsigned lo = 0, hi = cfg->block_count;
+
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (cfg->blocks[mid].start < addr)
+            lo = mid + 1;
+        else if (cfg->blocks[mid].start > addr)
+            hi = mid;
+        else
+            return mid;
+    }
+    return CFG_NONE;
+}
+
+/* Split the scanned instructions into basic blocks. A block starts at any
+ * function entry or jump target, after any jump or return, and after a gap.
+ * Calls don't end a block. */
+static struct block_exit *read_blocks(struct cfg *cfg, const struct cfg_region *regions, unsigned count) {
+    struct block_exit *exits = NULL;
+    unsigned size = 0;
+    byte buffer[MAX_INSTR];
+    struct instr instr;
+    unsigned r;
+
+    for (r = 0; r < count; r++) {
+        const struct cfg_region *reg = &regions[r];
+        struct block_exit *tail = NULL;
+        struct cfg_block *block = NULL;
+        dword ip = 0;
+        int len;
+
+        while (ip < reg->length) {
+            if (!(reg->flags[ip] & INSTR_VALID)) {
+                block = NULL;
+                ip++;
+                continue;
+            }
+
+            memset(buffer, 0, sizeof(buffer));
+            memcpy(buffer, read_data(reg->offset + ip), min(sizeof(buffer), reg->length - ip));
+            len = get_instr(reg->ip + ip, buffer, &instr, reg->bits);
+
+            if (!block || (reg->flags[ip] & (INSTR_FUNC | INSTR_JUMP))) {
+                /* the previous block runs straight into this one */
+                if (block) tail->falls_through = 1;
+
+                if (cfg->block_count == size) {
+                    size = size ? size * 2 : 256;
+                    cfg->blocks = realloc(cfg->blocks, size * sizeof(*cfg->blocks));
+                    exits = realloc(exits, size * sizeof(*exits));
+                }
+                block = &cfg->blocks[cfg->block_count];
+                tail = &exits[cfg->block_count];
+                cfg->block_count++;
+
+                block->start = reg->base + ip;
+                block->func = CFG_NONE;
+                memset(tail, 0, sizeof(*tail));
+                tail->is_func = !!(reg->flags[ip] & INSTR_FUNC);
+            }
+
+            block->end = reg->base + ip + len;
+
+            if ((instr.op->flags & (OP_BRANCH | OP_CALL)) == OP_BRANCH) {
+                tail->has_target = 1;
+                tail->target = reg->base + (dword)(branch_target(&instr, len, reg->linear) - reg->ip);
+                tail->falls_through = !(instr.op->flags & OP_STOP);
+                block = NULL;
+            } else if (instr.op->flags & OP_STOP)
+                block = NULL;
+
+            ip += len;
+        }
+    }
+
+    return exits;
+}
+
+static void read_edges(struct cfg *cfg, const struct block_exit *exits) {
+    unsigned *from, *to;
+    unsigned *pos;
+    unsigned i, j, e;
+
+    from = malloc(2 * cfg->block_count * sizeof(*from));
+    to = malloc(2 * cfg->block_count * sizeof(*to));
+
+    e = 0;
+    for (i = 0; i < cfg->block_count; i++) {
+        unsigned target = CFG_NONE;
+
+        if (exits[i].has_target && (target = find_block(cfg, exits[i].target)) != CFG_NONE) {
+            from[e] = i;
+            to[e++] = target;
+        }
+        if (exits[i].falls_through && (j = find_block(cfg, cfg->blocks[i].end)) != CFG_NONE
+                && j != target) {
+            from[e] = i;
+            to[e++] = j;
+        }
+    }
+    cfg->edge_count = e;
+
+    /* edges were generated in order of source, so successors are easy */
+    cfg->succ_start = calloc(cfg->block_count + 1, sizeof(unsigned));
+    cfg->succ = malloc(e * sizeof(unsigned));
+    for (i = 0; i < e; i++) {
+        cfg->succ_start[from[i]+1]++;
+        cfg->succ[i] = to[i];
+    }
+    for (i = 0; i < cfg->block_count; i++)
+        cfg->succ_start[i+1] += cfg->succ_start[i];
+
+    /* predecessors need a counting sort */
+    cfg->pred_start = calloc(cfg->block_count + 1, sizeof(unsigned));
+    cfg->pred = malloc(e * sizeof(unsigned));
+    for (i = 0; i < e; i++)
+        cfg->pred_start[to[i]+1]++;
+    for (i = 0; i < cfg->block_count; i++)
+        cfg->pred_start[i+1] += cfg->pred_start[i];
+    pos = malloc(cfg->block_count * sizeof(unsigned));
+    memcpy(pos, cfg->pred_start, cfg->block_count * sizeof(unsigned));
+    for (i = 0; i < e; i++)
+        cfg->pred[pos[to[i]]++] = from[i];
+
+    free(pos);
+    free(from);
+    free(to);
+}
+
+/* Each function owns every block reachable from its entry without passing
+ * through another function's entry. Blocks shared between functions (e.g.
+ * common epilogues) go to whichever function was found first. */
+static void read_functions(struct cfg *cfg, const struct block_exit *exits) {
+    unsigned *stack, *pos;
+    unsigned i, f;
+
+    cfg->func_entry = malloc(cfg->block_count * sizeof(unsigned));
+    for (i = 0; i < cfg->block_count; i++) {
+        if (exits[i].is_func) {
+            cfg->blocks[i].func = cfg->func_count;
+            cfg->func_entry[cfg->func_count++] = i;
+        }
+    }
+
+    stack = malloc(cfg->block_count * sizeof(unsigned));
+    for (f = 0; f < cfg->func_count; f++) {
+        unsigned sp = 0;
+
+        stack[sp++] = cfg->func_entry[f];
+        while (sp) {
+            unsigned b = stack[--sp];
+            unsigned e;
+
+            for (e = cfg->succ_start[b]; e < cfg->succ_start[b+1]; e++) {
+                unsigned s = cfg->succ[e];
+                if (cfg->blocks[s].func == CFG_NONE) {
+                    cfg->blocks[s].func = f;
+                    stack[sp++] = s;
+                }
+            }
+        }
+    }
+    free(stack);
+
+    cfg->func_start = calloc(cfg->func_count + 1, sizeof(unsigned));
+    cfg->func_blocks = malloc(cfg->block_count * sizeof(unsigned));
+    for (i = 0; i < cfg->block_count; i++) {
+        if (cfg->blocks[i].func != CFG_NONE)
+            cfg->func_start[cfg->blocks[i].func+1]++;
+    }
+    for (f = 0; f < cfg->func_count; f++)
+        cfg->func_start[f+1] += cfg->func_start[f];
+    pos = malloc(cfg->func_count * sizeof(unsigned));
+    memcpy(pos, cfg->func_start, cfg->func_count * sizeof(unsigned));
+    for (i = 0; i < cfg->block_count; i++) {
+        if (cfg->blocks[i].func != CFG_NONE)
+            cfg->func_blocks[pos[cfg->blocks[i].func]++] = i;
+    }
+    free(pos);
+}
+
+/* Regions must be given in order of address. */
+void cfg_build(struct cfg *cfg, const struct cfg_region *regions, unsigned count) {
+    struct block_exit *exits;
+
+    memset(cfg, 0, sizeof(*cfg));
+
+    exits = read_blocks(cfg, regions, count);
+    read_edges(cfg, exits);
+    read_functions(cfg, exits);
+
+    free(exits);
+}
+
+/* print a string, escaped for both DOT and JSON */
+static void print_quoted(const char *str) {
+    putchar('"');
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            putchar('\\');
+        if ((byte)*str >= 0x20)
+            putchar(*str);
+    }
+    putchar('"');
+}
+
+static void print_dot(const struct cfg *cfg, const char *name, addr_func addr_str, const void *ctx) {
+    char start[32], end[32];
+    unsigned i, f;
+
+    printf("digraph ");
+    print_quoted(name);
+    printf(" {\n");
+    printf("    node [shape=box, fontname=\"monospace\"];\n");
+
+    for (f = 0; f < cfg->func_count; f++) {
+        addr_str(start, cfg->blocks[cfg->func_entry[f]].start, ctx);
+        printf("    subgraph \"cluster_%u\" {\n", f);
+        printf("        label=");
+        print_quoted(start);
+        printf(";\n");
+        for (i = cfg->func_start[f]; i < cfg->func_start[f+1]; i++) {
+            const struct cfg_block *block = &cfg->blocks[cfg->func_blocks[i]];
+            addr_str(start, block->start, ctx);
+            addr_str(end, block->end, ctx);
+            printf("        b%u [label=\"%s - %s\"];\n", cfg->func_blocks[i], start, end);
+        }
+        printf("    }\n");
+    }
+
+    for (i = 0; i < cfg->block_count; i++) {
+        unsigned e;
+
+        if (cfg->blocks[i].func == CFG_NONE) {
+            addr_str(start, cfg->blocks[i].start, ctx);
+            addr_str(end, cfg->blocks[i].end, ctx);
+            printf("    b%u [label=\"%s - %s\"];\n", i, start, end);
+        }
+        for (e = cfg->succ_start[i]; e < cfg->succ_start[i+1]; e++)
+            printf("    b%u -> b%u;\n", i, cfg->succ[e]);
+    }
+
+    printf("}\n");
+}
+
+static void print_list(const unsigned *list, unsigned first, unsigned last) {
+    unsigned i;
+
+    putchar('[');
+    for (i = first; i < last; i++)
+        printf(i == first ? "%u" : ", %u", list[i]);
+    putchar(']');
+}
+
+static void print_json(const struct cfg *cfg, const char *name, addr_func addr_str, const void *ctx) {
+    char start[32], end[32];
+    unsigned i, f;
+
+    printf("{\"name\": ");
+    print_quoted(name);
+    printf(",\n \"functions\": [");
+
+    for (f = 0; f < cfg->func_count; f++) {
+        addr_str(start, cfg->blocks[cfg->func_entry[f]].start, ctx);
+        printf(f ? ",\n  " : "\n  ");
+        printf("{\"entry\": \"%s\", \"blocks\": ", start);
+        print_list(cfg->func_blocks, cfg->func_start[f], cfg->func_start[f+1]);
+        putchar('}');
+    }
+
+    printf("],\n \"blocks\": [");
+
+    for (i = 0; i < cfg->block_count; i++) {
+        const struct cfg_block *block = &cfg->blocks[i];
+
+        addr_str(start, block->start, ctx);
+        addr_str(end, block->end, ctx);
+        printf(i ? ",\n  " : "\n  ");
+        printf("{\"start\": \"%s\", \"end\": \"%s\", \"function\": ", start, end);
+        if (block->func == CFG_NONE)
+            printf("null");
+        else
+            printf("%u", block->func);
+        printf(", \"succ\": ");
+        print_list(cfg->succ, cfg->succ_start[i], cfg->succ_start[i+1]);
+        printf(", \"pred\": ");
+        print_list(cfg->pred, cfg->pred_start[i], cfg->pred_start[i+1]);
+        putchar('}');
+    }
+
+    printf("]}\n");
+}
+
+void cfg_print(const struct cfg *cfg, const char *name, addr_func addr_str, const void *ctx) {
+    if (cfg_format == CFG_JSON)
+        print_json(cfg, name, addr_str, ctx);
+    else
+        print_dot(cfg, name, addr_str, ctx);
+}
+
+void cfg_free(struct cfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->succ_start);
+    free(cfg->succ);
+    free(cfg->pred_start);
+    free(cfg->pred);
+    free(cfg->func_entry);
+    free(cfg->func_start);
+    free(cfg->func_blocks);
+}
@@ -0,0 +1,47 @@
+#ifndef __CFG_H
+#define __CFG_H
+
+#include "semblance.h"
+
+/* A stretch of scanned code, e.g. one NE segment or PE section. Addresses
+ * use the same scheme as the xref table (see xref.h); "ip" is what the
+ * decoder should be given for the first byte, which need not be the same. */
+struct cfg_region {
+    dword base;         /* address of the first byte */
+    dword ip;           /* decoder IP of the first byte */
+    dword length;
+    off_t offset;       /* file offset of the first byte */
+    const byte *flags;  /* INSTR_* flags from the scanner */
+    int bits;
+    int linear;         /* near branches can cross 64K (see branch_target()) */
+};
+
+struct cfg_block {
+    dword start;        /* address of the first instruction */
+    dword end;          /* address following the last instruction */
+    unsigned func;      /* containing function, or CFG_NONE */
+};
+
+#define CFG_NONE ((unsigned)-1)  /* no such block or function */
+
+/* Edges and function membership are stored in compressed sparse row form:
+ * e.g. the successors of block i are succ[succ_start[i]] through
+ * succ[succ_start[i+1]-1]. */
+struct cfg {
+    struct cfg_block *blocks;   /* sorted by address */
+    unsigned block_count;
+
+    unsigned *succ_start, *succ;
+    unsigned *pred_start, *pred;
+    unsigned edge_count;
+
+    unsigned *func_entry;       /* entry block of each function */
+    unsigned *func_start, *func_blocks;
+    unsigned func_count;
+};
+
+extern void cfg_build(struct cfg *cfg, const struct cfg_region *regions, unsigned count);
+extern void cfg_print(const struct cfg *cfg, const char *name, addr_func addr_str, const void *ctx);
+extern void cfg_free(struct cfg *cfg);
+
+#endif /* __CFG_H */
@@ -0,0 +1,477 @@
+/*
+ * Stress test and benchmark for the instruction decoder
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Not built by default; run "make decbench".
+ *
+ * Every instruction in the input (random bytes, or the raw contents of the
+ * given files) is decoded at the end of a page followed by an inaccessible
+ * one, so that reading past MAX_INSTR bytes crashes, and printed in all
+ * three syntaxes. Lengths must be within MAX_INSTR. With -r, the input is also disassembled by objdump
+ * and the two are compared instruction by instruction. Last, decode
+ * throughput is measured. */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "semblance.h"
+#include "x86_instr.h"
+
+byte *map;
+int map_fd;
+off_t map_size;
+word opts;
+enum isa isa = ISA_ALL;
+
+static int bits = 32;
+static int verbose;
+
+/* Problems go here; stdout and stderr are sent to /dev/null while checking,
+ * since print_instr() writes its text and warnings there. Crashes and
+ * sanitizer reports still need to be seen, though, so those are written to
+ * report's descriptor instead. */
+static FILE *report;
+static int report_fd;
+static int saved_fds[2] = {-1, -1};
+
+/* the instruction being checked, for crash_handler() */
+static volatile size_t check_pos;
+static const byte *volatile check_window;
+
+/* in the sanitizer runtime, if we're built with one */
+extern void __sanitizer_set_report_fd(void *fd) __attribute__((weak));
+
+static void write_hex(char *out, unsigned long value, int digits) {
+    static const char hex[] = "0123456789abcdef";
+
+    while (digits--) {
+        out[digits] = hex[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/* Says where we crashed, using only async-signal-safe calls, then dies of
+ * the same signal. */
+static void crash_handler(int sig) {
+    char msg[64 + 3 * MAX_INSTR] = "decbench: crashed checking offset ";
+    size_t len = strlen(msg);
+    int i;
+
+    write_hex(msg + len, check_pos, 8);
+    len += 8;
+    msg[len++] = ':';
+    if (check_window) {
+        for (i = 0; i < MAX_INSTR; i++) {
+            msg[len++] = ' ';
+            write_hex(msg + len, check_window[i], 2);
+            len += 2;
+        }
+    }
+    msg[len++] = '\n';
+    if (write(report_fd, msg, len) < 0)
+        len = 0;    /* nowhere else to say it */
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void silence_output(int silence) {
+    int fd;
+
+    fflush(stdout);
+    fflush(stderr);
+    for (fd = 1; fd <= 2; fd++) {
+        if (silence) {
+            int null = open("/dev/null", O_WRONLY);
+
+            saved_fds[fd-1] = dup(fd);
+            dup2(null, fd);
+            close(null);
+        } else {
+            dup2(saved_fds[fd-1], fd);
+            close(saved_fds[fd-1]);
+        }
+    }
+}
+
+/* words objdump prints before the mnemonic */
+static int is_prefix_word(const char *word) {
+    static const char *const prefixes[] = {
+        "lock", "rep", "repe", "repz", "repne", "repnz", "bnd", "notrack",
+        "data16", "data32", "addr16", "addr32", "cs", "ds", "es", "fs", "gs", "ss",
+        "xacquire", "xrelease",
+    };
+    unsigned i;
+
+    if (!strncmp(word, "rex", 3))
+        return 1;
+    for (i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++)
+        if (!strcmp(word, prefixes[i]))
+            return 1;
+    return 0;
+}
+
+/* Mnemonics that objdump spells differently from us; ours first. */
+static const char *const aliases[][2] = {
+    {"jz", "je"},           {"jnz", "jne"},
+    {"cmovz", "cmove"},     {"cmovnz", "cmovne"},
+    {"setz", "sete"},       {"setnz", "setne"},
+    {"loopz", "loope"},     {"loopnz", "loopne"},
+    {"xlatb", "xlat"},      {"sal", "shl"},
+    {"amx", "aam"},         {"adx", "aad"},
+    {"mov", "movabs"},      {"movsx", "movsxd"},
+    {"wait", "fwait"},
+};
+
+/* whether longer is shorter with an operand size letter on the end */
+static int size_suffixed(const char *longer, const char *shorter) {
+    size_t len = strlen(shorter);
+
+    return strlen(longer) == len + 1 && !strncmp(longer, shorter, len) && strchr("bwdq", longer[len]);
+}
+
+/* Whether objdump's mnemonic ref names the same instruction as instr, whose
+ * mnemonic we render as name. Size suffixes are where they differ most:
+ * we spell out string and stack operations' sizes, and objdump spells out
+ * some others'. Its notes, as in "fneni(8087 only)", are ignored. */
+static int same_mnemonic(const struct instr *instr, const char *name, const char *ref) {
+    size_t ref_len = strcspn(ref, "(");
+    unsigned i;
+
+    if (!strcmp(name, ref) || (ref_len && ref_len == strlen(name) && !strncmp(name, ref, ref_len)))
+        return 1;
+    if ((instr->op->flags & (OP_STRING | OP_STACK)) && size_suffixed(name, ref))
+        return 1;
+    if (!instr->vex && size_suffixed(ref, name))
+        return 1;
+    for (i = 0; i < sizeof(aliases)/sizeof(aliases[0]); i++)
+        if (!strcmp(name, aliases[i][0]) && !strcmp(ref, aliases[i][1]))
+            return 1;
+    return 0;
+}
+
+/* Random bytes, leaning towards prefixes and escapes so that the less
+ * common tables get exercised too. */
+static byte *random_input(size_t size, unsigned seed) {
+    static const byte special[] = {
+        0x0F, 0x0F, 0x0F, 0x38, 0x3A, 0x66, 0x67, 0xF2, 0xF3, 0xF0, 0x2E, 0x26,
+        0x40, 0x41, 0x44, 0x48, 0x4C, 0xC4, 0xC5, 0x62, 0x8F, 0xD8, 0xD9, 0xDB,
+        0xDD, 0xDF, 0x80, 0x81, 0x83, 0xF6, 0xF7, 0xFE, 0xFF,
+    };
+    byte *data = malloc(size);
+    size_t i;
+
+    srand(seed);
+    for (i = 0; i < size; i++)
+        data[i] = (rand() % 4) ? rand() : special[rand() % sizeof(special)];
+    return data;
+}
+
+static byte *read_input(const char *file, size_t *size) {
+    FILE *f = fopen(file, "rb");
+    byte *data;
+
+    if (!f) {
+        perror(file);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc(*size);
+    if (fread(data, 1, *size, f) != *size) {
+        perror(file);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/* Returns the number of problems found. */
+static unsigned check_input(const byte *data, size_t size, byte *guard) {
+    static const enum asm_syntax syntaxes[3] = {GAS, NASM, MASM};
+    byte *window = guard - MAX_INSTR;
+    struct instr instr;
+    unsigned problems = 0;
+    size_t pos;
+    int i;
+
+    for (pos = 0; pos < size; pos++) {
+        int len;
+
+        memset(window, 0, MAX_INSTR);
+        memcpy(window, data + pos, min(MAX_INSTR, size - pos));
+        check_pos = pos;
+        check_window = window;
+
+        len = get_instr(pos, window, &instr, bits);
+
+        if (len <= 0 || len > MAX_INSTR) {
+            fprintf(report, "%08zx: bad length %d\n", pos, len);
+            problems++;
+            continue;
+        }
+
+        for (i = 0; i < 3; i++)
+            print_instr("0", window, len, 0, &instr, NULL, NULL, bits, syntaxes[i]);
+    }
+    check_window = NULL;
+
+    return problems;
+}
+
+/* Compare instruction boundaries and mnemonics with objdump's, decoding
+ * linearly through the input. Where the boundaries disagree, both skip
+ * ahead until they line up again. */
+static void compare_objdump(const byte *data, size_t size) {
+    static const char *const machine[3] = {"i8086", "i386", "i386:x86-64"};
+    char path[] = "/tmp/decbenchXXXXXX";
+    char cmd[256], line[512];
+    unsigned total = 0, length_diff = 0, name_diff = 0;
+    size_t pos = 0;
+    FILE *f;
+    int fd;
+
+    if ((fd = mkstemp(path)) < 0) {
+        perror("mkstemp");
+        return;
+    }
+    if (write(fd, data, size) != (ssize_t)size) {
+        perror("write");
+        close(fd);
+        unlink(path);
+        return;
+    }
+    close(fd);
+
+    snprintf(cmd, sizeof(cmd), "objdump -D -b binary -m %s -M intel --insn-width=16 %s",
+             machine[bits / 32], path);
+    if (!(f = popen(cmd, "r"))) {
+        perror("objdump");
+        unlink(path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        struct instr instr;
+        byte window[MAX_INSTR];
+        unsigned long addr;
+        char name[sizeof(instr.op->name) + 3];
+        char *bytes, *text, *ref;
+        int len, ref_len = 0;
+
+        if (sscanf(line, " %lx:", &addr) != 1 || !(bytes = strchr(line, '\t')))
+            continue;
+        if (!(text = strchr(bytes + 1, '\t')))
+            continue;
+        for (bytes++; bytes < text; bytes++)
+            if (*bytes != ' ' && bytes[-1] == ' ') ref_len++;
+        ref_len++;
+
+        /* catch up to objdump */
+        while (pos < addr && pos < size) {
+            memset(window, 0, sizeof(window));
+            memcpy(window, data + pos, min(MAX_INSTR, size - pos));
+            pos += get_instr(pos, window, &instr, bits);
+        }
+        if (pos != addr)
+            continue;   /* objdump is behind; wait for it */
+
+        memset(window, 0, sizeof(window));
+        memcpy(window, data + pos, min(MAX_INSTR, size - pos));
+        len = get_instr(pos, window, &instr, bits);
+        total++;
+
+        strcpy(name, instr.vex_sse ? "v" : "");
+        get_instr_name(name + strlen(name), &instr, bits, NASM);
+
+        ref = strtok(text + 1, " \n");
+        while (ref && is_prefix_word(ref))
+            ref = strtok(NULL, " \n");
+
+        if (!strcmp(name, "?") && ref && !strcmp(ref, "(bad)")) {
+            /* neither of us knows what it is; the lengths mean nothing */
+        } else if (len != ref_len) {
+            length_diff++;
+            if (verbose)
+                printf("%08lx: %d bytes (%s), objdump %d (%s)\n", addr, len, name, ref_len, ref ? ref : "");
+        } else if (ref && !same_mnemonic(&instr, name, ref)) {
+            name_diff++;
+            if (verbose)
+                printf("%08lx: %s, objdump %s\n", addr, name, ref);
+        }
+        pos += len;
+    }
+
+    pclose(f);
+    unlink(path);
+    printf("objdump: %u instructions compared, %u differ in length, %u in mnemonic\n",
+           total, length_diff, name_diff);
+}
+
+static void benchmark(const byte *data, size_t size) {
+    byte *buffer = calloc(size + MAX_INSTR, 1);
+    struct instr instr;
+    unsigned long count = 0;
+    clock_t start, elapsed;
+    size_t pos;
+    int pass;
+
+    memcpy(buffer, data, size);
+    start = clock();
+    for (pass = 0; pass < 10; pass++) {
+        for (pos = 0; pos < size; count++)
+            pos += get_instr(pos, buffer + pos, &instr, bits);
+    }
+    elapsed = clock() - start;
+    if (!elapsed) elapsed = 1;
+
+    printf("%-16s %10.0f instructions/s, %7.1f MB/s\n",
+           "get_instr:",
+           count / ((double)elapsed / CLOCKS_PER_SEC),
+           size * 10 / ((double)elapsed / CLOCKS_PER_SEC) / 1e6);
+    free(buffer);
+}
+
+/* Check and time one input: the given file, or random bytes if NULL.
+ * Returns the number of problems found. */
+static unsigned run(const char *file, size_t size, unsigned seed, byte *guard, int reference) {
+    unsigned problems;
+    byte *data;
+
+    data = file ? read_input(file, &size) : random_input(size, seed);
+    if (!data)
+        return 1;
+
+    silence_output(1);
+    problems = check_input(data, size, guard);
+    silence_output(0);
+
+    printf("%s: %zu bytes, %d-bit\n", file ? file : "random input", size, bits);
+    if (reference)
+        compare_objdump(data, size);
+    benchmark(data, size);
+
+    free(data);
+    return problems;
+}
+
+static void print_usage(void) {
+    printf(
+"Usage: decbench [options] [file...]\n"
+"Stress-test and time the instruction decoder on the raw contents of each\n"
+"file, or on random bytes if none are given.\n"
+"\n"
+"Options:\n"
+"\t-b, --bits=16|32|64          Decode in this mode (default 32).\n"
+"\t-h, --help                   Display this help message.\n"
+"\t-n, --size=BYTES             Size of random input (default 1000000).\n"
+"\t-r, --reference              Compare with objdump's disassembly.\n"
+"\t-s, --seed=SEED              Seed for random input.\n"
+"\t-v, --verbose                List each difference from objdump.\n"
+);
+}
+
+static const struct option long_options[] = {
+    {"bits",        required_argument,  NULL, 'b'},
+    {"help",        no_argument,        NULL, 'h'},
+    {"size",        required_argument,  NULL, 'n'},
+    {"reference",   no_argument,        NULL, 'r'},
+    {"seed",        required_argument,  NULL, 's'},
+    {"verbose",     no_argument,        NULL, 'v'},
+    {0}
+};
+
+int main(int argc, char *argv[]) {
+    size_t size = 1000000;
+    unsigned seed = 1, problems = 0;
+    long page = sysconf(_SC_PAGESIZE);
+    int reference = 0, opt, i;
+    byte *pages;
+
+    init_instr_tables();
+
+    while ((opt = getopt_long(argc, argv, "b:hn:rs:v", long_options, NULL)) >= 0) {
+        switch (opt) {
+        case 'b':
+            bits = atoi(optarg);
+            if (bits != 16 && bits != 32 && bits != 64) {
+                fprintf(stderr, "decbench: bits must be 16, 32, or 64\n");
+                return 1;
+            }
+            break;
+        case 'h':
+            print_usage();
+            return 0;
+        case 'n':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            reference = 1;
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: decbench [options] [file...]\n");
+            return 1;
+        }
+    }
+
+    report_fd = dup(2);
+    report = fdopen(report_fd, "w");
+    setvbuf(report, NULL, _IOLBF, 0);
+    if (__sanitizer_set_report_fd)
+        __sanitizer_set_report_fd((void *)(intptr_t)report_fd);
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGILL, crash_handler);
+    signal(SIGFPE, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    /* decode right below a page we can't read */
+    pages = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED || mprotect(pages + page, page, PROT_NONE) < 0) {
+        perror("mmap");
+        return 1;
+    }
+
+    if (optind == argc)
+        problems += run(NULL, size, seed, pages + page, reference);
+    for (i = optind; i < argc; i++)
+        problems += run(argv[i], 0, 0, pages + page, reference);
+
+    if (problems)
+        fprintf(stderr, "decbench: %u problems\n", problems);
+    return !!problems;
+}
@@ -20,8 +20,10 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -30,14 +32,21 @@
 #include <unistd.h>
 
 #include "semblance.h"
+#include "x86_instr.h"
 
 byte *map;
+int map_fd;
+off_t map_size;
 
 word mode;
 word opts;
-char **resource_filters;
-unsigned resource_filters_count;
+char **entry_points;
+unsigned entry_point_count;
+char **symbol_files;
+unsigned symbol_file_count;
 enum asm_syntax asm_syntax;
+enum isa isa;
+enum cfg_format cfg_format;
 
 static void dump_file(char *file){
     struct stat st;
@@ -61,10 +70,18 @@ static void dump_file(char *file){
         perror("Cannot map %s");
         return;
     }
+    map_fd = fd;
+    map_size = st.st_size;
+    if (extract_dir)
+        set_extract_input(file);
 
     magic = read_word(0);
 
-    printf("File: %s\n", file);
+    /* keep graphs machine-readable, and source assemblable */
+    if (opts & COMPILABLE)
+        printf((asm_syntax == GAS) ? "# File: %s\n" : "; File: %s\n", file);
+    else if (!(mode & DUMPCFG))
+        printf("File: %s\n", file);
     if (magic == 0x5a4d){ /* MZ */
         offset = read_dword(0x3c);
         magic = read_word(offset);
@@ -81,6 +98,52 @@ static void dump_file(char *file){
     return;
 }
 
+static void add_entry_point(const char *str) {
+    entry_points = realloc(entry_points, (entry_point_count + 1) * sizeof(*entry_points));
+    entry_points[entry_point_count++] = strdup(str);
+}
+
+/* one address per line; blank lines and lines starting with # are ignored */
+static int read_entry_file(const char *file) {
+    char line[256];
+    FILE *f;
+
+    if (!(f = fopen(file, "r"))) {
+        perror(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        size_t len;
+
+        while (*p == ' ' || *p == '\t') p++;
+        len = strcspn(p, " \t\r\n#");
+        if (!len) continue;
+        p[len] = 0;
+        add_entry_point(p);
+    }
+
+    fclose(f);
+    return 1;
+}
+
+static int parse_isa(const char *name) {
+    static const char *const names[] = {
+        "8086", "186", "286", "386", "486", "586", "p6", "sse", "sse2", "sse3",
+        "ssse3", "sse4", "avx", "avx2", "avx512", "all",
+    };
+    unsigned i;
+
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); i++) {
+        if (!strcasecmp(name, names[i])) {
+            isa = ISA_8086 + i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static const char help_message[] =
 "dump: tool to disassemble and print information from executable files.\n"
 "Usage: dump [options] <file(s)>\n"
@@ -103,9 +166,22 @@ static const char help_message[] =
 "\t-s, --full-contents                  Display full contents of all sections.\n"
 "\t-v, --version                        Print the version number of semblance.\n"
 "\t-x, --all-headers                    Print all headers.\n"
+"\t--cfg[=dot|json]                     Print only the control flow graph.\n"
+"\t--entry=ADDR                         Also scan code starting at ADDR.\n"
+"\t--entry-file=FILE                    Also scan code at each address listed in FILE.\n"
+"\t--extract-resources=DIR              Write resources to files in DIR, named\n"
+"\t                                     after the input file.\n"
+"\t--isa=CPU                            Only decode instructions that CPU has:\n"
+"\t\t8086, 186, 286, 386, 486, 586, p6, sse, sse2, sse3, ssse3, sse4,\n"
+"\t\tavx, avx2, avx512, or all (the default).\n"
+"\t--load-state=FILE                    Start from scan results saved with --save-state.\n"
 "\t--no-show-addresses                  Don't print instruction addresses.\n"
 "\t--no-show-raw-insn                   Don't print raw instruction hex code.\n"
 "\t--pe-rel-addr=[y/n]                  Use relative addresses for PE files.\n"
+"\t--save-state=FILE                    Save scan results for the (single) input file to FILE.\n"
+"\t--symbols=FILE                       Take function names from a linker map or .sym file.\n"
+"\t--xrefs                              Print cross-references to code and data,\n"
+"\t                                     both inline and as a list at the end.\n"
 ;
 
 static const struct option long_options[] = {
@@ -129,6 +205,15 @@ static const struct option long_options[] = {
     {"no-show-raw-insn",        no_argument,        NULL, NO_SHOW_RAW_INSN},
     {"no-prefix-addresses",     no_argument,        NULL, NO_SHOW_ADDRESSES},
     {"pe-rel-addr",             required_argument,  NULL, 0x80},
+    {"xrefs",                   no_argument,        NULL, 0x81},
+    {"cfg",                     optional_argument,  NULL, 0x82},
+    {"entry",                   required_argument,  NULL, 0x83},
+    {"entry-file",              required_argument,  NULL, 0x84},
+    {"save-state",              required_argument,  NULL, 0x85},
+    {"load-state",              required_argument,  NULL, 0x86},
+    {"extract-resources",       required_argument,  NULL, 0x87},
+    {"isa",                     required_argument,  NULL, 0x88},
+    {"symbols",                 required_argument,  NULL, 0x89},
     {0}
 };
 
@@ -138,6 +223,8 @@ int main(int argc, char *argv[]){
     mode = 0;
     opts = 0;
     asm_syntax = NASM;
+    isa = ISA_ALL;
+    init_instr_tables();
 
     while ((opt = getopt_long(argc, argv, "a::cCdDefhiM:osvx", long_options, NULL)) >= 0){
         switch (opt) {
@@ -153,12 +240,12 @@ int main(int argc, char *argv[]){
             if (optarg){
                 const char *p = optarg;
                 while (*p == ' ' || *p == '=') ++p;
-                resource_filters = realloc(resource_filters, (resource_filters_count + 1) * sizeof(*resource_filters));
-                resource_filters[resource_filters_count++] = strdup(p);
+                add_resource_filter(p);
             }
             break;
         }
-        case 'c': /* compilable */
+        case 'c': /* compilable; prints nothing but the disassembly */
+            mode |= DISASSEMBLE;
             opts |= COMPILABLE|NO_SHOW_ADDRESSES|NO_SHOW_RAW_INSN;
             break;
         case 'C': /* demangle */
@@ -216,18 +303,71 @@ int main(int argc, char *argv[]){
                 return 1;
             }
             break;
+        case 0x81:
+            mode |= DUMPXREFS;
+            break;
+        case 0x82: /* control flow graph */
+            mode |= DUMPCFG;
+            if (!optarg || !strcmp(optarg, "dot"))
+                cfg_format = CFG_DOT;
+            else if (!strcmp(optarg, "json"))
+                cfg_format = CFG_JSON;
+            else {
+                fprintf(stderr, "Unrecognized --cfg format `%s'.\n", optarg);
+                return 1;
+            }
+            break;
+        case 0x83:
+            add_entry_point(optarg);
+            break;
+        case 0x84:
+            if (!read_entry_file(optarg))
+                return 1;
+            break;
+        case 0x85:
+            save_state_file = optarg;
+            break;
+        case 0x86:
+            load_state_file = optarg;
+            break;
+        case 0x87: /* extract resources; honours the -a filters */
+            mode |= DUMPRSRC;
+            extract_dir = optarg;
+            if (mkdir(extract_dir, 0777) < 0 && errno != EEXIST) {
+                perror(extract_dir);
+                return 1;
+            }
+            break;
+        case 0x88:
+            if (!parse_isa(optarg)) {
+                fprintf(stderr, "Unrecognized instruction set `%s'.\n", optarg);
+                return 1;
+            }
+            break;
+        case 0x89:
+            symbol_files = realloc(symbol_files, (symbol_file_count + 1) * sizeof(*symbol_files));
+            symbol_files[symbol_file_count++] = optarg;
+            break;
         default:
             fprintf(stderr, "Usage: dumpne [options] <file>\n");
             return 1;
         }
     }
 
+    /* cross-references are long, so only print them when asked to; a graph
+     * replaces all other output, so likewise */
     if (mode == 0)
-        mode = ~0;
+        mode = ~(DUMPXREFS | DUMPCFG);
 
     if (optind == argc)
         printf(help_message);
 
+    /* a state file describes a single image */
+    if ((save_state_file || load_state_file) && argc - optind > 1) {
+        fprintf(stderr, "--save-state and --load-state take only one input file.\n");
+        return 1;
+    }
+
     while (optind < argc){
         dump_file(argv[optind++]);
         if (optind < argc)
@@ -0,0 +1,167 @@
+/*
+ * Writing resources out to files
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define _GNU_SOURCE /* copy_file_range */
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "semblance.h"
+
+const char *extract_dir;
+
+/* base name of the file being dumped */
+static const char *extract_base = "";
+
+/* Every file extracted from now on is named after file, so that resources
+ * from several input files don't overwrite each other. */
+void set_extract_input(const char *file)
+{
+    const char *p = strrchr(file, '/');
+
+    extract_base = p ? p + 1 : file;
+}
+
+/* Resource names can contain anything at all, so be careful to keep the
+ * result inside the extraction directory. Returns a newly allocated path. */
+static char *make_path(const char *name)
+{
+    char *path = malloc(strlen(extract_dir) + strlen(extract_base) + strlen(name) + 3), *p;
+
+    sprintf(path, "%s/", extract_dir);
+    p = path + strlen(path);
+    sprintf(p, "%s_%s", extract_base, name);
+    for (; *p; p++)
+    {
+        if (!isalnum(*p) && *p != '.' && *p != '_' && *p != '-')
+            *p = '_';
+    }
+    if (path[strlen(extract_dir) + 1] == '.')
+        path[strlen(extract_dir) + 1] = '_';
+    return path;
+}
+
+static int create_file(const char *path)
+{
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+        perror(path);
+    return fd;
+}
+
+/* Write length bytes of the input file, starting at offset, to a new file
+ * called name inside extract_dir. The kernel can usually copy the data
+ * without it passing through us at all; otherwise we write() it straight out
+ * of the map. Returns nonzero on success. */
+int extract_file(const char *name, off_t offset, size_t length)
+{
+    char *path = make_path(name);
+    ssize_t ret;
+    int fd;
+
+    if ((fd = create_file(path)) < 0)
+    {
+        free(path);
+        return 0;
+    }
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (length)
+    {
+        loff_t in = offset;
+
+        /* EXDEV, EINVAL, ENOSYS etc. just mean we have to do it ourselves */
+        if ((ret = copy_file_range(map_fd, &in, fd, NULL, length, 0)) <= 0)
+            break;
+        offset += ret;
+        length -= ret;
+    }
+#endif
+
+    while (length)
+    {
+        if ((ret = write(fd, map + offset, length)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror(path);
+            break;
+        }
+        offset += ret;
+        length -= ret;
+    }
+
+    close(fd);
+    free(path);
+    return !length;
+}
+
+/* Same, but for files that we have to stitch together from a header we built
+ * and pieces of the map. Everything goes out in one writev() call unless the
+ * kernel gives us a short write. The iovec array is modified. */
+int extract_iov(const char *name, struct iovec *iov, int count)
+{
+    char *path = make_path(name);
+    ssize_t ret;
+    int fd;
+
+    if ((fd = create_file(path)) < 0)
+    {
+        free(path);
+        return 0;
+    }
+
+    while (count)
+    {
+        if ((ret = writev(fd, iov, min(count, IOV_MAX))) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror(path);
+            break;
+        }
+
+        while (count && (size_t)ret >= iov->iov_len)
+        {
+            ret -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count)
+        {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    close(fd);
+    free(path);
+    return !count;
+}
@@ -26,6 +26,7 @@
 #include "semblance.h"
 #include "x86_instr.h"
 #include "mz.h"
+#include "cfg.h"
 
 #pragma pack(1)
 
@@ -46,8 +47,33 @@ static void print_header(const struct header_mz *header) {
 #define warn_at(...)
 #endif
 
-static int print_mz_instr(dword ip, const byte *p, const byte *flags) {
+/* Addresses in the xref table carry the segment index above the 20 bits of
+ * a real-mode address. */
+#define MZ_ADDR(seg, ip) (((dword)(seg) << 20) | (ip))
+
+static void mz_addr(char *out, dword addr, const void *ctx) {
+    if (addr >> 20)
+        sprintf(out, "%d:%05x", addr >> 20, addr & 0xfffff);
+    else
+        sprintf(out, "%05x", addr);
+}
+
+/* Label for a byte of seg in compilable output, or NULL if it hasn't got
+ * one. */
+static const char *get_mz_label(const struct mz_segment *seg, dword ip) {
+    static char label[48];
+
+    if (ip >= seg->length || !(seg->flags[ip] & INSTR_LABEL))
+        return NULL;
+    get_label(label, MZ_ADDR(seg->overlay, ip), seg->flags[ip], mz_addr, NULL);
+    return label;
+}
+
+static int print_mz_instr(const struct mz_segment *seg, dword ip, const byte *p, const struct xref_table *xrefs) {
+    const byte *flags = seg->flags;
     struct instr instr = {0};
+    char argstr[3][ARG_LEN] = {{0}};
+    const char *label;
     unsigned len;
 
     char ip_string[7];
@@ -56,95 +82,223 @@ static int print_mz_instr(dword ip, const byte *p, const byte *flags) {
 
     sprintf(ip_string, "%05x", ip);
 
-    print_instr(ip_string, p, len, flags[ip], &instr, NULL, 16);
+    if (instr.argtype[0] == REL && instr.size == 16)
+        sprintf(argstr[0], "%05x", branch_target(&instr, len, 1));
+    else if (instr.argtype[0] == SEGPTR)
+        /* the segment is relative to the load segment, like e_cs */
+        sprintf(argstr[0], "%04x:%04lx", *(word *)(p + instr.argoff[0] + 2), instr.args[0]);
+
+    if (opts & COMPILABLE) {
+        print_labels(MZ_ADDR(seg->overlay, ip), flags + ip, min(len, seg->length - ip), mz_addr, NULL, asm_syntax);
+
+        if (instr.argtype[0] == REL8 || instr.argtype[0] == REL) {
+            if ((label = get_mz_label(seg, branch_target(&instr, len, 1))))
+                print_label_arg("", &instr, 0, 16, asm_syntax, label, argstr[0]);
+        } else if (instr.argtype[0] == SEGPTR && !seg->overlay && asm_syntax != GAS
+                && arg_ip(&instr, 0) + 2 < seg->length && (flags[arg_ip(&instr, 0) + 2] & INSTR_RELOC)) {
+            /* only the load module is relocated */
+            label = get_mz_label(seg, realaddr(*(word *)(p + instr.argoff[0] + 2), instr.args[0]));
+            if (label && strlen(label) < 12)
+                sprintf(argstr[0], (asm_syntax == NASM) ? "(seg %s):%s" : "far ptr %s", label, label);
+        }
+    }
+
+    if (mode & DUMPXREFS)
+        print_xref_comment(xrefs, MZ_ADDR(seg->overlay, ip), mz_addr, NULL, asm_syntax);
+
+    print_instr(ip_string, p, len, flags[ip], &instr, argstr, NULL, 16, asm_syntax);
 
     return len;
 }
 
-static void print_code(struct mz *mz) {
+/* Flags for overlays are only allocated once something in them is scanned
+ * (or we're asked to dump everything). */
+static byte *get_flags(struct mz_segment *seg) {
+    if (!seg->flags)
+        seg->flags = calloc(seg->length, sizeof(byte));
+    return seg->flags;
+}
+
+/* Compilable output: all of the segment, with labels wherever the scanner
+ * found a reference. DOS programs mix code and data freely, so anything the
+ * scanner didn't reach is printed as data. */
+static void print_compilable(const struct mz *mz, const struct mz_segment *seg) {
+    dword ip = 0, start;
+    byte buffer[MAX_INSTR];
+    char name[12];
+
+    if (seg->overlay)
+        sprintf(name, "ovl%d", seg->overlay);
+    else
+        strcpy(name, "code");
+    print_region_start(name, 16, asm_syntax);
+
+    while (ip < seg->length) {
+        for (start = ip; ip < seg->length && !(seg->flags[ip] & INSTR_VALID); ip++);
+        print_data_range(seg->start + start, seg->flags + start, MZ_ADDR(seg->overlay, start),
+                ip - start, ip - start, mz_addr, NULL, asm_syntax);
+        if (ip >= seg->length) break;
+
+        memset(buffer, 0, sizeof(buffer));
+        memcpy(buffer, read_data(seg->start + ip), min(sizeof(buffer), seg->length - ip));
+        ip += print_mz_instr(seg, ip, buffer, &mz->xrefs);
+    }
+
+    print_region_end(name, asm_syntax);
+}
+
+static void print_code(const struct mz *mz, struct mz_segment *seg) {
     dword ip = 0;
     byte buffer[MAX_INSTR];
 
     putchar('\n');
-    printf("Code (start = 0x%x, length = 0x%x):\n", mz->start, mz->length);
+    if (seg->overlay)
+        printf("Overlay %d (%s, start = 0x%x, length = 0x%x):\n",
+            seg->overlay, seg->borland ? "FBOV" : "MS", seg->start, seg->length);
+    else
+        printf("Code (start = 0x%x, length = 0x%x):\n", seg->start, seg->length);
 
-    while (ip < mz->length) {
+    while (ip < seg->length) {
         /* find a valid instruction */
-        if (!(mz->flags[ip] & INSTR_VALID)) {
+        if (!(seg->flags[ip] & INSTR_VALID)) {
             if (opts & DISASSEMBLE_ALL) {
                 /* still skip zeroes */
-                if (read_byte(mz->start + ip) == 0) {
+                if (read_byte(seg->start + ip) == 0) {
                     printf("      ...\n");
                     ip++;
-                    while (read_byte(mz->start + ip) == 0) ip++;
+                    while (ip < seg->length && read_byte(seg->start + ip) == 0) ip++;
                 }
             } else {
                 printf("     ...\n");
-                while ((ip < mz->length) && !(mz->flags[ip] & INSTR_VALID)) ip++;
+                while ((ip < seg->length) && !(seg->flags[ip] & INSTR_VALID)) ip++;
             }
         }
 
-        if (ip >= mz->length) return;
+        if (ip >= seg->length) return;
 
         /* fixme: disassemble everything for now; we'll try to fix it later.
          * this is going to be a little more difficult since dos executables
          * unabashedly mix code and data, so we need to figure out a solution
          * for that. but we needed to do that anyway. */
 
-        memcpy(buffer, read_data(mz->start + ip), min(sizeof(buffer), mz->length - ip));
+        memset(buffer, 0, sizeof(buffer));
+        memcpy(buffer, read_data(seg->start + ip), min(sizeof(buffer), seg->length - ip));
 
-        if (mz->flags[ip] & INSTR_FUNC) {
+        if (seg->flags[ip] & INSTR_FUNC) {
+            const char *name = symbol_name(&mz->symbols, MZ_ADDR(seg->overlay, ip));
             printf("\n");
-            printf("%05x <no name>:\n", ip);
+            printf("%05x <%s>:\n", ip, name ? name : "no name");
         }
 
-        ip += print_mz_instr(ip, buffer, mz->flags);
+        ip += print_mz_instr(seg, ip, buffer, &mz->xrefs);
     }
 }
 
-static void scan_segment(dword ip, struct mz *mz) {
+static struct mz_segment *find_overlay(struct mz *mz, word ovno) {
+    unsigned i;
+
+    for (i = 1; i < mz->segment_count; i++) {
+        if (!mz->segments[i].borland && mz->segments[i].ovno == ovno)
+            return &mz->segments[i];
+    }
+    return NULL;
+}
+
+static void scan_segment(unsigned segnum, dword ip, struct mz *mz) {
+    struct mz_segment *seg = &mz->segments[segnum];
+    byte *flags = get_flags(seg);
     byte buffer[MAX_INSTR];
     struct instr instr;
     int instr_length;
     int i;
 
-    if (ip > mz->length) {
+    if (ip > seg->length) {
         warn_at("Attempt to scan past end of segment.\n");
         return;
     }
 
-    if ((mz->flags[ip] & (INSTR_VALID|INSTR_SCANNED)) == INSTR_SCANNED)
+    if ((flags[ip] & (INSTR_VALID|INSTR_SCANNED)) == INSTR_SCANNED)
         warn_at("Attempt to scan byte that does not begin instruction.\n");
 
-    while (ip < mz->length) {
+    while (ip < seg->length) {
         /* check if we already read from here */
-        if (mz->flags[ip] & INSTR_SCANNED) return;
+        if (flags[ip] & INSTR_SCANNED) return;
 
         /* read the instruction */
         memset(buffer, 0, sizeof(buffer));  // fixme
-        memcpy(buffer, read_data(mz->start + ip), min(sizeof(buffer), mz->length - ip));
+        memcpy(buffer, read_data(seg->start + ip), min(sizeof(buffer), seg->length - ip));
         instr_length = get_instr(ip, buffer, &instr, 16);
 
         /* mark the bytes */
-        mz->flags[ip] |= INSTR_VALID;
-        for (i = ip; i < ip+instr_length && i < mz->length; i++) mz->flags[i] |= INSTR_SCANNED;
+        flags[ip] |= INSTR_VALID;
+        for (i = ip; i < ip+instr_length && i < seg->length; i++) flags[i] |= INSTR_SCANNED;
 
         /* instruction which hangs over the minimum allocation */
-        if (i < ip+instr_length && i == mz->length) break;
+        if (i < ip+instr_length && i == seg->length) break;
 
         /* handle conditional and unconditional jumps */
-        if (instr.op.flags & OP_BRANCH) {
+        if (instr.op->flags & OP_BRANCH) {
             /* near relative jump, loop, or call */
-            if (!strcmp(instr.op.name, "call"))
-                mz->flags[instr.args[0].value] |= INSTR_FUNC;
-            else
-                mz->flags[instr.args[0].value] |= INSTR_JUMP;
+            dword target = branch_target(&instr, instr_length, 1);
 
-            /* scan it */
-            scan_segment(instr.args[0].value, mz);
+            if (target >= seg->length) {
+                warn_at("Branch target %05x exceeds segment length.\n", target);
+            } else {
+                if (instr.op->flags & OP_CALL) {
+                    flags[target] |= INSTR_FUNC;
+                    xref_add(&mz->xrefs, MZ_ADDR(segnum, ip), MZ_ADDR(segnum, target), XREF_CALL);
+                } else {
+                    flags[target] |= INSTR_JUMP;
+                    xref_add(&mz->xrefs, MZ_ADDR(segnum, ip), MZ_ADDR(segnum, target), XREF_JUMP);
+                }
+
+                /* scan it */
+                scan_segment(segnum, target, mz);
+            }
+        } else if (instr.argtype[0] == SEGPTR) {
+            /* Far call or jump. We can only follow it if the loader fixes up
+             * the segment; otherwise it points somewhere absolute, like the
+             * BIOS. Only the load module has relocations. */
+            dword seg_ip = arg_ip(&instr, 0) + 2;
+
+            if (!segnum && seg_ip < seg->length && (flags[seg_ip] & INSTR_RELOC)) {
+                dword target = realaddr(read_word(seg->start + seg_ip), instr.args[0]);
+                int call = !!(instr.op->flags & OP_CALL);
+
+                if (target >= seg->length) {
+                    warn_at("Far branch target %05x exceeds segment length.\n", target);
+                } else {
+                    flags[target] |= INSTR_FAR | (call ? INSTR_FUNC : INSTR_JUMP);
+                    xref_add(&mz->xrefs, ip, target, XREF_FAR | (call ? XREF_CALL : XREF_JUMP));
+                    scan_segment(0, target, mz);
+                }
+            }
+        } else if (instr.op->opcode == 0xcd && instr.args[0] == 0x3f && ip + 5 <= seg->length) {
+            /* The Microsoft overlay manager's calls look like
+             *     int 3fh
+             *     db overlay
+             *     dw offset
+             * so skip the data and follow the call into the overlay. */
+            struct mz_segment *ovl = find_overlay(mz, read_byte(seg->start + ip + 2));
+            dword target = read_word(seg->start + ip + 3);
+
+            for (i = ip + 2; i < ip + 5; i++) flags[i] |= INSTR_SCANNED;
+            instr_length = 5;
+
+            if (!ovl) {
+                warn_at("Call to nonexistent overlay %d.\n", read_byte(seg->start + ip + 2));
+            } else if (target >= ovl->length) {
+                warn_at("Overlay call target %05x exceeds overlay length.\n", target);
+            } else {
+                unsigned ovlnum = ovl - mz->segments;
+
+                get_flags(ovl)[target] |= INSTR_FAR | INSTR_FUNC;
+                xref_add(&mz->xrefs, MZ_ADDR(segnum, ip), MZ_ADDR(ovlnum, target), XREF_FAR | XREF_CALL);
+                scan_segment(ovlnum, target, mz);
+            }
         }
 
-        if (instr.op.flags & OP_STOP)
+        if (instr.op->flags & OP_STOP)
             return;
 
         ip += instr_length;
@@ -153,17 +307,184 @@ static void scan_segment(dword ip, struct mz *mz) {
     warn_at("Scan reached the end of segment.\n");
 }
 
+static void print_xrefs(struct mz *mz) {
+    char from[32], to[32];
+    unsigned i;
+
+    xref_sort(&mz->xrefs);
+
+    putchar('\n');
+    printf("Cross-references:\n");
+
+    for (i = 0; i < mz->xrefs.count; i++) {
+        const struct xref *x = &mz->xrefs.xrefs[i];
+
+        mz_addr(to, x->to, NULL);
+        mz_addr(from, x->from, NULL);
+        if (!i || x->to != x[-1].to) {
+            const char *name = symbol_name(&mz->symbols, x->to);
+            if (name)
+                printf("%s <%s>:\n", to, name);
+            else
+                printf("%s:\n", to);
+        }
+        printf("\t%s\t%s\n", from, xref_type_name(x->type));
+    }
+}
+
+static void print_cfg(const struct mz *mz) {
+    struct cfg_region *regions = malloc(mz->segment_count * sizeof(*regions));
+    unsigned count = 0, i;
+    struct cfg cfg;
+
+    for (i = 0; i < mz->segment_count; i++) {
+        const struct mz_segment *seg = &mz->segments[i];
+
+        if (!seg->flags) continue;
+
+        regions[count].base = MZ_ADDR(i, 0);
+        regions[count].ip = 0;
+        regions[count].length = seg->length;
+        regions[count].offset = seg->start;
+        regions[count].flags = seg->flags;
+        regions[count].bits = 16;
+        regions[count].linear = 1;
+        count++;
+    }
+
+    cfg_build(&cfg, regions, count);
+    cfg_print(&cfg, "mz", mz_addr, NULL);
+    cfg_free(&cfg);
+    free(regions);
+}
+
+static void add_segment(struct mz *mz, word ovno, int borland, dword start, dword length) {
+    struct mz_segment *seg;
+
+    mz->segments = realloc(mz->segments, (mz->segment_count + 1) * sizeof(*mz->segments));
+    seg = &mz->segments[mz->segment_count];
+    seg->overlay = mz->segment_count++;
+    seg->ovno = ovno;
+    seg->borland = borland;
+    seg->start = start;
+    seg->length = length;
+    seg->flags = NULL;
+}
+
+/* size of an MZ image, header included, according to its header */
+static dword image_size(const struct header_mz *header) {
+    dword size = ((header->e_cp - 1) * 512) + header->e_cblp;
+    if (header->e_cblp == 0) size += 512;
+    return size;
+}
+
+/* Overlays are appended to the file after the load module. We know of two
+ * kinds: Microsoft's, which are complete MZ images with e_ovno set, and
+ * Borland's (VROOM), which are stored in one "FBOV" block. Only note where
+ * they are for now; they're read when something calls into them. */
+static void read_overlays(struct mz *mz, dword offset) {
+    while (offset + sizeof(struct header_mz) <= map_size) {
+        const struct header_mz *header = read_data(offset);
+
+        if (header->e_magic == 0x5a4d && header->e_ovno) {
+            dword size = image_size(header), start = header->e_cparhdr * 16;
+
+            if (!header->e_cp || size < start || size > map_size - offset) {
+                warn("Overlay at %#x has a bad size\n", offset);
+                break;
+            }
+            add_segment(mz, header->e_ovno, 0, offset + start, size - start);
+            offset += size;
+        } else if (!memcmp(header, "FBOV", 4)) {
+            /* 00 signature, 04 size of overlay data, 08 offset of the
+             * segment table in the load module, 0c segment count */
+            dword size = read_dword(offset + 4);
+
+            /* Some linkers count the header in the size. We don't read the
+             * segment table, so nothing can call into these; they only show
+             * up with -D. */
+            if (size > map_size - offset - 0x10)
+                size = map_size - offset - 0x10;
+            add_segment(mz, 0, 1, offset + 0x10, size);
+            offset += 0x10 + size;
+        } else
+            break;
+    }
+}
+
 static void read_code(struct mz *mz) {
+    struct mz_segment *seg;
+    dword size = image_size(mz->header);
+    unsigned i;
 
     mz->entry_point = realaddr(mz->header->e_cs, mz->header->e_ip);
-    mz->length = ((mz->header->e_cp - 1) * 512) + mz->header->e_cblp;
-    if (mz->header->e_cblp == 0) mz->length += 512;
-    mz->flags = calloc(mz->length, sizeof(byte));
 
-    if (mz->entry_point > mz->length)
-        warn("Entry point %05x exceeds segment length (%05x)\n", mz->entry_point, mz->length);
-    mz->flags[mz->entry_point] |= INSTR_FUNC;
-    scan_segment(mz->entry_point, mz);
+    /* the page count includes the header */
+    add_segment(mz, 0, 0, mz->header->e_cparhdr * 16, size - mz->header->e_cparhdr * 16);
+    read_overlays(mz, size);
+
+    seg = &mz->segments[0];
+    get_flags(seg);
+
+    /* Mark the segment words that the loader will fix up. We need to know
+     * these to tell which far pointers can be followed. */
+    for (i = 0; i < mz->header->e_crlc; i++) {
+        dword addr = realaddr(mz->reltab[i].segment, mz->reltab[i].offset);
+
+        if (addr + 2 > seg->length) {
+            warn("Relocation %04x:%04x exceeds segment length (%05x)\n",
+                mz->reltab[i].segment, mz->reltab[i].offset, seg->length);
+            continue;
+        }
+        seg->flags[addr] |= INSTR_RELOC;
+    }
+
+    /* saved state only covers the load module */
+    load_state(&seg->flags, &seg->length, 1, &mz->xrefs);
+
+    if (mz->entry_point > seg->length)
+        warn("Entry point %05x exceeds segment length (%05x)\n", mz->entry_point, seg->length);
+    seg->flags[mz->entry_point] |= INSTR_FUNC;
+    scan_segment(0, mz->entry_point, mz);
+
+    /* user-supplied entry points, either linear or seg:off (relative to the
+     * load segment, like e_cs) */
+    for (i = 0; i < entry_point_count; i++) {
+        unsigned segment, off;
+        dword ip;
+
+        if (sscanf(entry_points[i], "%x:%x", &segment, &off) == 2)
+            ip = realaddr(segment, off);
+        else if (sscanf(entry_points[i], "%x", &ip) != 1) {
+            fprintf(stderr, "Invalid entry point `%s'.\n", entry_points[i]);
+            continue;
+        }
+
+        seg = &mz->segments[0];
+        if (ip >= seg->length) {
+            fprintf(stderr, "Entry point %05x exceeds segment length (%05x).\n", ip, seg->length);
+            continue;
+        }
+        seg->flags[ip] |= INSTR_FUNC;
+        scan_segment(0, ip, mz);
+    }
+
+    /* scanning is done; the disassembly looks references up as it goes */
+    xref_sort(&mz->xrefs);
+
+    seg = &mz->segments[0];
+    save_state(&seg->flags, &seg->length, 1, &mz->xrefs);
+}
+
+/* Symbol files give real-mode frames, relative to the load module like e_cs.
+ * There's no way to name anything in an overlay. */
+static int get_symbol_addr(word seg, dword offset, dword *addr, const void *ctx) {
+    const struct mz *mz = ctx;
+
+    if (offset > 0xffff)
+        return 0;
+    *addr = realaddr(seg, offset);
+    return *addr < mz->segments[0].length;
 }
 
 void readmz(struct mz *mz) {
@@ -173,26 +494,64 @@ void readmz(struct mz *mz) {
     mz->reltab = read_data(mz->header->e_lfarlc);
 
     /* read the code */
-    mz->start = mz->header->e_cparhdr * 16;
     read_code(mz);
+
+    if (symbol_file_count)
+        load_symbols(&mz->symbols, get_symbol_addr, mz);
 }
 
 void freemz(struct mz *mz) {
-    free(mz->flags);
+    unsigned i;
+
+    for (i = 0; i < mz->segment_count; i++)
+        free(mz->segments[i].flags);
+    free(mz->segments);
+    xref_free(&mz->xrefs);
+    free_symbols(&mz->symbols);
 }
 
 void dumpmz(void) {
-    struct mz mz;
+    struct mz mz = {0};
+    unsigned i;
 
     readmz(&mz);
 
+    if (mode & DUMPCFG) {
+        print_cfg(&mz);
+        freemz(&mz);
+        return;
+    }
+
+    if (opts & COMPILABLE) {
+        for (i = 0; i < mz.segment_count; i++) {
+            get_flags(&mz.segments[i]);
+            print_compilable(&mz, &mz.segments[i]);
+        }
+        freemz(&mz);
+        return;
+    }
+
     printf("Module type: MZ (DOS executable)\n");
 
-    if (mode & DUMPHEADER)
+    if (mode & DUMPHEADER) {
         print_header(mz.header);
+        for (i = 1; i < mz.segment_count; i++)
+            printf("Overlay %d: %s, start = 0x%x, length = 0x%x\n", i,
+                mz.segments[i].borland ? "FBOV" : "MS", mz.segments[i].start, mz.segments[i].length);
+    }
+
+    if (mode & DISASSEMBLE) {
+        for (i = 0; i < mz.segment_count; i++) {
+            /* overlays nobody calls into are skipped, unless asked for */
+            if (!mz.segments[i].flags && !(opts & DISASSEMBLE_ALL))
+                continue;
+            get_flags(&mz.segments[i]);
+            print_code(&mz, &mz.segments[i]);
+        }
+    }
 
-    if (mode & DISASSEMBLE)
-        print_code(&mz);
+    if (mode & DUMPXREFS)
+        print_xrefs(&mz);
 
     freemz(&mz);
 }
@@ -2,6 +2,8 @@
 #define __MZ_H
 
 #include "semblance.h"
+#include "symbols.h"
+#include "xref.h"
 
 /* MZ (aka real-mode) addresses are "segmented", but not really. Just
  * use the actual value. */
@@ -41,6 +43,17 @@ struct reloc {
     word segment;
 };
 
+/* A stretch of code that is scanned on its own: the load module, or an
+ * overlay appended to the file. */
+struct mz_segment {
+    unsigned overlay;   /* index into mz->segments; 0 for the load module */
+    word ovno;          /* overlay number used by int 3fh (MS overlays) */
+    int borland;        /* FBOV overlay */
+    dword start;        /* file offset */
+    dword length;
+    byte *flags;        /* NULL until something in it is scanned */
+};
+
 struct mz {
     /* fixme: file pointer here */
 
@@ -49,9 +62,11 @@ struct mz {
 
     /* code */
     dword entry_point;
-    byte *flags;
-    dword start;
-    dword length;
+    struct mz_segment *segments;
+    unsigned segment_count;
+
+    struct xref_table xrefs;
+    struct symbol_table symbols;
 };
 
 extern void readmz(struct mz *mz);
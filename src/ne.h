@@ -2,6 +2,9 @@
 #define __NE_H
 
 #include "semblance.h"
+#include "arena.h"
+#include "symbols.h"
+#include "xref.h"
 
 #pragma pack(1)
 
@@ -53,25 +56,24 @@ struct entry {
     char *name;     /* may be NULL */
 };
 
-struct export {
-    word ordinal;
-    char *name;
-};
-
 struct import_module {
     char *name;
-    struct export *exports;
-    unsigned export_count;
+    char **exports;         /* indexed by ordinal; entries may be NULL */
+    unsigned export_count;  /* highest ordinal + 1 */
 };
 
 struct reloc {
     byte size;
     byte type;
-    word offset_count;
-    word *offsets;
     word tseg;
     word toffset;
-    char *text;
+    const char *text;
+};
+
+/* one location a relocation is applied to */
+struct reloc_offset {
+    word offset;
+    word index;     /* into reloc_table */
 };
 
 struct segment {
@@ -83,6 +85,8 @@ struct segment {
     byte *instr_flags;
     struct reloc *reloc_table;
     word reloc_count;
+    struct reloc_offset *reloc_offsets;     /* sorted by offset */
+    unsigned reloc_offset_count;
 };
 
 struct ne {
@@ -97,17 +101,26 @@ struct ne {
 
     struct entry *enttab;
     unsigned entcount;
+    /* entries with a segment, sorted by segment and offset */
+    const struct entry **entry_index;
+    unsigned entry_index_count;
 
     struct import_module *imptab;
 
     struct segment *segments;
+
+    struct xref_table xrefs;
+    struct symbol_table symbols;
+
+    struct arena arena;     /* most of the above, except names we demangle */
 };
 
 /* in ne_resource.c */
 extern void print_rsrc(off_t start);
 /* in ne_segment.c */
 extern void read_segments(off_t start, struct ne *ne);
-extern void free_segments(struct ne *ne);
 extern void print_segments(struct ne *ne);
+extern void print_ne_xrefs(struct ne *ne);
+extern void print_ne_cfg(const struct ne *ne);
 
 #endif /* __NE_H */
@@ -377,7 +377,7 @@ static char *demangle(char *func) {
 }
 
 /* return the first entry (module name/desc) */
-static char *read_res_name_table(off_t start, struct entry *entry_table)
+static char *read_res_name_table(off_t start, struct ne *ne)
 {
     /* reads (non)resident names into our entry table */
     off_t cursor = start;
@@ -386,9 +386,7 @@ static char *read_res_name_table(off_t start, struct entry *entry_table)
     char *name;
 
     length = read_byte(cursor++);
-    first = malloc((length+1)*sizeof(char));
-    memcpy(first, read_data(cursor), length);
-    first[length] = 0;
+    first = arena_strndup(&ne->arena, read_data(cursor), length);
     cursor += length + 2;
 
     while ((length = read_byte(cursor++)))
@@ -401,13 +399,27 @@ static char *read_res_name_table(off_t start, struct entry *entry_table)
         if ((opts & DEMANGLE) && name[0] == '?')
             name = demangle(name);
 
-        entry_table[read_word(cursor) - 1].name = name;
+        ne->enttab[read_word(cursor) - 1].name = name;
         cursor += 2;
     }
 
     return first;
 }
 
+/* Sort by address; entries with the same address stay in ordinal order, so
+ * lookups find the first one like a linear search would. */
+static int compare_entry_addr(const void *a, const void *b)
+{
+    const struct entry *entry_a = *(const struct entry **)a;
+    const struct entry *entry_b = *(const struct entry **)b;
+
+    if (entry_a->segment != entry_b->segment)
+        return entry_a->segment - entry_b->segment;
+    if (entry_a->offset != entry_b->offset)
+        return entry_a->offset - entry_b->offset;
+    return (entry_a > entry_b) - (entry_a < entry_b);
+}
+
 static void get_entry_table(off_t start, struct ne *ne)
 {
     byte length, index;
@@ -425,7 +437,7 @@ static void get_entry_table(off_t start, struct ne *ne)
         if (index != 0)
             cursor += (index == 0xff ? 6 : 3) * length;
     }
-    ne->enttab = calloc(sizeof(struct entry), count);
+    ne->enttab = arena_alloc(&ne->arena, count * sizeof(struct entry));
 
     count = 0;
     cursor = start;
@@ -454,6 +466,21 @@ static void get_entry_table(off_t start, struct ne *ne)
     }
 
     ne->entcount = count;
+
+    /* index the entries by address, for get_entry_name() */
+    ne->entry_index = NULL;
+    ne->entry_index_count = 0;
+    if (!count)
+        return;
+
+    ne->entry_index = arena_alloc(&ne->arena, count * sizeof(*ne->entry_index));
+    for (i = 0; i < count; i++)
+    {
+        if (ne->enttab[i].segment)
+            ne->entry_index[ne->entry_index_count++] = &ne->enttab[i];
+    }
+    if (ne->entry_index_count)
+        qsort(ne->entry_index, ne->entry_index_count, sizeof(*ne->entry_index), compare_entry_addr);
 }
 
 static void load_exports(struct import_module *module) {
@@ -477,17 +504,19 @@ static void load_exports(struct import_module *module) {
         }
     }
 
-    /* first grab a count */
+    /* first find the highest ordinal; ordinals are small and mostly
+     * contiguous, so we index the names by ordinal directly */
     count = 0;
     while (fgets(line, sizeof(line), specfile)) {
         if (line[0] == '#' || line[0] == '\n') continue;
-        count++;
+        if (sscanf(line, "%hu", &ordinal) == 1 && ordinal >= count)
+            count = ordinal + 1;
     }
 
-    module->exports = malloc(count * sizeof(struct export));
+    module->exports = calloc(count, sizeof(char *));
+    module->export_count = count;
 
     fseek(specfile, 0, SEEK_SET);
-    count = 0;
     while (fgets(line, sizeof(line), specfile)) {
         if (line[0] == '#' || line[0] == '\n') continue;
         if ((p = strchr(line, '\n'))) *p = 0;   /* kill final newline */
@@ -495,23 +524,18 @@ static void load_exports(struct import_module *module) {
             fprintf(stderr, "Error reading specfile near line: `%s'\n", line);
             continue;
         }
-        module->exports[count].ordinal = ordinal;
 
+        /* the first name given for an ordinal wins */
         p = strchr(line, '\t');
-        if (p) {
+        if (p && !module->exports[ordinal]) {
             p++;
-            module->exports[count].name = strdup(p);
-    
-            if ((opts & DEMANGLE) && module->exports[count].name[0] == '?')
-                module->exports[count].name = demangle(module->exports[count].name);
-        } else {
-            module->exports[count].name = NULL;
+            module->exports[ordinal] = strdup(p);
+
+            if ((opts & DEMANGLE) && module->exports[ordinal][0] == '?')
+                module->exports[ordinal] = demangle(module->exports[ordinal]);
         }
-        count++;
     }
 
-    module->export_count = count;
-
     fclose(specfile);
 }
 
@@ -521,13 +545,11 @@ static void get_import_module_table(off_t start, struct ne *ne)
     byte length;
     unsigned i;
 
-    ne->imptab = malloc(ne->header.ne_cmod * sizeof(struct import_module));
+    ne->imptab = arena_alloc(&ne->arena, ne->header.ne_cmod * sizeof(struct import_module));
     for (i = 0; i < ne->header.ne_cmod; i++) {
         offset = read_word(start + i * 2);
         length = ne->nametab[offset];
-        ne->imptab[i].name = malloc((length+1)*sizeof(char));
-        memcpy(ne->imptab[i].name, &ne->nametab[offset+1], length);
-        ne->imptab[i].name[length] = 0;
+        ne->imptab[i].name = arena_strndup(&ne->arena, (const char *)&ne->nametab[offset+1], length);
 
         if (mode & DISASSEMBLE)
             load_exports(&ne->imptab[i]);
@@ -538,50 +560,58 @@ static void get_import_module_table(off_t start, struct ne *ne)
     }
 }
 
+static int get_symbol_addr(word seg, dword offset, dword *addr, const void *ctx) {
+    const struct ne *ne = ctx;
+
+    if (!seg || seg > ne->header.ne_cseg || offset > 0xffff)
+        return 0;
+    *addr = (seg << 16) | offset;
+    return 1;
+}
+
 static void readne(off_t offset_ne, struct ne *ne) {
     memcpy(&ne->header, read_data(offset_ne), sizeof(ne->header));
 
     /* read our various tables */
     get_entry_table(offset_ne + ne->header.ne_enttab, ne);
-    ne->name = read_res_name_table(offset_ne + ne->header.ne_restab, ne->enttab);
+    ne->name = read_res_name_table(offset_ne + ne->header.ne_restab, ne);
     if (ne->header.ne_nrestab)
-        ne->description = read_res_name_table(ne->header.ne_nrestab, ne->enttab);
+        ne->description = read_res_name_table(ne->header.ne_nrestab, ne);
     else
         ne->description = NULL;
     ne->nametab = read_data(offset_ne + ne->header.ne_imptab);
     get_import_module_table(offset_ne + ne->header.ne_modtab, ne);
+    if (symbol_file_count)
+        load_symbols(&ne->symbols, get_symbol_addr, ne);
     read_segments(offset_ne + ne->header.ne_segtab, ne);
 }
 
 static void freene(struct ne *ne) {
     int i, j;
 
-    free(ne->name);
-    free(ne->description);
-
-    /* free the entry table */
+    /* names may have been reallocated by demangle(), so they're not in the
+     * arena */
     if (ne->enttab) {
         for (i = 0; i < ne->entcount; i++)
             free(ne->enttab[i].name);
-        free(ne->enttab);
     }
 
-    /* free the import module table */
+    /* nor are the exports, which come from specfiles */
     if (ne->imptab) {
         for (i = 0; i < ne->header.ne_cmod; i++) {
-            free(ne->imptab[i].name);
             for (j = 0; j < ne->imptab[i].export_count; j++)
-                free(ne->imptab[i].exports[j].name);
+                free(ne->imptab[i].exports[j]);
             free(ne->imptab[i].exports);
         }
-        free(ne->imptab);
     }
 
-    free_segments(ne);
+    xref_free(&ne->xrefs);
+    free_symbols(&ne->symbols);
+    arena_free(&ne->arena);
 }
 
 void dumpne(off_t offset_ne) {
-    struct ne ne;
+    struct ne ne = {0};
     int i;
 
     readne(offset_ne, &ne);
@@ -592,6 +622,18 @@ void dumpne(off_t offset_ne) {
         return;
     }
 
+    if (mode & DUMPCFG) {
+        print_ne_cfg(&ne);
+        freene(&ne);
+        return;
+    }
+
+    if (opts & COMPILABLE) {
+        print_segments(&ne);
+        freene(&ne);
+        return;
+    }
+
     printf("Module type: NE (New Executable)\n");
     printf("Module name: %s\n", ne.name);
     if (ne.description)
@@ -616,6 +658,9 @@ void dumpne(off_t offset_ne) {
     if (mode & DISASSEMBLE)
         print_segments(&ne);
 
+    if (mode & DUMPXREFS)
+        print_ne_xrefs(&ne);
+
     if (mode & DUMPRSRC){
         if (ne.header.ne_rsrctab != ne.header.ne_restab)
             print_rsrc(offset_ne + ne.header.ne_rsrctab);
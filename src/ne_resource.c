@@ -24,6 +24,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "semblance.h"
 #include "ne.h"
@@ -46,6 +50,39 @@ struct header_bitmap_info {
 
 STATIC_ASSERT(sizeof(struct header_bitmap_info) == 0x28);
 
+/* header of a .bmp file */
+struct header_bitmap_file {
+    word  bfType;           /* 00 */
+    dword bfSize;           /* 02 */
+    word  bfReserved1;      /* 06 */
+    word  bfReserved2;      /* 08 */
+    dword bfOffBits;        /* 0a */
+};
+
+STATIC_ASSERT(sizeof(struct header_bitmap_file) == 0xe);
+
+/* header of an .ico or .cur file, followed by the entries */
+struct header_icon_file {
+    word  idReserved;       /* 00 */
+    word  idType;           /* 02 */
+    word  idCount;          /* 04 */
+};
+
+STATIC_ASSERT(sizeof(struct header_icon_file) == 0x6);
+
+struct icon_file_entry {
+    byte  bWidth;           /* 00 */
+    byte  bHeight;          /* 01 */
+    byte  bColorCount;      /* 02 */
+    byte  bReserved;        /* 03 */
+    word  wPlanes;          /* 04 */ /* hotspot x for cursors */
+    word  wBitCount;        /* 06 */ /* hotspot y for cursors */
+    dword dwBytesInRes;     /* 08 */
+    dword dwImageOffset;    /* 0c */
+};
+
+STATIC_ASSERT(sizeof(struct icon_file_entry) == 0x10);
+
 static char *dup_string_resource(off_t offset)
 {
     byte length = read_byte(offset);
@@ -55,52 +92,98 @@ static char *dup_string_resource(off_t offset)
     return ret;
 }
 
-/* length-indexed; returns  */
-static void print_escaped_string(off_t offset, long length){
-    putchar('"');
-    while (length--){
-        char c = read_byte(offset++);
-        if (c == '\t')
-            printf("\\t");
-        else if (c == '\n')
-            printf("\\n");
-        else if (c == '\r')
-            printf("\\r");
-        else if (c == '"')
-            printf("\\\"");
-        else if (c == '\\')
-            printf("\\\\");
-        else if (c >= ' ' && c <= '~')
-            putchar(c);
+/* Returns the number of bytes at the start of p, up to len, which can be
+ * printed as they are: anything printable except quotes and backslashes. */
+static size_t plain_run(const byte *p, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' '), tilde = _mm_set1_epi8('~');
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+
+    /* Bytes of 0x80 and up are negative, so they count as less than ' '. */
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpgt_epi8(v, tilde)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        int mask = _mm_movemask_epi8(special);
+
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; i++)
+    {
+        if (p[i] < ' ' || p[i] > '~' || p[i] == '"' || p[i] == '\\')
+            break;
+    }
+    return i;
+}
+
+/* Print bytes with C escapes, without quotes. Plain runs are written out in
+ * one go, rather than a character at a time. */
+void print_escaped_bytes(const byte *p, size_t len)
+{
+    char escape[5];
+
+    while (len)
+    {
+        size_t run = plain_run(p, len);
+
+        fwrite(p, 1, run, stdout);
+        p += run;
+        len -= run;
+        if (!len)
+            break;
+
+        if (*p == '\t')
+            strcpy(escape, "\\t");
+        else if (*p == '\n')
+            strcpy(escape, "\\n");
+        else if (*p == '\r')
+            strcpy(escape, "\\r");
+        else if (*p == '"')
+            strcpy(escape, "\\\"");
+        else if (*p == '\\')
+            strcpy(escape, "\\\\");
         else
-            printf("\\x%02hhx", c);
+        {
+            static const char hex[] = "0123456789abcdef";
+            escape[0] = '\\';
+            escape[1] = 'x';
+            escape[2] = hex[*p >> 4];
+            escape[3] = hex[*p & 0xf];
+            escape[4] = 0;
+        }
+        fputs(escape, stdout);
+        p++;
+        len--;
     }
+}
+
+/* Print a string in quotes, with C escapes. */
+static void print_escaped(const byte *p, size_t len)
+{
+    putchar('"');
+    print_escaped_bytes(p, len);
     putchar('"');
 }
 
+/* length-indexed; returns  */
+static void print_escaped_string(off_t offset, long length){
+    print_escaped(read_data(offset), length);
+}
+
 /* null-terminated; returns the end of the string */
 static off_t print_escaped_string0(off_t offset)
 {
-    char c;
-    putchar('"');
-    while ((c = read_byte(offset++))){
-        if (c == '\t')
-            printf("\\t");
-        else if (c == '\n')
-            printf("\\n");
-        else if (c == '\r')
-            printf("\\r");
-        else if (c == '"')
-            printf("\\\"");
-        else if (c == '\\')
-            printf("\\\\");
-        else if (c >= ' ' && c <= '~')
-            putchar(c);
-        else
-            printf("\\x%02hhx", c);
-    }
-    putchar('"');
-    return offset;
+    size_t length = strlen(read_data(offset));
+    print_escaped(read_data(offset), length);
+    return offset + length + 1;
 }
 
 static void print_timestamp(dword high, dword low){
@@ -126,7 +209,13 @@ const char *const rsrc_types[] = {
     "Name table",        /* f */
     "Version",           /* 10 */
     0,                              /* fixme: RT_DLGINCLUDE? */
-    0
+    0,
+    "Plug and Play",     /* 13 */
+    "VxD",               /* 14 */
+    "Animated cursor",   /* 15 */
+    "Animated icon",     /* 16 */
+    "HTML",              /* 17 */
+    "Manifest",          /* 18 */
 };
 const size_t rsrc_types_count = sizeof(rsrc_types)/sizeof(rsrc_types[0]);
 
@@ -723,7 +812,7 @@ static void print_rsrc_varfileinfo(off_t offset, off_t end)
     }
 };
 
-static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_id)
+void print_rsrc_resource(word type, off_t offset, size_t length, word rn_id)
 {
     switch (type)
     {
@@ -1013,30 +1102,131 @@ static void print_rsrc_resource(word type, off_t offset, size_t length, word rn_
     }
 }
 
+/* Filters are compiled once, when they're given on the command line. Each
+ * one may name a resource type, an ID, or a type followed by an ID. Types and
+ * IDs are case insensitive, and may be given either by name or by number. */
+
+struct filter_key {
+    char *name;     /* case-folded */
+    dword num;
+    int numeric;    /* whether num is valid */
+};
+
+struct resource_filter {
+    /* the whole filter, taken as a type or as an ID */
+    struct filter_key whole_type, whole_id;
+    /* or split into a type and an ID */
+    int pair;
+    struct filter_key type, id;
+};
+
+static struct resource_filter *resource_filters;
+unsigned resource_filters_count;
+
+static char *fold_string(const char *str, size_t len)
+{
+    char *ret = malloc(len + 1);
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        ret[i] = tolower(str[i]);
+    ret[len] = 0;
+    return ret;
+}
+
+/* a type is numeric if it has a name we know, or is written in hex */
+static void compile_type(struct filter_key *key, const char *str, size_t len)
+{
+    size_t i;
+
+    key->name = fold_string(str, len);
+    key->numeric = 0;
+
+    for (i = 0; i < rsrc_types_count; i++)
+    {
+        if (rsrc_types[i] && strlen(rsrc_types[i]) == len && !strncasecmp(rsrc_types[i], str, len))
+        {
+            key->num = i;
+            key->numeric = 1;
+            return;
+        }
+    }
+
+    if (len > 2 && key->name[0] == '0' && key->name[1] == 'x'
+            && strspn(key->name + 2, "0123456789abcdef") == len - 2)
+    {
+        /* NE types are printed with the high bit set */
+        key->num = strtoul(key->name + 2, NULL, 16) & 0x7fff;
+        key->numeric = 1;
+    }
+}
+
+/* an ID is numeric if it's written in decimal */
+static void compile_id(struct filter_key *key, const char *str, size_t len)
+{
+    key->name = fold_string(str, len);
+    key->numeric = (len && strspn(key->name, "0123456789") == len);
+    if (key->numeric)
+        key->num = strtoul(key->name, NULL, 10);
+}
+
+void add_resource_filter(const char *str)
+{
+    struct resource_filter *filter;
+    size_t len = strlen(str), type_len = 0, i;
+    const char *p;
+
+    resource_filters = realloc(resource_filters, (resource_filters_count + 1) * sizeof(*resource_filters));
+    filter = &resource_filters[resource_filters_count++];
+
+    compile_type(&filter->whole_type, str, len);
+    compile_id(&filter->whole_id, str, len);
+
+    /* Type names can have spaces in them, so look for the longest one we
+     * know of first; otherwise the type is the first word. */
+    for (i = 0; i < rsrc_types_count; i++)
+    {
+        size_t name_len;
+        if (!rsrc_types[i]) continue;
+        name_len = strlen(rsrc_types[i]);
+        if (name_len > type_len && !strncasecmp(rsrc_types[i], str, name_len) && str[name_len] == ' ')
+            type_len = name_len;
+    }
+    if (!type_len && (p = strchr(str, ' ')))
+        type_len = p - str;
+
+    p = str + type_len;
+    while (*p == ' ') ++p;
+    filter->pair = (type_len && *p);
+    if (filter->pair)
+    {
+        compile_type(&filter->type, str, type_len);
+        compile_id(&filter->id, p, strlen(p));
+    }
+}
+
+static int match_key(const struct filter_key *filter, const struct rsrc_key *key)
+{
+    if (key->name)
+        return !strcasecmp(filter->name, key->name);
+    return filter->numeric && filter->num == key->num;
+}
+
 /* return true if this was one of the resources that was asked for */
-static int filter_resource(const char *type, const char *id){
+int filter_resource(const struct rsrc_key *type, const struct rsrc_key *id)
+{
     unsigned i;
 
     if (!resource_filters_count)
         return 1;
 
-    for (i = 0; i < resource_filters_count; ++i){
-        const char *filter_type = resource_filters[i], *p;
-        size_t len = strlen(type);
-
-        /* note that both resource types and IDs are case insensitive */
+    for (i = 0; i < resource_filters_count; ++i)
+    {
+        const struct resource_filter *filter = &resource_filters[i];
 
-        /* if the filter is just a resource type or ID and we match that */
-        if (!strcasecmp(type, filter_type) || !strcasecmp(id, filter_type))
+        if (match_key(&filter->whole_type, type) || match_key(&filter->whole_id, id))
             return 1;
-
-        /* if the filter is a resource type followed by an ID and we match both */
-        if (strncasecmp(type, filter_type, len) || filter_type[len] != ' ')
-            continue;
-
-        p = filter_type + len;
-        while (*p == ' ') ++p;
-        if (!strcasecmp(id, p))
+        if (filter->pair && match_key(&filter->type, type) && match_key(&filter->id, id))
             return 1;
     }
     return 0;
@@ -1061,66 +1251,413 @@ struct type_header
     struct resource resources[1];
 };
 
-void print_rsrc(off_t start){
+/* The resource table, parsed once. Entries are kept in table order, which is
+ * the order we print them in, and also sorted by type and then ID so that
+ * filters only have to look at the resources they match. */
+struct rsrc_entry {
+    struct rsrc_key type, id;
+    word type_id;
+    const struct resource *rn;
+};
+
+struct rsrc_index {
+    word align;
+    struct rsrc_entry *entries;
+    unsigned count;
+    const struct rsrc_entry **sorted;
+    unsigned *type_start;   /* index into sorted[] of each type, plus the end */
+    unsigned type_count;
+    char **names;           /* strings we allocated, to be freed */
+    unsigned name_count;
+};
+
+static char *index_name(struct rsrc_index *index, off_t offset)
+{
+    char *name = dup_string_resource(offset);
+    index->names = realloc(index->names, (index->name_count + 1) * sizeof(*index->names));
+    index->names[index->name_count++] = name;
+    return name;
+}
+
+/* numbers sort before names */
+static int compare_key(const struct rsrc_key *a, const struct rsrc_key *b)
+{
+    if (!a->name != !b->name)
+        return a->name ? 1 : -1;
+    if (a->name)
+        return strcasecmp(a->name, b->name);
+    return (a->num > b->num) - (a->num < b->num);
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+    const struct rsrc_entry *entry_a = *(const struct rsrc_entry **)a;
+    const struct rsrc_entry *entry_b = *(const struct rsrc_entry **)b;
+    int ret;
+
+    if ((ret = compare_key(&entry_a->type, &entry_b->type)))
+        return ret;
+    if ((ret = compare_key(&entry_a->id, &entry_b->id)))
+        return ret;
+    return (entry_a > entry_b) - (entry_a < entry_b);
+}
+
+static void build_index(off_t start, struct rsrc_index *index)
+{
     const struct type_header *header;
-    word align = read_word(start);
-    char *idstr;
-    word i;
+    unsigned i, n = 0;
+
+    memset(index, 0, sizeof(*index));
+    index->align = read_word(start);
 
-    header = read_data(start + sizeof(word));
+    for (header = read_data(start + sizeof(word)); header->type_id;
+            header = (struct type_header *)(&header->resources[header->count]))
+        index->count += header->count;
 
-    while (header->type_id)
+    index->entries = malloc(index->count * sizeof(*index->entries));
+    index->sorted = malloc(index->count * sizeof(*index->sorted));
+
+    for (header = read_data(start + sizeof(word)); header->type_id;
+            header = (struct type_header *)(&header->resources[header->count]))
     {
+        struct rsrc_key type = {0};
+
         if (header->resloader)
             warn("resloader is nonzero: %08x\n", header->resloader);
 
-        for (i = 0; i < header->count; ++i)
-        {
-            const struct resource *rn = &header->resources[i];
+        if (header->type_id & 0x8000)
+            type.num = header->type_id & ~0x8000;
+        else
+            type.name = index_name(index, start + header->type_id);
 
-            if (rn->id & 0x8000){
-                idstr = malloc(6);
-                sprintf(idstr, "%d", rn->id & ~0x8000);
-            } else
-                idstr = dup_string_resource(start + rn->id);
+        for (i = 0; i < header->count; ++i, ++n)
+        {
+            struct rsrc_entry *entry = &index->entries[n];
 
-            if (header->type_id & 0x8000)
+            entry->type = type;
+            entry->type_id = header->type_id;
+            entry->rn = &header->resources[i];
+            if (entry->rn->id & 0x8000)
             {
-                if ((header->type_id & (~0x8000)) < rsrc_types_count && rsrc_types[header->type_id & (~0x8000)]){
-                    if (!filter_resource(rsrc_types[header->type_id & ~0x8000], idstr))
-                        goto next;
-                    printf("\n%s", rsrc_types[header->type_id & ~0x8000]);
-                } else {
-                    char typestr[7];
-                    sprintf(typestr, "0x%04x", header->type_id);
-                    if (!filter_resource(typestr, idstr))
-                        goto next;
-                    printf("\n%s", typestr);
-                }
+                entry->id.name = NULL;
+                entry->id.num = entry->rn->id & ~0x8000;
             }
             else
-            {
-                char *typestr = dup_string_resource(start + header->type_id);
-                if (!filter_resource(typestr, idstr))
-                {
-                    free(typestr);
-                    goto next;
-                }
-                printf("\n\"%s\"", typestr);
-                free(typestr);
-            }
+                entry->id.name = index_name(index, start + entry->rn->id);
+            index->sorted[n] = entry;
+        }
+    }
+
+    qsort(index->sorted, index->count, sizeof(*index->sorted), compare_entry);
+
+    index->type_start = malloc((index->count + 1) * sizeof(*index->type_start));
+    for (i = 0; i < index->count; i++)
+    {
+        if (!i || compare_key(&index->sorted[i - 1]->type, &index->sorted[i]->type))
+            index->type_start[index->type_count++] = i;
+    }
+    index->type_start[index->type_count] = index->count;
+}
+
+static void free_index(struct rsrc_index *index)
+{
+    unsigned i;
+
+    for (i = 0; i < index->name_count; i++)
+        free(index->names[i]);
+    free(index->names);
+    free(index->type_start);
+    free(index->sorted);
+    free(index->entries);
+}
+
+/* Returns the first entry in sorted[lo, hi) whose type (or ID) is not less
+ * than key, or if "upper" is set, greater than key. */
+static unsigned bound(const struct rsrc_index *index, unsigned lo, unsigned hi,
+        const struct rsrc_key *key, int by_id, int upper)
+{
+    while (lo < hi)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        const struct rsrc_entry *entry = index->sorted[mid];
+        int cmp = compare_key(by_id ? &entry->id : &entry->type, key);
+
+        if (cmp < 0 || (upper && !cmp))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void select_range(const struct rsrc_index *index, unsigned lo, unsigned hi,
+        const struct rsrc_key *key, int by_id, byte *selected)
+{
+    unsigned i;
+
+    hi = bound(index, lo, hi, key, by_id, 1);
+    for (i = bound(index, lo, hi, key, by_id, 0); i < hi; i++)
+        selected[index->sorted[i] - index->entries] = 1;
+}
+
+/* A filter key can match either a number or a name. */
+static unsigned filter_keys(const struct filter_key *filter, struct rsrc_key keys[2])
+{
+    unsigned count = 0;
+
+    if (filter->numeric)
+    {
+        keys[count].name = NULL;
+        keys[count++].num = filter->num;
+    }
+    keys[count].name = filter->name;
+    keys[count++].num = 0;
+    return count;
+}
+
+static void select_resources(const struct rsrc_index *index, const struct resource_filter *filter, byte *selected)
+{
+    struct rsrc_key types[2], ids[2];
+    unsigned type_count, id_count, i, j, t;
 
-            printf(" %s", idstr);
-            printf(" (offset = 0x%x, length = %d [0x%x]", rn->offset << align, rn->length << align, rn->length << align);
-            print_rsrc_flags(rn->flags);
-            printf("):\n");
+    /* the whole filter as a type */
+    type_count = filter_keys(&filter->whole_type, types);
+    for (i = 0; i < type_count; i++)
+        select_range(index, 0, index->count, &types[i], 0, selected);
 
-            print_rsrc_resource(header->type_id, rn->offset << align, rn->length << align, rn->id);
+    /* the whole filter as an ID, of any type */
+    id_count = filter_keys(&filter->whole_id, ids);
+    for (t = 0; t < index->type_count; t++)
+    {
+        for (j = 0; j < id_count; j++)
+            select_range(index, index->type_start[t], index->type_start[t + 1], &ids[j], 1, selected);
+    }
+
+    if (!filter->pair)
+        return;
+
+    type_count = filter_keys(&filter->type, types);
+    id_count = filter_keys(&filter->id, ids);
+    for (i = 0; i < type_count; i++)
+    {
+        unsigned lo = bound(index, 0, index->count, &types[i], 0, 0);
+        unsigned hi = bound(index, lo, index->count, &types[i], 0, 1);
+
+        for (j = 0; j < id_count; j++)
+            select_range(index, lo, hi, &ids[j], 1, selected);
+    }
+}
+
+/* Look up a resource by numeric type and ID. Returns its offset and length,
+ * or 0 if it doesn't exist. */
+static off_t find_resource(const struct rsrc_index *index, word type, word id, size_t *length)
+{
+    struct rsrc_key type_key = {NULL, type}, id_key = {NULL, id};
+    unsigned lo = bound(index, 0, index->count, &type_key, 0, 0);
+    unsigned hi = bound(index, lo, index->count, &type_key, 0, 1);
+    const struct resource *rn;
+
+    lo = bound(index, lo, hi, &id_key, 1, 0);
+    if (lo == hi || index->sorted[lo]->id.name || index->sorted[lo]->id.num != id)
+        return 0;
+
+    rn = index->sorted[lo]->rn;
+    *length = rn->length << index->align;
+    return rn->offset << index->align;
+}
+
+/* Bitmap resources are just a .bmp without the file header, so we only need
+ * to work out where the pixels start. */
+static void extract_bitmap(const char *name, off_t offset, size_t length)
+{
+    struct header_bitmap_file file = {0};
+    dword size = read_dword(offset), colors = 0;
+    word bits;
+    struct iovec iov[2];
 
-next:
-            free(idstr);
+    if (size == 12) /* BITMAPCOREHEADER */
+    {
+        bits = read_word(offset + 10);
+        if (bits <= 8)
+            colors = (1 << bits) * 3;
+    }
+    else
+    {
+        const struct header_bitmap_info *header = read_data(offset);
+        bits = header->biBitCount;
+        if (header->biClrUsed)
+            colors = header->biClrUsed * 4;
+        else if (bits <= 8)
+            colors = (1 << bits) * 4;
+        if (size == 40 && header->biCompression == 3) /* BI_BITFIELDS */
+            colors += 12;
+    }
+
+    file.bfType = 0x4d42; /* BM */
+    file.bfSize = sizeof(file) + length;
+    file.bfOffBits = sizeof(file) + size + colors;
+
+    iov[0].iov_base = &file;
+    iov[0].iov_len = sizeof(file);
+    iov[1].iov_base = map + offset;
+    iov[1].iov_len = length;
+    extract_iov(name, iov, 2);
+}
+
+/* Icon and cursor directories name the individual images by ID. Put them
+ * back together into an .ico or .cur file, the way they were before the
+ * resource compiler took them apart. */
+static void extract_icon_group(const char *name, const struct rsrc_index *index, word type, off_t offset)
+{
+    word count = read_word(offset + 4), i, n = 0;
+    struct header_icon_file *header = malloc(sizeof(*header) + count * sizeof(struct icon_file_entry));
+    struct icon_file_entry *entries = (struct icon_file_entry *)(header + 1);
+    struct iovec *iov = malloc((count + 1) * sizeof(*iov));
+    dword image_offset = sizeof(*header) + count * sizeof(*entries);
+
+    offset += 6;
+    for (i = 0; i < count; i++, offset += 14)
+    {
+        struct icon_file_entry *entry = &entries[n];
+        word id = read_word(offset + 12);
+        dword bytes = read_dword(offset + 8);
+        size_t length;
+        off_t image;
+
+        if (!(image = find_resource(index, type == 0x800c ? 1 : 3, id, &length)))
+        {
+            warn("Resource #%d in group %s doesn't exist\n", id, name);
+            continue;
         }
+        bytes = min(bytes, length);
 
-        header = (struct type_header *)(&header->resources[header->count]);
+        if (type == 0x800c)
+        {
+            /* The group stores the size as words, and the image carries the
+             * hotspot in front of the bitmap. */
+            if (bytes < 4) continue;
+            entry->bWidth = read_word(offset);
+            entry->bHeight = read_word(offset + 2) / 2;
+            entry->bColorCount = 0;
+            entry->bReserved = 0;
+            entry->wPlanes = read_word(image);
+            entry->wBitCount = read_word(image + 2);
+            image += 4;
+            bytes -= 4;
+        }
+        else
+            memcpy(entry, read_data(offset), 12);
+
+        entry->dwBytesInRes = bytes;
+        iov[n + 1].iov_base = map + image;
+        iov[n + 1].iov_len = bytes;
+        n++;
+    }
+
+    /* the header shrinks if any images were missing */
+    image_offset -= (count - n) * sizeof(*entries);
+    for (i = 0; i < n; i++)
+    {
+        entries[i].dwImageOffset = image_offset;
+        image_offset += entries[i].dwBytesInRes;
     }
+
+    header->idReserved = 0;
+    header->idType = (type == 0x800c) ? 2 : 1;
+    header->idCount = n;
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(*header) + n * sizeof(*entries);
+    extract_iov(name, iov, n + 1);
+
+    free(iov);
+    free(header);
+}
+
+static void extract_rsrc_resource(const struct rsrc_index *index, word type, const char *typestr,
+        const char *idstr, off_t offset, size_t length)
+{
+    const char *ext = ".bin";
+    char *name;
+
+    if (type == 0x8002)
+        ext = ".bmp";
+    else if (type == 0x800c)
+        ext = ".cur";
+    else if (type == 0x800e)
+        ext = ".ico";
+
+    name = malloc(strlen(typestr) + strlen(idstr) + strlen(ext) + 2);
+    sprintf(name, "%s_%s%s", typestr, idstr, ext);
+
+    if (type == 0x8002)
+        extract_bitmap(name, offset, length);
+    else if (type == 0x800c || type == 0x800e)
+        extract_icon_group(name, index, type, offset);
+    else
+        extract_file(name, offset, length);
+
+    free(name);
+}
+
+void print_rsrc(off_t start){
+    struct rsrc_index index;
+    byte *selected;
+    unsigned i;
+
+    build_index(start, &index);
+
+    selected = calloc(index.count + 1, sizeof(byte));
+    if (!resource_filters_count)
+        memset(selected, 1, index.count);
+    for (i = 0; i < resource_filters_count; i++)
+        select_resources(&index, &resource_filters[i], selected);
+
+    for (i = 0; i < index.count; i++)
+    {
+        const struct rsrc_entry *entry = &index.entries[i];
+        const struct resource *rn = entry->rn;
+        off_t offset = rn->offset << index.align;
+        size_t length = rn->length << index.align;
+        char typebuf[7], idbuf[6];
+        const char *typestr, *idstr;
+
+        if (!selected[i])
+            continue;
+
+        if (entry->type.name)
+        {
+            typestr = entry->type.name;
+            printf("\n\"%s\"", typestr);
+        }
+        else
+        {
+            if (entry->type.num < rsrc_types_count && rsrc_types[entry->type.num])
+                typestr = rsrc_types[entry->type.num];
+            else {
+                sprintf(typebuf, "0x%04x", entry->type_id);
+                typestr = typebuf;
+            }
+            printf("\n%s", typestr);
+        }
+
+        if (entry->id.name)
+            idstr = entry->id.name;
+        else {
+            sprintf(idbuf, "%d", entry->id.num);
+            idstr = idbuf;
+        }
+
+        printf(" %s", idstr);
+        printf(" (offset = 0x%x, length = %d [0x%x]", rn->offset << index.align, rn->length << index.align, rn->length << index.align);
+        print_rsrc_flags(rn->flags);
+        printf("):\n");
+
+        if (extract_dir)
+            extract_rsrc_resource(&index, entry->type_id, typestr, idstr, offset, length);
+        else
+            print_rsrc_resource(entry->type_id, offset, length, rn->id);
+    }
+
+    free(selected);
+    free_index(&index);
 }
@@ -28,6 +28,7 @@
 #include "semblance.h"
 #include "ne.h"
 #include "x86_instr.h"
+#include "cfg.h"
 
 #ifdef USE_WARN
 #define warn_at(...) \
@@ -38,99 +39,166 @@
 #endif
 
 /* index function */
-static char *get_entry_name(word cs, word ip, const struct ne *ne) {
-    unsigned i;
-    for (i=0; i<ne->entcount; i++) {
-        if (ne->enttab[i].segment == cs &&
-            ne->enttab[i].offset == ip)
-            return ne->enttab[i].name;
+static const char *get_entry_name(word cs, word ip, const struct ne *ne) {
+    unsigned lo = 0, hi = ne->entry_index_count;
+
+    /* find the first entry at or after cs:ip */
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        const struct entry *entry = ne->entry_index[mid];
+
+        if (entry->segment < cs || (entry->segment == cs && entry->offset < ip))
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    return NULL;
+
+    if (lo < ne->entry_index_count && ne->entry_index[lo]->segment == cs
+            && ne->entry_index[lo]->offset == ip && ne->entry_index[lo]->name)
+        return ne->entry_index[lo]->name;
+    return symbol_name(&ne->symbols, (cs << 16) | ip);
+}
+
+static int compare_reloc_offset(const void *a, const void *b) {
+    return (int)((const struct reloc_offset *)a)->offset - (int)((const struct reloc_offset *)b)->offset;
 }
 
 /* index function */
 static const struct reloc *get_reloc(const struct segment *seg, word ip) {
-    unsigned i, o;
-    for (i = 0; i < seg->reloc_count; i++) {
-        for (o = 0; o < seg->reloc_table[i].offset_count; o++)
-            if (seg->reloc_table[i].offsets[o] == ip)
-                return &seg->reloc_table[i];
-    }
+    struct reloc_offset key = {ip, 0};
+    const struct reloc_offset *found;
+
+    if (seg->reloc_offset_count && (found = bsearch(&key, seg->reloc_offsets,
+            seg->reloc_offset_count, sizeof(key), compare_reloc_offset)))
+        return &seg->reloc_table[found->index];
     return NULL;
 }
 
 /* load an imported name from a specfile */
 static char *get_imported_name(word module, word ordinal, const struct ne *ne) {
-    unsigned i;
-    for (i=0; i<ne->imptab[module-1].export_count; i++) {
-        if (ne->imptab[module-1].exports[i].ordinal == ordinal)
-            return ne->imptab[module-1].exports[i].name;
-    }
+    const struct import_module *imp = &ne->imptab[module-1];
+
+    if (ordinal < imp->export_count)
+        return imp->exports[ordinal];
     return NULL;
 }
 
-/* Tweak the inline string and return the comment. */
-static const char *relocate_arg(const struct segment *seg, struct arg *arg, const struct ne *ne)
+/* Write the replacement string for argument i into out (ARG_LEN bytes) and return
+ * the comment. */
+static const char *relocate_arg(const struct segment *seg, const struct instr *instr, int i, char *out, const struct ne *ne)
 {
-    const struct reloc *r = get_reloc(seg, arg->ip);
+    const struct reloc *r = get_reloc(seg, arg_ip(instr, i));
+    enum argtype type = instr->argtype[i];
     char *module = NULL;
 
-    if (!r && arg->type == SEGPTR) r = get_reloc(seg, arg->ip+2);
+    if (!r && type == SEGPTR) r = get_reloc(seg, arg_ip(instr, i)+2);
     if (!r) {
-        warn("%#x: Byte tagged INSTR_RELOC has no reloc attached; this is a bug.\n", arg->ip);
+        warn("%#x: Byte tagged INSTR_RELOC has no reloc attached; this is a bug.\n", arg_ip(instr, i));
         return "?";
     }
 
     if (r->type == 1 || r->type == 2)
         module = ne->imptab[r->tseg-1].name;
 
-    if (arg->type == SEGPTR && r->size == 3) {
+    if (type == SEGPTR && r->size == 3) {
         /* 32-bit relocation on 32-bit pointer, so just copy the name */
         if (r->type == 0) {
-            snprintf(arg->string, sizeof(arg->string), "%d:%04x", r->tseg, r->toffset);
+            snprintf(out, ARG_LEN, "%d:%04x", r->tseg, r->toffset);
             return r->text;
         } else if (r->type == 1) {
-            snprintf(arg->string, sizeof(arg->string), "%s.%d", module, r->toffset);
+            snprintf(out, ARG_LEN, "%s.%d", module, r->toffset);
             return get_imported_name(r->tseg, r->toffset, ne);
         } else if (r->type == 2) {
-            snprintf(arg->string, sizeof(arg->string), "%s.%.*s", module,
+            snprintf(out, ARG_LEN, "%s.%.*s", module,
                 ne->nametab[r->toffset], &ne->nametab[r->toffset+1]);
             return NULL;
         }
-    } else if (arg->type == SEGPTR && r->size == 2 && r->type == 0) {
+    } else if (type == SEGPTR && r->size == 2 && r->type == 0) {
         /* segment relocation on 32-bit pointer; copy the segment but keep the
          * offset */
-        snprintf(arg->string, sizeof(arg->string), "%d:%04lx", r->tseg, arg->value);
-        return get_entry_name(r->tseg, arg->value, ne);
-    } else if ((arg->type == IMM || arg->type == MEM) && (r->size == 2 || r->size == 5)) {
+        snprintf(out, ARG_LEN, "%d:%04lx", r->tseg, instr->args[i]);
+        return get_entry_name(r->tseg, instr->args[i], ne);
+    } else if ((type == IMM || type == MEM) && (r->size == 2 || r->size == 5)) {
         /* imm16 referencing a segment or offset directly; MEM with lea has also
          * been observed (for some reason) */
         const char *pfx = (r->size == 2 ? "seg " : "");
         const char *open = "", *close = "";
-        if (arg->type != IMM)
+        if (type != IMM)
         {
             open = "[";
             close = "]";
         }
         if (r->type == 0) {
-            snprintf(arg->string, sizeof(arg->string), "%s%s%d%s", open, pfx, r->tseg, close);
+            snprintf(out, ARG_LEN, "%s%s%d%s", open, pfx, r->tseg, close);
             return NULL;
         } else if (r->type == 1) {
-            snprintf(arg->string, sizeof(arg->string), "%s%s%s.%d%s", open, pfx, module, r->toffset, close);
+            snprintf(out, ARG_LEN, "%s%s%s.%d%s", open, pfx, module, r->toffset, close);
             return get_imported_name(r->tseg, r->toffset, ne);
         } else if (r->type == 2) {
-            snprintf(arg->string, sizeof(arg->string), "%s%s%s.%.*s%s", open, pfx, module,
+            snprintf(out, ARG_LEN, "%s%s%s.%.*s%s", open, pfx, module,
                 ne->nametab[r->toffset], &ne->nametab[r->toffset+1], close);
             return NULL;
         }
     }
 
     warn("%d:%#x: unhandled relocation: size %d, type %d, argtype %x\n",
-        seg->cs, arg->ip, r->size, r->type, arg->type);
+        seg->cs, arg_ip(instr, i), r->size, r->type, type);
 
     return NULL;
 }
 
+static void ne_addr(char *out, dword addr, const void *ctx) {
+    sprintf(out, "%d:%04x", addr >> 16, addr & 0xffff);
+}
+
+/* Label for cs:ip in compilable output, or NULL if it hasn't got one. */
+static const char *get_ne_label(word cs, word ip, const struct ne *ne) {
+    static char label[48];
+    const struct segment *seg;
+
+    if (!cs || cs > ne->header.ne_cseg)
+        return NULL;
+    seg = &ne->segments[cs-1];
+    if (ip >= seg->min_alloc || !(seg->instr_flags[ip] & INSTR_LABEL))
+        return NULL;
+    get_label(label, (cs << 16) | ip, seg->instr_flags[ip], ne_addr, NULL);
+    return label;
+}
+
+/* Replace addresses inside this module with labels, for compilable output.
+ * References to other modules are left as they are. */
+static void label_args(const struct segment *seg, const struct instr *instr, char argstr[3][ARG_LEN], const struct ne *ne)
+{
+    int bits = (seg->flags & 0x2000) ? 32 : 16;
+    const struct reloc *r;
+    const char *label;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        enum argtype type = instr->argtype[i];
+
+        if (type == REL8 || type == REL) {
+            if ((label = get_ne_label(seg->cs, instr->args[i], ne)))
+                print_label_arg("", instr, i, bits, asm_syntax, label, argstr[i]);
+        } else if (type == SEGPTR) {
+            if (!(r = get_reloc(seg, arg_ip(instr, i))) && !(r = get_reloc(seg, arg_ip(instr, i)+2)))
+                continue;
+            if (r->type != 0 || !(r->size == 3 || r->size == 2) || asm_syntax == GAS)
+                continue;
+            label = get_ne_label(r->tseg, (r->size == 3) ? r->toffset : instr->args[i], ne);
+            if (label && strlen(label) < 12)
+                snprintf(argstr[i], sizeof(argstr[i]), (asm_syntax == NASM) ? "(seg %s):%s" : "far ptr %s", label, label);
+        } else if (type == IMM || (type >= RM && type <= MEM && instr->modrm_disp != DISP_REG)) {
+            if (!(seg->instr_flags[arg_ip(instr, i)] & INSTR_RELOC) || !(r = get_reloc(seg, arg_ip(instr, i))))
+                continue;
+            if (r->type == 0 && r->size == 5 && (label = get_ne_label(r->tseg, r->toffset, ne)))
+                print_label_arg("", instr, i, bits, asm_syntax, label, argstr[i]);
+            else if (r->type == 0 && r->size == 2 && type == IMM && asm_syntax != GAS)
+                sprintf(argstr[i], "seg%d", r->tseg);   /* a segment's name is its base */
+        }
+    }
+}
+
 /* Returns the number of bytes processed (same as get_instr). */
 static int print_ne_instr(const struct segment *seg, word ip, byte *p, const struct ne *ne) {
     word cs = seg->cs;
@@ -140,25 +208,34 @@ static int print_ne_instr(const struct segment *seg, word ip, byte *p, const str
 
     const char *comment = NULL;
     char ip_string[11];
+    char argstr[3][ARG_LEN] = {{0}};
 
     len = get_instr(ip, p, &instr, bits);
 
     sprintf(ip_string, "%3d:%04x", seg->cs, ip);
 
     /* check for relocations */
-    if (seg->instr_flags[instr.args[0].ip] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[0], ne);
-    if (seg->instr_flags[instr.args[1].ip] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[1], ne);
+    if (seg->instr_flags[arg_ip(&instr, 0)] & INSTR_RELOC)
+        comment = relocate_arg(seg, &instr, 0, argstr[0], ne);
+    if (seg->instr_flags[arg_ip(&instr, 1)] & INSTR_RELOC)
+        comment = relocate_arg(seg, &instr, 1, argstr[1], ne);
     /* make sure to check for SEGPTR segment-only relocations */
-    if (instr.op.arg0 == SEGPTR && seg->instr_flags[instr.args[0].ip+2] & INSTR_RELOC)
-        comment = relocate_arg(seg, &instr.args[0], ne);
+    if (instr.op->arg0 == SEGPTR && seg->instr_flags[arg_ip(&instr, 0)+2] & INSTR_RELOC)
+        comment = relocate_arg(seg, &instr, 0, argstr[0], ne);
 
     /* check if we are referencing a named export */
-    if (!comment && instr.op.arg0 == REL)
-        comment = get_entry_name(cs, instr.args[0].value, ne);
+    if (!comment && instr.op->arg0 == REL)
+        comment = get_entry_name(cs, instr.args[0], ne);
 
-    print_instr(ip_string, p, len, seg->instr_flags[ip], &instr, comment, bits);
+    if (opts & COMPILABLE) {
+        print_labels((cs << 16) | ip, seg->instr_flags + ip, min(len, seg->min_alloc - ip), ne_addr, NULL, asm_syntax);
+        label_args(seg, &instr, argstr, ne);
+    }
+
+    if (mode & DUMPXREFS)
+        print_xref_comment(&ne->xrefs, (cs << 16) | ip, ne_addr, NULL, asm_syntax);
+
+    print_instr(ip_string, p, len, seg->instr_flags[ip], &instr, argstr, comment, bits, asm_syntax);
 
     return len;
 };
@@ -194,7 +271,7 @@ static void print_disassembly(const struct segment *seg, const struct ne *ne) {
         memcpy(buffer, read_data(seg->start + ip), min(sizeof(buffer), seg->length - ip));
 
         if (seg->instr_flags[ip] & INSTR_FUNC) {
-            char *name = get_entry_name(cs, ip, ne);
+            const char *name = get_entry_name(cs, ip, ne);
             printf("\n");
             printf("%d:%04x <%s>:\n", cs, ip, name ? name : "no name");
             /* don't mark far functions—we can't reliably detect them
@@ -206,6 +283,39 @@ static void print_disassembly(const struct segment *seg, const struct ne *ne) {
     putchar('\n');
 }
 
+/* Compilable output: all of the segment, code and data alike, with labels
+ * wherever the scanner found a reference. */
+static void print_compilable(const struct segment *seg, const struct ne *ne) {
+    word length = min(seg->length, seg->min_alloc);
+    dword ip = 0, start;
+    byte buffer[MAX_INSTR];
+    char name[12];
+
+    sprintf(name, "seg%d", seg->cs);
+    print_region_start(name, (seg->flags & 0x2000) ? 32 : 16, asm_syntax);
+
+    if (!(seg->flags & 0x0001)) {
+        while (ip < length) {
+            /* anything between instructions is data */
+            for (start = ip; ip < length && !(seg->instr_flags[ip] & INSTR_VALID); ip++);
+            print_data_range(seg->start + start, seg->instr_flags + start, (seg->cs << 16) | start,
+                    ip - start, ip - start, ne_addr, NULL, asm_syntax);
+            if (ip >= length) break;
+
+            memset(buffer, 0, sizeof(buffer));
+            memcpy(buffer, read_data(seg->start + ip), min(sizeof(buffer), seg->length - ip));
+            ip += print_ne_instr(seg, ip, buffer, ne);
+        }
+    }
+
+    /* the rest, including anything past the end of the raw data */
+    if (ip < seg->min_alloc)
+        print_data_range(seg->start + ip, seg->instr_flags + ip, (seg->cs << 16) | ip,
+                (ip < length) ? length - ip : 0, seg->min_alloc - ip, ne_addr, NULL, asm_syntax);
+
+    print_region_end(name, asm_syntax);
+}
+
 static void print_data(const struct segment *seg) {
     word ip;    /* well, not really ip */
 
@@ -263,59 +373,83 @@ static void scan_segment(word cs, word ip, struct ne *ne) {
         if (i < ip+instr_length && i == seg->min_alloc) break;
 
         /* handle conditional and unconditional jumps */
-        if (instr.op.arg0 == SEGPTR) {
+        if (instr.op->arg0 == SEGPTR) {
+            byte type = XREF_FAR | ((instr.op->flags & OP_CALL) ? XREF_CALL : XREF_JUMP);
+
             for (i = ip; i < ip+instr_length; i++) {
                 if (seg->instr_flags[i] & INSTR_RELOC) {
                     const struct reloc *r = get_reloc(seg, i);
                     const struct segment *tseg;
 
                     if (!r) break;
-                    tseg = &ne->segments[r->tseg-1];
-
                     if (r->type != 0) break;
 
+                    if (!r->tseg || r->tseg > ne->header.ne_cseg) {
+                        warn_at("Far branch to nonexistent segment %d.\n", r->tseg);
+                        break;
+                    }
+                    tseg = &ne->segments[r->tseg-1];
+
                     if (r->size == 3) {
                         /* 32-bit relocation on 32-bit pointer */
                         tseg->instr_flags[r->toffset] |= INSTR_FAR;
-                        if (!strcmp(instr.op.name, "call"))
+                        if (instr.op->flags & OP_CALL)
                             tseg->instr_flags[r->toffset] |= INSTR_FUNC;
                         else
                             tseg->instr_flags[r->toffset] |= INSTR_JUMP;
+                        xref_add(&ne->xrefs, (cs << 16) | ip, (r->tseg << 16) | r->toffset, type);
                         scan_segment(r->tseg, r->toffset, ne);
                     } else if (r->size == 2) {
                         /* segment relocation on 32-bit pointer */
-                        tseg->instr_flags[instr.args[0].value] |= INSTR_FAR;
-                        if (!strcmp(instr.op.name, "call"))
-                            tseg->instr_flags[instr.args[0].value] |= INSTR_FUNC;
+                        tseg->instr_flags[instr.args[0]] |= INSTR_FAR;
+                        if (instr.op->flags & OP_CALL)
+                            tseg->instr_flags[instr.args[0]] |= INSTR_FUNC;
                         else
-                            tseg->instr_flags[instr.args[0].value] |= INSTR_JUMP;
-                        scan_segment(r->tseg, instr.args[0].value, ne);
+                            tseg->instr_flags[instr.args[0]] |= INSTR_JUMP;
+                        xref_add(&ne->xrefs, (cs << 16) | ip, (r->tseg << 16) | instr.args[0], type);
+                        scan_segment(r->tseg, instr.args[0], ne);
                     }
 
                     break;
                 }
             }
-        } else if (instr.op.flags & OP_BRANCH) {
+        } else if (instr.op->flags & OP_BRANCH) {
             /* near relative jump, loop, or call */
 
-            if (instr.args[0].value < seg->min_alloc)
+            if (instr.args[0] < seg->min_alloc)
             {
-                if (!strcmp(instr.op.name, "call"))
-                    seg->instr_flags[instr.args[0].value] |= INSTR_FUNC;
+                if (instr.op->flags & OP_CALL)
+                    seg->instr_flags[instr.args[0]] |= INSTR_FUNC;
                 else
-                    seg->instr_flags[instr.args[0].value] |= INSTR_JUMP;
+                    seg->instr_flags[instr.args[0]] |= INSTR_JUMP;
+                xref_add(&ne->xrefs, (cs << 16) | ip, (cs << 16) | instr.args[0],
+                         (instr.op->flags & OP_CALL) ? XREF_CALL : XREF_JUMP);
             }
             else
             {
                 warn_at("Invalid relative call or jump to %#lx (segment size %#x).\n",
-                        instr.args[0].value, seg->min_alloc);
+                        instr.args[0], seg->min_alloc);
             }
 
             /* scan it */
-            scan_segment(cs, instr.args[0].value, ne);
+            scan_segment(cs, instr.args[0], ne);
+        } else {
+            /* record references to our own segments through offset relocations */
+            for (i = ip; i < ip+instr_length && i < seg->min_alloc; i++) {
+                if (seg->instr_flags[i] & INSTR_RELOC) {
+                    const struct reloc *r = get_reloc(seg, i);
+
+                    if (r && r->type == 0 && r->size == 5
+                            && r->tseg && r->tseg <= ne->header.ne_cseg) {
+                        xref_add(&ne->xrefs, (cs << 16) | ip, (r->tseg << 16) | r->toffset, XREF_DATA);
+                        if (r->toffset < ne->segments[r->tseg-1].min_alloc)
+                            ne->segments[r->tseg-1].instr_flags[r->toffset] |= INSTR_DATA;
+                    }
+                }
+            }
         }
 
-        if (instr.op.flags & OP_STOP)
+        if (instr.op->flags & OP_STOP)
             return;
 
         ip += instr_length;
@@ -353,7 +487,14 @@ static void print_segment_flags(word flags) {
     printf("    Flags: 0x%04x (%s)\n", flags, buffer);
 }
 
-static void read_reloc(const struct segment *seg, word index, struct ne *ne)
+/* Offsets are collected here for one segment at a time, then copied into the
+ * arena and sorted once the segment is done. */
+struct offset_buffer {
+    struct reloc_offset *offsets;
+    unsigned count, size;
+};
+
+static void read_reloc(const struct segment *seg, word index, struct offset_buffer *buf, struct ne *ne)
 {
     off_t entry = seg->start + seg->length + 2 + (index * 8);
     struct reloc *r = &seg->reloc_table[index];
@@ -365,6 +506,7 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
 
     word offset_cursor;
     word next;
+    unsigned first = buf->count;
 
     memset(r, 0, sizeof(*r));
 
@@ -373,7 +515,7 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
 
     if ((type & 3) == 0) {
         /* internal reference */
-        char *name;
+        const char *name;
 
         if (module == 0xff) {
             r->tseg = ne->enttab[ordinal-1].segment;
@@ -407,9 +549,9 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
     if (size != 2 && size != 3 && size != 5)
         warn("%d: Relocation with unknown size %#x.\n", size);
 
-    /* get the offset list */
+    /* Walk the offset list. Each location holds the next link until the
+     * loader patches it, so read it once and record it as we go. */
     offset_cursor = offset;
-    r->offset_count = 0;
     do {
         /* One of my testcases has relocation offsets that exceed the length of
          * the segment. Until we figure out what that's about, ignore them. */
@@ -420,35 +562,18 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
 
         if (seg->instr_flags[offset_cursor] & INSTR_RELOC) {
             warn("%d:%04x: Infinite loop reading relocation data.\n", seg->cs, offset_cursor);
-            r->offset_count = 0;
+            buf->count = first;
             return;
         }
 
-        r->offset_count++;
-        seg->instr_flags[offset_cursor] |= INSTR_RELOC;
-
-        next = read_word(seg->start + offset_cursor);
-        if (type & 4)
-        {
-            if (!next)
-                break;
-            offset_cursor += next;
+        if (buf->count == buf->size) {
+            buf->size = buf->size ? buf->size * 2 : 64;
+            buf->offsets = realloc(buf->offsets, buf->size * sizeof(*buf->offsets));
         }
-        else
-            offset_cursor = next;
-    } while (next < 0xfffb);
-
-    r->offsets = malloc(r->offset_count*sizeof(word *));
-
-    offset_cursor = offset;
-    r->offset_count = 0;
-    do {
-        if (offset_cursor >= seg->length) {
-            break;
-        }
-
-        r->offsets[r->offset_count] = offset_cursor;
-        r->offset_count++;
+        buf->offsets[buf->count].offset = offset_cursor;
+        buf->offsets[buf->count].index = index;
+        buf->count++;
+        seg->instr_flags[offset_cursor] |= INSTR_RELOC;
 
         next = read_word(seg->start + offset_cursor);
         if (type & 4)
@@ -462,24 +587,18 @@ static void read_reloc(const struct segment *seg, word index, struct ne *ne)
     } while (next < 0xfffb);
 }
 
-static void free_reloc(struct reloc *reloc_data, word reloc_count) {
-    int i;
-    for (i = 0; i < reloc_count; i++) {
-        free(reloc_data[i].offsets);
-    }
-
-    free(reloc_data);
-}
-
 void read_segments(off_t start, struct ne *ne)
 {
     word entry_cs = ne->header.ne_cs;
     word entry_ip = ne->header.ne_ip;
     word count = ne->header.ne_cseg;
     struct segment *seg;
+    struct offset_buffer buf = {0};
+    byte **flags;
+    dword *lengths;
     word i, j;
 
-    ne->segments = malloc(count * sizeof(struct segment));
+    ne->segments = arena_alloc(&ne->arena, count * sizeof(struct segment));
 
     for (i = 0; i < count; ++i)
     {
@@ -491,7 +610,7 @@ void read_segments(off_t start, struct ne *ne)
         seg->min_alloc = read_word(start + i*8 + 6);
 
         /* Use min_alloc rather than length because data can "hang over". */
-        seg->instr_flags = calloc(seg->min_alloc, sizeof(byte));
+        seg->instr_flags = arena_alloc(&ne->arena, seg->min_alloc);
     }
 
     /* First pass: just read the relocation data */
@@ -501,15 +620,37 @@ void read_segments(off_t start, struct ne *ne)
 
         if (seg->flags & 0x0100) {
             seg->reloc_count = read_word(seg->start + seg->length);
-            seg->reloc_table = malloc(seg->reloc_count * sizeof(struct reloc));
+            seg->reloc_table = arena_alloc(&ne->arena, seg->reloc_count * sizeof(struct reloc));
 
+            buf.count = 0;
             for (j = 0; j < seg->reloc_count; j++)
-                read_reloc(seg, j, ne);
+                read_reloc(seg, j, &buf, ne);
+
+            /* imports and ordinals don't leave any offsets of our own */
+            seg->reloc_offset_count = buf.count;
+            if (buf.count) {
+                seg->reloc_offsets = arena_alloc(&ne->arena, buf.count * sizeof(*buf.offsets));
+                memcpy(seg->reloc_offsets, buf.offsets, buf.count * sizeof(*buf.offsets));
+                qsort(seg->reloc_offsets, buf.count, sizeof(*buf.offsets), compare_reloc_offset);
+            } else
+                seg->reloc_offsets = NULL;
         } else {
             seg->reloc_count = 0;
             seg->reloc_table = NULL;
+            seg->reloc_offsets = NULL;
+            seg->reloc_offset_count = 0;
         }
     }
+    free(buf.offsets);
+
+    /* Pick up where a previous run left off, if asked to. */
+    flags = malloc(count * sizeof(*flags));
+    lengths = malloc(count * sizeof(*lengths));
+    for (i = 0; i < count; i++) {
+        flags[i] = ne->segments[i].instr_flags;
+        lengths[i] = ne->segments[i].min_alloc;
+    }
+    load_state(flags, lengths, count, &ne->xrefs);
 
     /* Second pass: scan entry points (we have to do this after we read
      * relocation data for all segments.) */
@@ -542,25 +683,93 @@ void read_segments(off_t start, struct ne *ne)
         ne->segments[entry_cs-1].instr_flags[entry_ip] |= INSTR_FUNC;
         scan_segment(entry_cs, entry_ip, ne);
     }
+
+    /* user-supplied entry points, given as cs:ip like we print them */
+    for (i = 0; i < entry_point_count; i++) {
+        unsigned cs, ip;
+
+        if (sscanf(entry_points[i], "%u:%x", &cs, &ip) != 2) {
+            fprintf(stderr, "Invalid entry point `%s' (expected segment:offset).\n", entry_points[i]);
+            continue;
+        }
+        if (cs < 1 || cs > count || (ne->segments[cs-1].flags & 0x0001)) {
+            fprintf(stderr, "Entry point %s is not in a code segment.\n", entry_points[i]);
+            continue;
+        }
+        if (ip >= ne->segments[cs-1].min_alloc) {
+            fprintf(stderr, "Entry point %s exceeds segment length (%04x).\n",
+                    entry_points[i], ne->segments[cs-1].min_alloc);
+            continue;
+        }
+        ne->segments[cs-1].instr_flags[ip] |= INSTR_FUNC;
+        scan_segment(cs, ip, ne);
+    }
+
+    /* scanning is done; the disassembly looks references up as it goes */
+    xref_sort(&ne->xrefs);
+
+    save_state(flags, lengths, count, &ne->xrefs);
+    free(flags);
+    free(lengths);
+}
+
+void print_ne_xrefs(struct ne *ne) {
+    unsigned i;
+
+    xref_sort(&ne->xrefs);
+
+    putchar('\n');
+    printf("Cross-references:\n");
+
+    for (i = 0; i < ne->xrefs.count; i++) {
+        const struct xref *x = &ne->xrefs.xrefs[i];
+
+        if (!i || x->to != x[-1].to) {
+            const char *name = get_entry_name(x->to >> 16, x->to & 0xffff, ne);
+            printf("%3d:%04x <%s>:\n", x->to >> 16, x->to & 0xffff, name ? name : "no name");
+        }
+        printf("\t%3d:%04x\t%s\n", x->from >> 16, x->from & 0xffff, xref_type_name(x->type));
+    }
 }
 
-void free_segments(struct ne *ne) {
+void print_ne_cfg(const struct ne *ne) {
+    struct cfg_region *regions = malloc(ne->header.ne_cseg * sizeof(*regions));
+    unsigned count = 0;
+    struct cfg cfg;
     unsigned cs;
-    struct segment *seg;
 
     for (cs = 1; cs <= ne->header.ne_cseg; cs++) {
-        seg = &ne->segments[cs-1];
-        free_reloc(seg->reloc_table, seg->reloc_count);
-        free(seg->instr_flags);
+        const struct segment *seg = &ne->segments[cs-1];
+
+        if (seg->flags & 0x0001) continue;
+
+        regions[count].base = cs << 16;
+        regions[count].ip = 0;
+        /* the scanner doesn't mark anything past the minimum allocation */
+        regions[count].length = min(seg->length, seg->min_alloc);
+        regions[count].offset = seg->start;
+        regions[count].flags = seg->instr_flags;
+        regions[count].bits = (seg->flags & 0x2000) ? 32 : 16;
+        regions[count].linear = 0;
+        count++;
     }
 
-    free(ne->segments);
+    cfg_build(&cfg, regions, count);
+    cfg_print(&cfg, ne->name, ne_addr, NULL);
+    cfg_free(&cfg);
+    free(regions);
 }
 
 void print_segments(struct ne *ne) {
     unsigned cs;
     struct segment *seg;
 
+    if (opts & COMPILABLE) {
+        for (cs = 1; cs <= ne->header.ne_cseg; cs++)
+            print_compilable(&ne->segments[cs-1], ne);
+        return;
+    }
+
     /* Final pass: print data */
     for (cs = 1; cs <= ne->header.ne_cseg; cs++) {
         seg = &ne->segments[cs-1];
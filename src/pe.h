@@ -2,6 +2,9 @@
 #define __PE_H
 
 #include "semblance.h"
+#include "arena.h"
+#include "symbols.h"
+#include "xref.h"
 
 #pragma pack(1)
 
@@ -15,6 +18,25 @@ struct file_header {
     word  Characteristics;              /* 16 */
 };
 
+/* An entry in the COFF symbol table. Auxiliary records follow in the same
+ * 18-byte slots. */
+struct coff_symbol {
+    union {
+        char ShortName[8];              /* 00 */
+        struct {
+            dword Zeroes;               /* 00 */
+            dword Offset;               /* 04 into the string table */
+        };
+    };
+    dword Value;                        /* 08 */
+    short SectionNumber;                /* 0c */
+    word  Type;                         /* 0e */
+    byte  StorageClass;                 /* 10 */
+    byte  NumberOfAuxSymbols;           /* 11 */
+};
+
+STATIC_ASSERT(sizeof(struct coff_symbol) == 18);
+
 struct directory {
     dword address;
     dword size;
@@ -119,6 +141,13 @@ struct reloc_pe
 
 #pragma pack()
 
+/* An entry in the x64 exception table (.pdata). */
+struct runtime_function {
+    dword BeginAddress;
+    dword EndAddress;
+    dword UnwindInfoAddress;
+};
+
 struct export {
     dword address;
     word ordinal;
@@ -150,6 +179,7 @@ struct pe {
         const struct optional_header_pep *opt64;
     };
     const struct directory *dirs;
+    unsigned dir_count;
 
     const char *name;
 
@@ -163,12 +193,24 @@ struct pe {
 
     struct reloc_pe *relocs;
     unsigned reloc_count;
+
+    const struct runtime_function *functions;
+    unsigned function_count;
+
+    struct xref_table xrefs;
+    struct symbol_table symbols;
+
+    struct arena arena;     /* everything above that we allocated */
 };
 
+/* in pe_resource.c */
+extern void print_pe_rsrc(const struct pe *pe);
 /* in pe_section.c */
 extern struct section *addr2section(dword addr, const struct pe *pe);
 extern off_t addr2offset(dword addr, const struct pe *pe);
 extern void read_sections(struct pe *pe);
 extern void print_sections(struct pe *pe);
+extern void print_pe_xrefs(struct pe *pe);
+extern void print_pe_cfg(const struct pe *pe);
 
 #endif /* __PE_H */
@@ -26,6 +26,64 @@
 #include "semblance.h"
 #include "pe.h"
 
+/* symbol files count sections from 1 */
+static int get_symbol_addr(word seg, dword offset, dword *addr, const void *ctx) {
+    const struct pe *pe = ctx;
+
+    if (!seg || seg > pe->header->NumberOfSections)
+        return 0;
+    *addr = pe->sections[seg-1].address + offset;
+    return 1;
+}
+
+/* MinGW leaves the COFF symbol table in the image, followed by the string
+ * table for long names. Values are relative to the symbol's section. */
+static void get_coff_symbols(struct pe *pe) {
+    off_t offset = pe->header->PointerToSymbolTable;
+    off_t strtab = offset + (off_t)pe->header->NumberOfSymbols * sizeof(struct coff_symbol);
+    dword strtab_size = 0;
+    dword i;
+
+    if (strtab > map_size) {
+        warn("Symbol table at %#lx exceeds the file size\n", (long)offset);
+        return;
+    }
+    if (strtab + 4 <= map_size)
+        strtab_size = min(read_dword(strtab), map_size - strtab);
+
+    for (i = 0; i < pe->header->NumberOfSymbols; i++) {
+        const struct coff_symbol *sym = read_data(offset + i * sizeof(struct coff_symbol));
+        const char *name;
+        size_t len;
+
+        i += sym->NumberOfAuxSymbols;
+
+        /* only external and static symbols; the rest are files, sections'
+         * auxiliary data, and the like */
+        if (sym->StorageClass != 2 && sym->StorageClass != 3)
+            continue;
+        if (sym->SectionNumber <= 0 || sym->SectionNumber > pe->header->NumberOfSections)
+            continue;
+
+        if (sym->Zeroes) {
+            name = sym->ShortName;
+            len = strnlen(name, 8);
+        } else {
+            if (sym->Offset < 4 || sym->Offset >= strtab_size)
+                continue;
+            name = (const char *)read_data(strtab + sym->Offset);
+            len = strnlen(name, strtab_size - sym->Offset);
+        }
+
+        /* section symbols (.text) and local labels */
+        if (!len || name[0] == '.')
+            continue;
+
+        symbol_add(&pe->symbols, pe->sections[sym->SectionNumber-1].address + sym->Value, name, len,
+            ((sym->Type & 0x30) == 0x20) ? SYMBOL_FUNC : 0);
+    }
+}
+
 static void print_flags(word flags) {
     char buffer[1024] = "";
 
@@ -240,7 +298,7 @@ static void get_export_table(struct pe *pe)
     pe->name = read_data(addr2offset(header->module_name_addr, pe));
 
     /* Grab the exports. */
-    pe->exports = malloc(header->addr_table_count * sizeof(struct export));
+    pe->exports = arena_alloc(&pe->arena, header->addr_table_count * sizeof(struct export));
 
     /* If addr_table_count exceeds export_count, this means that some exports
      * are nameless (and thus exported by ordinal). */
@@ -274,7 +332,7 @@ static void get_import_name_table(struct import_module *module, dword nametab_ad
     else
         while (read_qword(offset + count * 8)) count++;
 
-    module->nametab = malloc(count * sizeof(*module->nametab));
+    module->nametab = arena_alloc(&pe->arena, count * sizeof(*module->nametab));
 
     for (i = 0; i < count; i++) {
         qword address;
@@ -305,7 +363,7 @@ static void get_import_module_table(struct pe *pe) {
     while (memcmp(read_data(offset + pe->import_count * 20), zeroes, 20))
         pe->import_count++;
 
-    pe->imports = malloc(pe->import_count * sizeof(struct import_module));
+    pe->imports = arena_alloc(&pe->arena, pe->import_count * sizeof(struct import_module));
 
     for (i = 0; i < pe->import_count; i++)
     {
@@ -326,7 +384,7 @@ static void get_reloc_table(struct pe *pe) {
         cursor += read_dword(cursor + 4);
     }
 
-    pe->relocs = malloc(pe->reloc_count * sizeof(*pe->relocs));
+    pe->relocs = arena_alloc(&pe->arena, pe->reloc_count * sizeof(*pe->relocs));
     cursor = offset;
     while (cursor < offset + pe->dirs[5].size)
     {
@@ -344,6 +402,19 @@ static void get_reloc_table(struct pe *pe) {
     }
 }
 
+/* x64 images list every function that needs unwinding, which is nearly all
+ * of them, in .pdata. */
+static void get_exception_table(struct pe *pe) {
+    off_t offset = addr2offset(pe->dirs[3].address, pe);
+
+    if (!offset || offset + pe->dirs[3].size > map_size) {
+        warn("Exception table at %#x isn't in the file?\n", pe->dirs[3].address);
+        return;
+    }
+    pe->functions = read_data(offset);
+    pe->function_count = pe->dirs[3].size / sizeof(struct runtime_function);
+}
+
 static void readpe(off_t offset_pe, struct pe *pe)
 {
     off_t offset;
@@ -368,10 +439,11 @@ static void readpe(off_t offset_pe, struct pe *pe)
     }
 
     pe->dirs = read_data(offset);
+    pe->dir_count = cdirs;
     offset += cdirs * sizeof(struct directory);
 
     /* read the section table */
-    pe->sections = malloc(pe->header->NumberOfSections * sizeof(struct section));
+    pe->sections = arena_alloc(&pe->arena, pe->header->NumberOfSections * sizeof(struct section));
     for (i = 0; i < pe->header->NumberOfSections; i++)
     {
         memcpy(&pe->sections[i], read_data(offset + i*0x28), 0x28);
@@ -379,12 +451,18 @@ static void readpe(off_t offset_pe, struct pe *pe)
         /* allocate zeroes, but only if it's a code section */
         /* in theory nobody will ever try to jump into a data section.
          * VirtualProtect() be damned */
-        if (pe->sections[i].flags & 0x20)
-            pe->sections[i].instr_flags = calloc(pe->sections[i].min_alloc, sizeof(byte));
+        /* compilable output needs somewhere to put labels for data, though */
+        if ((pe->sections[i].flags & 0x20) || (opts & COMPILABLE))
+            pe->sections[i].instr_flags = arena_alloc(&pe->arena, pe->sections[i].min_alloc);
         else
             pe->sections[i].instr_flags = NULL;
     }
 
+    /* Read the symbols. */
+    if (pe->header->PointerToSymbolTable)
+        get_coff_symbols(pe);
+    load_symbols(&pe->symbols, get_symbol_addr, pe);
+
     /* Read the Data Directories.
      * PE is bizarre. It tries to make all of these things generic by putting
      * them in separate "directories". But the order of these seems to be fixed
@@ -394,25 +472,20 @@ static void readpe(off_t offset_pe, struct pe *pe)
         get_export_table(pe);
     if (cdirs >= 2 && pe->dirs[1].size)
         get_import_module_table(pe);
+    if (cdirs >= 4 && pe->dirs[3].size && pe->header->Machine == 0x8664)
+        get_exception_table(pe);
     if (cdirs >= 6 && pe->dirs[5].size)
         get_reloc_table(pe);
 
     /* Read the code. */
-    if (mode & DISASSEMBLE)
+    if ((mode & (DISASSEMBLE | DUMPXREFS | DUMPCFG)) || save_state_file)
         read_sections(pe);
 }
 
 static void freepe(struct pe *pe) {
-    int i;
-
-    for (i = 0; i < pe->header->NumberOfSections; i++)
-        free(pe->sections[i].instr_flags);
-    free(pe->sections);
-    free(pe->exports);
-    for (i = 0; i < pe->import_count; i++)
-        free(pe->imports[i].nametab);
-    free(pe->relocs);
-    free(pe->imports);
+    xref_free(&pe->xrefs);
+    free_symbols(&pe->symbols);
+    arena_free(&pe->arena);
 }
 
 void dumppe(off_t offset_pe) {
@@ -445,6 +518,18 @@ void dumppe(off_t offset_pe) {
     if (pe_rel_addr == -1)
         pe_rel_addr = pe.header->Characteristics & 0x2000;
 
+    if (mode & DUMPCFG) {
+        print_pe_cfg(&pe);
+        freepe(&pe);
+        return;
+    }
+
+    if (opts & COMPILABLE) {
+        print_sections(&pe);
+        freepe(&pe);
+        return;
+    }
+
     printf("Module type: PE (Portable Executable)\n");
     if (pe.name) printf("Module name: %s\n", pe.name);
 
@@ -495,8 +580,19 @@ void dumppe(off_t offset_pe) {
             printf("No imported module table\n");
     }
 
+    if (mode & DUMPRSRC) {
+        putchar('\n');
+        if (pe.dir_count >= 3 && pe.dirs[2].size)
+            print_pe_rsrc(&pe);
+        else
+            printf("No resource table\n");
+    }
+
     if (mode & DISASSEMBLE)
         print_sections(&pe);
 
+    if (mode & DUMPXREFS)
+        print_pe_xrefs(&pe);
+
     freepe(&pe);
 }
@@ -0,0 +1,358 @@
+/*
+ * Function(s) for dumping resources from PE files
+ *
+ * Copyright 2017-2018,2020 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "pe.h"
+
+#pragma pack(1)
+
+struct resource_directory {
+    dword Characteristics;              /* 00 */
+    dword TimeDateStamp;                /* 04 */
+    word  MajorVersion;                 /* 08 */
+    word  MinorVersion;                 /* 0a */
+    word  NumberOfNamedEntries;         /* 0c */
+    word  NumberOfIdEntries;            /* 0e */
+};
+
+STATIC_ASSERT(sizeof(struct resource_directory) == 0x10);
+
+struct resource_directory_entry {
+    dword Name;             /* high bit set: offset of a counted UTF-16 string */
+    dword OffsetToData;     /* high bit set: offset of a subdirectory */
+};
+
+STATIC_ASSERT(sizeof(struct resource_directory_entry) == 0x8);
+
+struct resource_data_entry {
+    dword OffsetToData;     /* an RVA, unlike everything else here */
+    dword Size;
+    dword CodePage;
+    dword Reserved;
+};
+
+STATIC_ASSERT(sizeof(struct resource_data_entry) == 0x10);
+
+#pragma pack()
+
+/* Names are counted UTF-16 strings, at offset into the resource section,
+ * which starts at start and is size bytes long. We only care about them as
+ * filter targets and labels, so anything outside of ASCII becomes '?'. */
+static char *dup_name(off_t start, dword size, dword offset)
+{
+    word length, i;
+    char *ret;
+
+    if (offset + 2 > size || offset + 2 + read_word(start + offset) * 2 > size)
+    {
+        warn("Resource name offset %#x is out of range\n", offset);
+        return strdup("?");
+    }
+    length = read_word(start + offset);
+    ret = malloc(length + 1);
+
+    for (i = 0; i < length; i++)
+    {
+        word c = read_word(start + offset + 2 + i * 2);
+        ret[i] = (c >= ' ' && c <= '~') ? c : '?';
+    }
+    ret[length] = 0;
+    return ret;
+}
+
+/* length is in characters, not bytes. ASCII is narrowed and escaped in runs
+ * the same way as NE strings; anything else is written as \uXXXX. */
+static void print_escaped_unicode(off_t offset, word length)
+{
+    byte buffer[256];
+    size_t count = 0;
+
+    putchar('"');
+    while (length--)
+    {
+        word c = read_word(offset);
+        offset += 2;
+        if (c >= 0x80 || count == sizeof(buffer))
+        {
+            print_escaped_bytes(buffer, count);
+            count = 0;
+        }
+        if (c >= 0x80)
+            printf("\\u%04x", c);
+        else
+            buffer[count++] = c;
+    }
+    print_escaped_bytes(buffer, count);
+    putchar('"');
+}
+
+static void print_hexdump(off_t offset, size_t length)
+{
+    off_t cursor = offset;
+    int len, i;
+
+    /* hexl-style dump */
+    while (cursor < offset + length)
+    {
+        len = min(offset + length - cursor, 16);
+
+        printf("    %lx:", cursor);
+        for (i = 0; i < 16; i++)
+        {
+            if (!(i & 1))
+                putchar(' ');
+            if (i < len)
+                printf("%02x", read_byte(cursor + i));
+            else
+                printf("  ");
+        }
+        printf("  ");
+        for (i = 0; i < len; i++)
+        {
+            char c = read_byte(cursor + i);
+            putchar(isprint(c) ? c : '.');
+        }
+        putchar('\n');
+
+        cursor += len;
+    }
+}
+
+static void print_pe_rsrc_resource(dword type, off_t offset, size_t length, dword id)
+{
+    switch (type)
+    {
+    case 1: /* Cursor */
+    case 2: /* Bitmap */
+    case 3: /* Icon */
+    case 12: /* Cursor directory */
+    case 14: /* Icon directory */
+        /* these are the same as in NE files */
+        print_rsrc_resource(0x8000 | type, offset, length, id);
+        break;
+    case 6: /* String */
+    {
+        /* Each block holds sixteen strings, each a counted UTF-16 string. */
+        off_t cursor = offset;
+        int i;
+
+        for (i = 0; i < 16 && cursor + 2 <= offset + length; i++)
+        {
+            word str_length = read_word(cursor);
+            cursor += 2;
+            if (str_length)
+            {
+                printf("    %3d (0x%06lx): ", i + (id - 1) * 16, cursor);
+                print_escaped_unicode(cursor, str_length);
+                putchar('\n');
+                cursor += str_length * 2;
+            }
+        }
+    }
+    break;
+    case 24: /* Manifest */
+        fwrite(map + offset, 1, length, stdout);
+        if (length && read_byte(offset + length - 1) != '\n')
+            putchar('\n');
+        break;
+    default:
+        print_hexdump(offset, length);
+        break;
+    }
+}
+
+static void extract_pe_resource(const char *type, const char *id, word lang, off_t offset, size_t length)
+{
+    char *name = malloc(strlen(type) + strlen(id) + 16);
+
+    sprintf(name, "%s_%s_%04x.bin", type, id, lang);
+    extract_file(name, offset, length);
+    free(name);
+}
+
+static unsigned dir_count(const struct resource_directory *dir)
+{
+    return dir->NumberOfNamedEntries + dir->NumberOfIdEntries;
+}
+
+/* Check that a directory and all of its entries lie inside the resource
+ * section, which is "size" bytes long. */
+static int valid_dir(dword offset, off_t start, dword size)
+{
+    const struct resource_directory *dir = read_data(start + offset);
+
+    if (offset + sizeof(*dir) > size
+            || offset + sizeof(*dir) + dir_count(dir) * sizeof(struct resource_directory_entry) > size)
+    {
+        warn("Resource directory offset %#x is out of range\n", offset);
+        return 0;
+    }
+    return 1;
+}
+
+/* Returns the offset of the subdirectory that entry points to, or 0 if it's
+ * bogus. */
+static off_t get_subdir(const struct resource_directory_entry *entry, off_t start, dword size)
+{
+    dword offset = entry->OffsetToData & 0x7fffffff;
+
+    if (!(entry->OffsetToData & 0x80000000))
+    {
+        warn("Resource directory entry %#x is not a directory\n", entry->Name);
+        return 0;
+    }
+    if (!valid_dir(offset, start, size))
+        return 0;
+    return start + offset;
+}
+
+static char *get_entry_name(const struct resource_directory_entry *entry, off_t start, dword size)
+{
+    char *ret;
+
+    if (entry->Name & 0x80000000)
+        return dup_name(start, size, entry->Name & 0x7fffffff);
+
+    ret = malloc(6);
+    sprintf(ret, "%u", entry->Name & 0xffff);
+    return ret;
+}
+
+void print_pe_rsrc(const struct pe *pe)
+{
+    off_t start = addr2offset(pe->dirs[2].address, pe);
+    dword size = pe->dirs[2].size;
+    const struct resource_directory *root = read_data(start);
+    const struct resource_directory_entry *types = (const void *)(root + 1);
+    unsigned i, j, k;
+
+    if (!start)
+    {
+        warn("Resource directory %#x is not in any section\n", pe->dirs[2].address);
+        return;
+    }
+    if (!valid_dir(0, start, size))
+        return;
+
+    /* The tree is always three levels deep: type, then name, then language. */
+    for (i = 0; i < dir_count(root); i++)
+    {
+        const struct resource_directory *names_dir;
+        const struct resource_directory_entry *names;
+        struct rsrc_key type_key = {0};
+        char *typestr;
+        off_t offset;
+        int named_type = types[i].Name & 0x80000000;
+
+        if (!(offset = get_subdir(&types[i], start, size)))
+            continue;
+        names_dir = read_data(offset);
+        names = (const void *)(names_dir + 1);
+
+        if (named_type)
+            typestr = dup_name(start, size, types[i].Name & 0x7fffffff);
+        else if (types[i].Name < rsrc_types_count && rsrc_types[types[i].Name])
+            typestr = strdup(rsrc_types[types[i].Name]);
+        else
+        {
+            typestr = malloc(7);
+            sprintf(typestr, "0x%04x", types[i].Name & 0xffff);
+        }
+
+        if (named_type)
+            type_key.name = typestr;
+        else
+            type_key.num = types[i].Name & 0xffff;
+
+        for (j = 0; j < dir_count(names_dir); j++)
+        {
+            const struct resource_directory *langs_dir;
+            const struct resource_directory_entry *langs;
+            struct rsrc_key id_key = {0};
+            char *idstr;
+
+            if (!(offset = get_subdir(&names[j], start, size)))
+                continue;
+            langs_dir = read_data(offset);
+            langs = (const void *)(langs_dir + 1);
+
+            idstr = get_entry_name(&names[j], start, size);
+            if (names[j].Name & 0x80000000)
+                id_key.name = idstr;
+            else
+                id_key.num = names[j].Name & 0xffff;
+            if (!filter_resource(&type_key, &id_key))
+            {
+                free(idstr);
+                continue;
+            }
+
+            for (k = 0; k < dir_count(langs_dir); k++)
+            {
+                const struct resource_data_entry *data;
+                const struct section *section;
+                off_t data_offset;
+
+                if (langs[k].OffsetToData & 0x80000000
+                        || langs[k].OffsetToData + sizeof(*data) > size)
+                {
+                    warn("Resource data entry %#x is invalid\n", langs[k].OffsetToData);
+                    continue;
+                }
+                data = read_data(start + langs[k].OffsetToData);
+
+                section = addr2section(data->OffsetToData, pe);
+                /* the section may be longer in memory than in the file */
+                if (!section || data->OffsetToData < section->address
+                        || data->OffsetToData - section->address > section->length
+                        || data->Size > section->length - (data->OffsetToData - section->address))
+                {
+                    warn("Resource data %#x is not in any section\n", data->OffsetToData);
+                    continue;
+                }
+                data_offset = addr2offset(data->OffsetToData, pe);
+
+                if (named_type)
+                    printf("\n\"%s\"", typestr);
+                else
+                    printf("\n%s", typestr);
+                printf(" %s (language 0x%04x, offset = 0x%lx, length = %u [0x%x]):\n",
+                        idstr, langs[k].Name & 0xffff, data_offset, data->Size, data->Size);
+
+                if (extract_dir)
+                    extract_pe_resource(typestr, idstr, langs[k].Name, data_offset, data->Size);
+                else
+                    print_pe_rsrc_resource(named_type ? 0 : types[i].Name,
+                            data_offset, data->Size, names[j].Name);
+            }
+
+            free(idstr);
+        }
+
+        free(typestr);
+    }
+}
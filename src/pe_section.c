@@ -21,10 +21,12 @@
  */
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include "semblance.h"
 #include "pe.h"
 #include "x86_instr.h"
+#include "cfg.h"
 
 #ifdef USE_WARN
 #define warn_at(...) \
@@ -66,7 +68,7 @@ static const char *get_export_name(dword ip, const struct pe *pe) {
         if (pe->exports[i].address == ip)
             return pe->exports[i].name;
     }
-    return NULL;
+    return symbol_name(&pe->symbols, ip);
 }
 
 static const char *get_imported_name(dword offset, const struct pe *pe) {
@@ -101,8 +103,9 @@ static const struct reloc_pe *get_reloc(dword ip, const struct pe *pe) {
     return NULL;
 }
 
-static char *relocate_arg(const struct instr *instr, const struct arg *arg, const struct pe *pe) {
-    const struct reloc_pe *r = get_reloc(arg->ip, pe);
+static char *relocate_arg(const struct instr *instr, int i, const struct pe *pe) {
+    const struct reloc_pe *r = get_reloc(arg_ip(instr, i), pe);
+    enum argtype type = instr->argtype[i];
     static char comment[10];
 
     if (!r)
@@ -111,8 +114,8 @@ static char *relocate_arg(const struct instr *instr, const struct arg *arg, cons
     if (r->type == 0)
         return NULL;    /* not even a real relocation, just padding */
     else if (r->type == 3) {
-        if (arg->type == IMM || (arg->type == RM && instr->modrm_reg == -1) || arg->type == MOFFS) {
-            snprintf(comment, 10, "%lx", pe_rel_addr ? arg->value - pe->opt32->ImageBase : arg->value);
+        if (type == IMM || (type == RM && instr->modrm_reg == -1) || type == MOFFS) {
+            snprintf(comment, 10, "%lx", pe_rel_addr ? instr->args[i] - pe->opt32->ImageBase : instr->args[i]);
             return comment;
         }
     }
@@ -121,22 +124,23 @@ static char *relocate_arg(const struct instr *instr, const struct arg *arg, cons
 }
 
 static const char *get_arg_comment(const struct section *sec, dword end_ip,
-        const struct instr *instr, const struct arg *arg, const struct pe *pe)
+        const struct instr *instr, int i, const struct pe *pe)
 {
     static char comment_str[10];
     struct section *tsec;
     const char *comment;
     qword rel_value;
+    enum argtype type = instr->argtype[i];
 
-    if (arg->type == NONE)
+    if (type == NONE)
         return NULL;
 
-    if (instr->modrm_reg == 16 && arg->type >= RM && arg->type <= MEM)
+    if (instr->modrm_reg == 16 && type >= RM && type <= MEM)
     {
         dword tip;
         qword abstip;
 
-        tip = end_ip + arg->value;
+        tip = end_ip + instr->args[i];
         abstip = tip;
         if (!pe_rel_addr) abstip += pe->imagebase;
 
@@ -151,12 +155,12 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
     }
 
     /* FIXME: This is getting messy. */
-    rel_value = arg->value;
+    rel_value = instr->args[i];
     if (!pe_rel_addr) rel_value -= pe->imagebase;
 
     /* Relocate anything that points inside the image's address space or that
      * has a relocation entry. */
-    if ((tsec = addr2section(rel_value, pe)) || (sec->instr_flags[arg->ip - sec->address] & INSTR_RELOC))
+    if ((tsec = addr2section(rel_value, pe)) || (sec->instr_flags[arg_ip(instr, i) - sec->address] & INSTR_RELOC))
     {
         if ((comment = get_imported_name(rel_value, pe)))
             return comment;
@@ -174,11 +178,11 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
             return get_imported_name(rel_value, pe);
         }
 
-        if ((comment = relocate_arg(instr, arg, pe)))
+        if ((comment = relocate_arg(instr, i, pe)))
             return comment;
 
         /* Don't print any comment for mundane relative jumps or calls. */
-        if (arg->type == REL8 || arg->type == REL)
+        if (type == REL8 || type == REL)
             return NULL;
 
         /* If all else fails, print the address relative to the image base. */
@@ -189,11 +193,63 @@ static const char *get_arg_comment(const struct section *sec, dword end_ip,
     return NULL;
 }
 
+static void pe_addr(char *out, dword addr, const void *ctx) {
+    const struct pe *pe = ctx;
+    sprintf(out, "%lx", addr + (pe_rel_addr ? 0 : pe->imagebase));
+}
+
+/* Label for the byte at addr in compilable output, or NULL if it hasn't got
+ * one. */
+static const char *get_pe_label(dword addr, const struct pe *pe) {
+    static char label[48];
+    const struct section *sec = addr2section(addr, pe);
+    byte flags;
+
+    if (!sec || !sec->instr_flags)
+        return NULL;
+    flags = sec->instr_flags[addr - sec->address];
+    if (!(flags & INSTR_LABEL))
+        return NULL;
+    get_label(label, addr, flags, pe_addr, pe);
+    return label;
+}
+
+/* Replace addresses with labels, for compilable output. */
+static void label_args(const struct section *sec, dword end_ip, const struct instr *instr,
+        char argstr[3][ARG_LEN], const struct pe *pe)
+{
+    int bits = (pe->magic == 0x10b) ? 32 : 64;
+    const char *label;
+    dword relip;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        enum argtype type = instr->argtype[i];
+
+        label = NULL;
+        if (type == REL8 || type == REL)
+            label = get_pe_label(instr->args[i], pe);
+        else if (instr->modrm_reg == 16 && type >= RM && type <= MEM)
+            label = get_pe_label(end_ip + instr->args[i], pe);
+        else if (type == IMM || type == MOFFS || (type >= RM && type <= MEM && instr->modrm_disp == DISP_16)) {
+            /* only trust it to be an address if it's relocated */
+            relip = arg_ip(instr, i) - sec->address;
+            if (relip < sec->min_alloc && (sec->instr_flags[relip] & INSTR_RELOC)
+                    && instr->args[i] >= pe->imagebase)
+                label = get_pe_label(instr->args[i] - pe->imagebase, pe);
+        }
+
+        if (label)
+            print_label_arg("", instr, i, bits, asm_syntax, label, argstr[i]);
+    }
+}
+
 static int print_pe_instr(const struct section *sec, dword ip, byte *p, const struct pe *pe) {
     struct instr instr = {0};
     unsigned len;
     const char *comment = NULL;
     char ip_string[17];
+    char argstr[3][ARG_LEN] = {{0}};
     qword absip = ip;
     int bits = (pe->magic == 0x10b) ? 32 : 64;
 
@@ -204,11 +260,20 @@ static int print_pe_instr(const struct section *sec, dword ip, byte *p, const st
 
     sprintf(ip_string, "%8lx", absip);
 
+    if (opts & COMPILABLE) {
+        dword relip = ip - sec->address;
+        print_labels(ip, sec->instr_flags + relip, min(len, sec->min_alloc - relip), pe_addr, pe, asm_syntax);
+        label_args(sec, ip + len, &instr, argstr, pe);
+    }
+
+    if (mode & DUMPXREFS)
+        print_xref_comment(&pe->xrefs, ip, pe_addr, pe, asm_syntax);
+
     /* We deal in relative addresses internally everywhere. That means we have
      * to fix up the values for relative jumps if we're not displaying relative
      * addresses. */
-    if ((instr.op.arg0 == REL8 || instr.op.arg0 == REL) && !pe_rel_addr) {
-        instr.args[0].value += pe->imagebase;
+    if ((instr.op->arg0 == REL8 || instr.op->arg0 == REL) && !pe_rel_addr) {
+        instr.args[0] += pe->imagebase;
     }
 
     /* Check for relocations and imported names. PE separates the two concepts:
@@ -216,10 +281,10 @@ static int print_pe_instr(const struct section *sec, dword ip, byte *p, const st
      * relocated, and relocations proper are scattered throughout code sections
      * and relocated according to the contents of .reloc. */
 
-    if (!(comment = get_arg_comment(sec, ip + len, &instr, &instr.args[0], pe)))
-        comment = get_arg_comment(sec, ip + len, &instr, &instr.args[1], pe);
+    if (!(comment = get_arg_comment(sec, ip + len, &instr, 0, pe)))
+        comment = get_arg_comment(sec, ip + len, &instr, 1, pe);
 
-    print_instr(ip_string, p, len, sec->instr_flags[ip - sec->address], &instr, comment, bits);
+    print_instr(ip_string, p, len, sec->instr_flags[ip - sec->address], &instr, argstr, comment, bits, asm_syntax);
 
     return len;
 }
@@ -302,6 +367,40 @@ static void print_data(const struct section *sec, struct pe *pe) {
     }
 }
 
+/* Compilable output: all of the section, code and data alike, with labels
+ * wherever the scanner found a reference. */
+static void print_compilable(const struct section *sec, const struct pe *pe) {
+    dword length = min(sec->length, sec->min_alloc);
+    dword relip = 0, start;
+    int bits = (pe->magic == 0x10b) ? 32 : 64;
+    byte buffer[MAX_INSTR];
+    char name[9];
+
+    snprintf(name, sizeof(name), "%.8s", sec->name);
+    print_region_start(name, bits, asm_syntax);
+
+    if (sec->flags & 0x20) {
+        while (relip < length) {
+            /* anything between instructions is data */
+            for (start = relip; relip < length && !(sec->instr_flags[relip] & INSTR_VALID); relip++);
+            print_data_range(sec->offset + start, sec->instr_flags + start, sec->address + start,
+                    relip - start, relip - start, pe_addr, pe, asm_syntax);
+            if (relip >= length) break;
+
+            memset(buffer, 0, sizeof(buffer));
+            memcpy(buffer, read_data(sec->offset + relip), min(sizeof(buffer), sec->length - relip));
+            relip += print_pe_instr(sec, sec->address + relip, buffer, pe);
+        }
+    }
+
+    /* the rest, including anything past the end of the raw data */
+    if (relip < sec->min_alloc)
+        print_data_range(sec->offset + relip, sec->instr_flags + relip, sec->address + relip,
+                (relip < length) ? length - relip : 0, sec->min_alloc - relip, pe_addr, pe, asm_syntax);
+
+    print_region_end(name, asm_syntax);
+}
+
 static void scan_segment(dword ip, struct pe *pe) {
     struct section *sec = addr2section(ip, pe);
     dword relip;
@@ -343,29 +442,32 @@ static void scan_segment(dword ip, struct pe *pe) {
         if (i < relip+instr_length && i == sec->min_alloc) break;
 
         /* handle conditional and unconditional jumps */
-        if (instr.op.flags & OP_BRANCH) {
+        if (instr.op->flags & OP_BRANCH) {
             /* relative jump, loop, or call */
-            struct section *tsec = addr2section(instr.args[0].value, pe);
+            struct section *tsec = addr2section(instr.args[0], pe);
 
             if (tsec)
             {
                 if (tsec->flags & 0x20)
                 {
-                    dword trelip = instr.args[0].value - tsec->address;
+                    dword trelip = instr.args[0] - tsec->address;
 
-                    if (!strcmp(instr.op.name, "call"))
+                    if (instr.op->flags & OP_CALL) {
                         tsec->instr_flags[trelip] |= INSTR_FUNC;
-                    else
+                        xref_add(&pe->xrefs, ip, instr.args[0], XREF_CALL);
+                    } else {
                         tsec->instr_flags[trelip] |= INSTR_JUMP;
+                        xref_add(&pe->xrefs, ip, instr.args[0], XREF_JUMP);
+                    }
 
                     /* scan it */
-                    scan_segment(instr.args[0].value, pe);
+                    scan_segment(instr.args[0], pe);
                 }
                 else
                     warn_at("Branch '%s' to byte %lx in non-code section %s.\n",
-                            instr.op.name, instr.args[0].value, tsec->name);
+                            instr.op->name, instr.args[0], tsec->name);
             } else
-                warn_at("Branch '%s' to byte %lx not in image.\n", instr.op.name, instr.args[0].value);
+                warn_at("Branch '%s' to byte %lx not in image.\n", instr.op->name, instr.args[0]);
         }
 
         for (i = relip; i < relip+instr_length; i++) {
@@ -391,9 +493,13 @@ static void scan_segment(dword ip, struct pe *pe) {
                         continue;
                     }
 
+                    xref_add(&pe->xrefs, ip, taddr, XREF_DATA);
+                    if (tsec->instr_flags)
+                        tsec->instr_flags[taddr - tsec->address] |= INSTR_DATA;
+
                     /* Only try to scan it if it's an immediate address. If someone is
                      * dereferencing an address inside a code section, it's data. */
-                    if (tsec->flags & 0x20 && (instr.op.arg0 == IMM || instr.op.arg1 == IMM)) {
+                    if (tsec->flags & 0x20 && (instr.op->arg0 == IMM || instr.op->arg1 == IMM)) {
                         tsec->instr_flags[taddr - tsec->address] |= INSTR_FUNC;
                         scan_segment(taddr, pe);
                     }
@@ -406,7 +512,22 @@ static void scan_segment(dword ip, struct pe *pe) {
             }
         }
 
-        if (instr.op.flags & OP_STOP)
+        /* rip-relative operands */
+        if (instr.modrm_reg == 16) {
+            for (i = 0; i < 2; i++) {
+                if (instr.argtype[i] >= RM && instr.argtype[i] <= MEM) {
+                    dword taddr = ip + instr_length + instr.args[i];
+                    struct section *tsec = addr2section(taddr, pe);
+                    if (tsec) {
+                        xref_add(&pe->xrefs, ip, taddr, XREF_DATA);
+                        if (tsec->instr_flags)
+                            tsec->instr_flags[taddr - tsec->address] |= INSTR_DATA;
+                    }
+                }
+            }
+        }
+
+        if (instr.op->flags & OP_STOP)
             return;
 
         ip += instr_length;
@@ -456,11 +577,61 @@ static void print_section_flags(dword flags) {
     printf("    Alignment: %d (2**%d)\n", 1 << alignment, alignment);
 }
 
+void print_pe_xrefs(struct pe *pe) {
+    unsigned i;
+
+    xref_sort(&pe->xrefs);
+
+    putchar('\n');
+    printf("Cross-references:\n");
+
+    for (i = 0; i < pe->xrefs.count; i++) {
+        const struct xref *x = &pe->xrefs.xrefs[i];
+        qword base = pe_rel_addr ? 0 : pe->imagebase;
+
+        if (!i || x->to != x[-1].to) {
+            const char *name = get_export_name(x->to, pe);
+            if (!name) name = get_imported_name(x->to, pe);
+            printf("%8lx <%s>:\n", x->to + base, name ? name : "no name");
+        }
+        printf("\t%8lx\t%s\n", x->from + base, xref_type_name(x->type));
+    }
+}
+
+void print_pe_cfg(const struct pe *pe) {
+    struct cfg_region *regions = malloc(pe->header->NumberOfSections * sizeof(*regions));
+    unsigned count = 0;
+    struct cfg cfg;
+    int i;
+
+    for (i = 0; i < pe->header->NumberOfSections; i++) {
+        const struct section *sec = &pe->sections[i];
+
+        if (!(sec->flags & 0x20)) continue;
+
+        regions[count].base = sec->address;
+        regions[count].ip = sec->address;
+        regions[count].length = min(sec->length, sec->min_alloc);
+        regions[count].offset = sec->offset;
+        regions[count].flags = sec->instr_flags;
+        regions[count].bits = (pe->magic == 0x10b) ? 32 : 64;
+        regions[count].linear = 0;
+        count++;
+    }
+
+    cfg_build(&cfg, regions, count);
+    cfg_print(&cfg, pe->name ? pe->name : "", pe_addr, pe);
+    cfg_free(&cfg);
+    free(regions);
+}
+
 /* We don't actually know what sections contain code. In theory it could be any
  * of them. Fortunately we actually have everything we need already. */
 
 void read_sections(struct pe *pe) {
     dword entry_point = (pe->magic == 0x10b) ? pe->opt32->AddressOfEntryPoint : pe->opt64->AddressOfEntryPoint;
+    byte **flags;
+    dword *lengths;
     int i;
 
     /* We already read the section header (unlike NE, we had to in order to read
@@ -491,6 +662,15 @@ void read_sections(struct pe *pe) {
         }
     }
 
+    /* Pick up where a previous run left off, if asked to. */
+    flags = malloc(pe->header->NumberOfSections * sizeof(*flags));
+    lengths = malloc(pe->header->NumberOfSections * sizeof(*lengths));
+    for (i = 0; i < pe->header->NumberOfSections; i++) {
+        flags[i] = pe->sections[i].instr_flags;
+        lengths[i] = (pe->sections[i].flags & 0x20) ? pe->sections[i].min_alloc : 0;
+    }
+    load_state(flags, lengths, pe->header->NumberOfSections, &pe->xrefs);
+
     for (i = 0; i < pe->export_count; i++)
     {
         dword address = pe->exports[i].address;
@@ -509,6 +689,38 @@ void read_sections(struct pe *pe) {
         }
     }
 
+    /* Functions named by the symbol table. */
+    for (i = 0; i < pe->symbols.count; i++) {
+        const struct symbol *sym = &pe->symbols.symbols[i];
+        struct section *sec;
+
+        if (!(sym->flags & SYMBOL_FUNC))
+            continue;
+        sec = addr2section(sym->addr, pe);
+        if (sec && (sec->flags & 0x20)) {
+            sec->instr_flags[sym->addr - sec->address] |= INSTR_FUNC;
+            scan_segment(sym->addr, pe);
+        }
+    }
+
+    /* Functions listed in the exception table. An entry whose unwind info is
+     * chained to another (flag 4, or an odd address pointing at the other
+     * entry) covers a later part of that function, not a new one. */
+    for (i = 0; i < pe->function_count; i++) {
+        dword address = pe->functions[i].BeginAddress;
+        dword unwind = pe->functions[i].UnwindInfoAddress;
+        struct section *sec = addr2section(address, pe);
+        off_t offset;
+
+        if (!sec || !(sec->flags & 0x20)) {
+            warn("Function at %#x isn't in a code section?\n", address);
+            continue;
+        }
+        if (!(unwind & 1) && (offset = addr2offset(unwind, pe)) && !(read_byte(offset) & 0x20))
+            sec->instr_flags[address - sec->address] |= INSTR_FUNC;
+        scan_segment(address, pe);
+    }
+
     if (entry_point) {
         struct section *sec = addr2section(entry_point, pe);
         if (!sec)
@@ -518,12 +730,48 @@ void read_sections(struct pe *pe) {
             scan_segment(entry_point, pe);
         }
     }
+
+    /* User-supplied entry points. Accept either relative or absolute
+     * addresses, since both are printed depending on --pe-rel-addr. */
+    for (i = 0; i < entry_point_count; i++) {
+        struct section *sec;
+        char *end;
+        qword address = strtoull(entry_points[i], &end, 16);
+
+        if (end == entry_points[i] || *end) {
+            fprintf(stderr, "Invalid entry point `%s'.\n", entry_points[i]);
+            continue;
+        }
+        if (address >= pe->imagebase)
+            address -= pe->imagebase;
+
+        sec = addr2section(address, pe);
+        if (!sec || !(sec->flags & 0x20)) {
+            fprintf(stderr, "Entry point %s is not in a code section.\n", entry_points[i]);
+            continue;
+        }
+        sec->instr_flags[address - sec->address] |= INSTR_FUNC;
+        scan_segment(address, pe);
+    }
+
+    /* scanning is done; the disassembly looks references up as it goes */
+    xref_sort(&pe->xrefs);
+
+    save_state(flags, lengths, pe->header->NumberOfSections, &pe->xrefs);
+    free(flags);
+    free(lengths);
 }
 
 void print_sections(struct pe *pe) {
     int i;
     struct section *sec;
 
+    if (opts & COMPILABLE) {
+        for (i = 0; i < pe->header->NumberOfSections; i++)
+            print_compilable(&pe->sections[i], pe);
+        return;
+    }
+
     for (i = 0; i < pe->header->NumberOfSections; i++) {
         sec = &pe->sections[i];
 
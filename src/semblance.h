@@ -15,6 +15,8 @@ typedef uint32_t dword;
 typedef uint64_t qword;
 
 extern byte *map;
+extern int map_fd;
+extern off_t map_size;
 
 static inline const void *read_data(off_t offset)
 {
@@ -42,6 +44,7 @@ static inline qword read_qword(off_t offset)
 }
 
 #define min(a,b) (((a)<(b))?(a):(b))
+#define max(a,b) (((a)>(b))?(a):(b))
 
 #ifdef USE_WARN
 #define warn(...)       fprintf(stderr, "Warning: " __VA_ARGS__)
@@ -56,6 +59,8 @@ static inline qword read_qword(off_t offset)
 #define DUMPEXPORT      0x04
 #define DUMPIMPORT      0x08
 #define DISASSEMBLE     0x10
+#define DUMPXREFS       0x20
+#define DUMPCFG         0x40
 #define SPECFILE        0x80
 extern word mode; /* what to dump */
 
@@ -74,15 +79,82 @@ extern enum asm_syntax
     MASM,
 } asm_syntax;
 
+/* Instruction set to decode for (--isa). Anything newer is treated as an
+ * invalid opcode, which also ends a scan. */
+extern enum isa
+{
+    ISA_8086,
+    ISA_186,
+    ISA_286,
+    ISA_386,
+    ISA_486,
+    ISA_586,
+    ISA_P6,     /* including MMX */
+    ISA_SSE,
+    ISA_SSE2,
+    ISA_SSE3,
+    ISA_SSSE3,
+    ISA_SSE4,
+    ISA_AVX,
+    ISA_AVX2,   /* including FMA and BMI */
+    ISA_AVX512,
+    ISA_ALL,
+} isa;
+
+/* Output format for --cfg. */
+extern enum cfg_format
+{
+    CFG_DOT,
+    CFG_JSON,
+} cfg_format;
+
 extern const char *const rsrc_types[];
 extern const size_t rsrc_types_count;
 
-extern char **resource_filters;
+/* A resource type or ID, which is either a number or a string. */
+struct rsrc_key {
+    const char *name;   /* NULL if this is a number */
+    dword num;
+};
+
+/* in ne_resource.c */
 extern unsigned resource_filters_count;
+extern void add_resource_filter(const char *filter);
+extern int filter_resource(const struct rsrc_key *type, const struct rsrc_key *id);
+extern void print_rsrc_resource(word type, off_t offset, size_t length, word rn_id);
+extern void print_escaped_bytes(const byte *p, size_t len);
+
+/* Directory to write resources to (--extract-resources), or NULL. */
+extern const char *extract_dir;
+/* in extract.c */
+struct iovec;
+extern void set_extract_input(const char *file);
+extern int extract_file(const char *name, off_t offset, size_t length);
+extern int extract_iov(const char *name, struct iovec *iov, int count);
 
 /* Whether to print addresses relative to the image base for PE files. */
 extern int pe_rel_addr;
 
+/* Formats an address, in the scheme of xref.h, for output; out holds at least
+ * 32 bytes. Each image format has one. */
+typedef void (*addr_func)(char *out, dword addr, const void *ctx);
+
+/* Extra entry points to scan (--entry). These are kept as strings since their
+ * format depends on the kind of image. */
+extern char **entry_points;
+extern unsigned entry_point_count;
+
+/* Linker map and .SYM files to take function names from (--symbols). */
+extern char **symbol_files;
+extern unsigned symbol_file_count;
+
+/* in state.c */
+extern const char *load_state_file;
+extern const char *save_state_file;
+struct xref_table;
+extern void load_state(byte *const *flags, const dword *lengths, unsigned count, struct xref_table *xrefs);
+extern void save_state(byte *const *flags, const dword *lengths, unsigned count, const struct xref_table *xrefs);
+
 /* Entry points */
 void dumpmz(void);
 void dumpne(off_t offset_ne);
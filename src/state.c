@@ -0,0 +1,205 @@
+/*
+ * Saving and restoring scan results
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "semblance.h"
+#include "xref.h"
+
+/* The state file is just the scanner's per-byte flags for each region of
+ * code (NE segment, PE section...), in order:
+ *
+ *  8 bytes     magic, "SEMBSCAN"
+ *  dword       size of the image file
+ *  dword       FNV-1a hash of the image file
+ *  dword       number of regions
+ *  then for each region:
+ *  dword       length
+ *  length      flags
+ *  then:
+ *  dword       number of cross-references
+ *  9 bytes     each: dword from, dword to, byte type
+ *
+ * The size and hash keep flags from an older build of the same program
+ * from being applied to a newer one whose regions happen to be the same
+ * size.
+ *
+ * Loading a state file and then scanning more entry points only walks code
+ * that wasn't already reached, since the scanner stops at any byte already
+ * marked as scanned. That's also why the cross-references are saved: the
+ * scanner won't find them again. */
+
+static const char state_magic[8] = "SEMBSCAN";
+
+const char *load_state_file;
+const char *save_state_file;
+
+static dword image_hash(void) {
+    dword hash = 0x811c9dc5;
+    off_t i;
+
+    for (i = 0; i < map_size; i++)
+        hash = (hash ^ map[i]) * 0x01000193;
+    return hash;
+}
+
+static int read_xref(struct xref *x, FILE *f) {
+    return fread(&x->from, sizeof(x->from), 1, f) == 1
+        && fread(&x->to, sizeof(x->to), 1, f) == 1
+        && fread(&x->type, sizeof(x->type), 1, f) == 1;
+}
+
+/* Merges the saved flags into the given arrays, and the saved references
+ * into xrefs. Nothing is merged unless the whole file matches this image. */
+void load_state(byte *const *flags, const dword *lengths, unsigned count, struct xref_table *xrefs) {
+    char magic[8];
+    dword size, hash, file_count, length, total = 0, xref_count;
+    struct xref *saved_xrefs;
+    byte *buffer, *p;
+    long here;
+    FILE *f;
+    unsigned i, j;
+
+    if (!load_state_file)
+        return;
+
+    if (!(f = fopen(load_state_file, "rb"))) {
+        perror(load_state_file);
+        return;
+    }
+
+    if (fread(magic, sizeof(magic), 1, f) != 1 || memcmp(magic, state_magic, sizeof(magic))
+            || fread(&size, sizeof(size), 1, f) != 1 || fread(&hash, sizeof(hash), 1, f) != 1
+            || fread(&file_count, sizeof(file_count), 1, f) != 1) {
+        fprintf(stderr, "%s is not a state file.\n", load_state_file);
+        fclose(f);
+        return;
+    }
+
+    if (size != (dword)map_size || hash != image_hash()) {
+        fprintf(stderr, "%s was saved from a different image.\n", load_state_file);
+        fclose(f);
+        return;
+    }
+
+    if (file_count != count) {
+        fprintf(stderr, "%s doesn't match this image (%u regions, expected %u).\n",
+                load_state_file, file_count, count);
+        fclose(f);
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+        total += lengths[i];
+    p = buffer = malloc(total ? total : 1);
+
+    /* read everything first, so that a bad region doesn't leave the ones
+     * before it merged */
+    for (i = 0; i < count; i++) {
+        if (fread(&length, sizeof(length), 1, f) != 1 || length != lengths[i]) {
+            fprintf(stderr, "%s doesn't match this image (region %u).\n", load_state_file, i);
+            free(buffer);
+            fclose(f);
+            return;
+        }
+
+        if (fread(p, 1, length, f) != length) {
+            fprintf(stderr, "%s is truncated.\n", load_state_file);
+            free(buffer);
+            fclose(f);
+            return;
+        }
+        p += length;
+    }
+
+    /* each reference takes 9 bytes, so check the count against what's left
+     * of the file before allocating for it */
+    here = ftell(f);
+    if (fread(&xref_count, sizeof(xref_count), 1, f) != 1 || fseek(f, 0, SEEK_END)
+            || (ftell(f) - here - 4) / 9 < xref_count || fseek(f, here + 4, SEEK_SET)) {
+        fprintf(stderr, "%s is truncated.\n", load_state_file);
+        free(buffer);
+        fclose(f);
+        return;
+    }
+
+    saved_xrefs = malloc((xref_count ? xref_count : 1) * sizeof(*saved_xrefs));
+    for (i = 0; i < xref_count; i++) {
+        if (!read_xref(&saved_xrefs[i], f)) {
+            fprintf(stderr, "%s is truncated.\n", load_state_file);
+            free(saved_xrefs);
+            free(buffer);
+            fclose(f);
+            return;
+        }
+    }
+
+    fclose(f);
+
+    for (i = 0, p = buffer; i < count; p += lengths[i++]) {
+        for (j = 0; j < lengths[i]; j++)
+            flags[i][j] |= p[j];
+    }
+
+    for (i = 0; i < xref_count; i++)
+        xref_add(xrefs, saved_xrefs[i].from, saved_xrefs[i].to, saved_xrefs[i].type);
+
+    free(saved_xrefs);
+    free(buffer);
+}
+
+void save_state(byte *const *flags, const dword *lengths, unsigned count, const struct xref_table *xrefs) {
+    dword size = map_size, hash = image_hash(), file_count = count;
+    FILE *f;
+    unsigned i;
+
+    if (!save_state_file)
+        return;
+
+    if (!(f = fopen(save_state_file, "wb"))) {
+        perror(save_state_file);
+        return;
+    }
+
+    fwrite(state_magic, sizeof(state_magic), 1, f);
+    fwrite(&size, sizeof(size), 1, f);
+    fwrite(&hash, sizeof(hash), 1, f);
+    fwrite(&file_count, sizeof(file_count), 1, f);
+    for (i = 0; i < count; i++) {
+        fwrite(&lengths[i], sizeof(dword), 1, f);
+        if (lengths[i])
+            fwrite(flags[i], 1, lengths[i], f);
+    }
+
+    fwrite(&xrefs->count, sizeof(dword), 1, f);
+    for (i = 0; i < xrefs->count; i++) {
+        const struct xref *x = &xrefs->xrefs[i];
+        fwrite(&x->from, sizeof(x->from), 1, f);
+        fwrite(&x->to, sizeof(x->to), 1, f);
+        fwrite(&x->type, sizeof(x->type), 1, f);
+    }
+
+    if (fclose(f))
+        perror(save_state_file);
+}
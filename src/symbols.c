@@ -0,0 +1,269 @@
+/*
+ * Symbol names from linker map and .SYM files
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "semblance.h"
+#include "symbols.h"
+
+/* Symbol files can be large, so everything is appended, then sorted once
+ * after all files are read. */
+
+void symbol_add(struct symbol_table *table, dword addr, const char *name, size_t len, byte flags) {
+    struct symbol *s;
+
+    if (table->count == table->size) {
+        table->size = table->size ? table->size * 2 : 256;
+        table->symbols = realloc(table->symbols, table->size * sizeof(*table->symbols));
+    }
+
+    s = &table->symbols[table->count++];
+    s->addr = addr;
+    s->name = arena_strndup(&table->arena, name, len);
+    s->flags = flags;
+}
+
+/* MS linker map file. We only want the lines in the "Publics by Name",
+ * "Publics by Value" and "Static symbols" sections, which look like
+ *
+ *  0001:00000020       _WinMain@16                00401020 f   main.obj
+ *
+ * where "f" marks a function. (16-bit linkers print 4-digit offsets and no
+ * more columns than the name.) The segment lists before them have the same
+ * prefix, so we can't just match every line. */
+static void load_map(struct symbol_table *table, FILE *f, const char *file,
+        symbol_addr_func get_addr, const void *ctx) {
+    char line[1024], name[256], type[16];
+    unsigned seg, offset;
+    int in_publics = 0;
+    unsigned count = 0;
+    dword addr;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, "Publics by") || strstr(line, "Static symbols")) {
+            in_publics = 1;
+            continue;
+        }
+        if (strstr(line, "Line numbers") || strstr(line, "FIXUPS:") || strstr(line, "Exports")) {
+            in_publics = 0;
+            continue;
+        }
+        if (!in_publics)
+            continue;
+
+        if (sscanf(line, " %x:%x %255s", &seg, &offset, name) != 3)
+            continue;
+        /* "Abs" and "Imp" mark absolute and imported names in 16-bit maps;
+         * 32-bit maps put absolute names in segment 0, which get_addr()
+         * rejects */
+        if (seg > 0xffff || !strcmp(name, "Abs") || !strcmp(name, "Imp"))
+            continue;
+        if (!get_addr(seg, offset, &addr, ctx))
+            continue;
+
+        symbol_add(table, addr, name, strlen(name),
+            (sscanf(line, " %*x:%*x %*s %*x %15s", type) == 1 && !strcmp(type, "f")) ? SYMBOL_FUNC : 0);
+        count++;
+    }
+
+    if (!count)
+        warn("%s: no public symbols found\n", file);
+}
+
+/* MAPSYM .SYM file. The header is a MAPDEF:
+ *
+ *  0a  word    number of segments
+ *  0c  word    paragraph offset of the first SEGDEF
+ *
+ * and each SEGDEF is
+ *
+ *  00  word    paragraph offset of the next SEGDEF
+ *  02  word    number of symbols
+ *  04  word    offset (from the SEGDEF) of an array of word offsets to the
+ *              SYMDEFs
+ *  06  word    segment number (NE) or frame (MZ)
+ *  0e  byte    flags; 1 means symbol values are dwords
+ *
+ * where a SYMDEF is the value followed by a length-prefixed name. */
+static void load_sym(struct symbol_table *table, const byte *data, size_t size, const char *file,
+        symbol_addr_func get_addr, const void *ctx) {
+    size_t segdef;
+    word seg_count, i, j;
+    dword addr;
+
+    if (size < 0x10) {
+        warn("%s: file too short\n", file);
+        return;
+    }
+
+    seg_count = *(word *)(data + 0x0a);
+    segdef = *(word *)(data + 0x0c) * 16;
+
+    for (i = 0; i < seg_count && segdef; i++) {
+        word sym_count, sym_ptr, seg;
+        int big;
+
+        if (segdef + 0x14 > size) {
+            warn("%s: segment %u out of bounds\n", file, i);
+            return;
+        }
+
+        sym_count = *(word *)(data + segdef + 2);
+        sym_ptr = *(word *)(data + segdef + 4);
+        seg = *(word *)(data + segdef + 6);
+        big = data[segdef + 0x0e] & 1;
+
+        for (j = 0; j < sym_count; j++) {
+            size_t index = segdef + sym_ptr + j * 2, symdef, name;
+            dword value;
+            byte len;
+
+            if (index + 2 > size)
+                break;
+            symdef = segdef + *(word *)(data + index);
+            name = symdef + (big ? 4 : 2);
+            if (name + 1 > size)
+                continue;
+            len = data[name];
+            if (name + 1 + len > size)
+                continue;
+
+            value = big ? *(dword *)(data + symdef) : *(word *)(data + symdef);
+            if (get_addr(seg, value, &addr, ctx))
+                symbol_add(table, addr, (const char *)data + name + 1, len, 0);
+        }
+
+        segdef = *(word *)(data + segdef) * 16;
+    }
+}
+
+static int is_sym_file(const char *file) {
+    const char *ext = strrchr(file, '.');
+    return ext && !strcasecmp(ext, ".sym");
+}
+
+static void load_file(struct symbol_table *table, const char *file,
+        symbol_addr_func get_addr, const void *ctx) {
+    FILE *f;
+
+    if (!(f = fopen(file, "rb"))) {
+        perror(file);
+        return;
+    }
+
+    if (is_sym_file(file)) {
+        byte *data;
+        long size;
+
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        data = malloc(size > 0 ? size : 1);
+        if (size > 0 && fread(data, 1, size, f) == (size_t)size)
+            load_sym(table, data, size, file, get_addr, ctx);
+        else
+            warn("%s: couldn't read file\n", file);
+        free(data);
+    } else {
+        load_map(table, f, file, get_addr, ctx);
+    }
+
+    fclose(f);
+}
+
+/* Of several names for one address, sort the one we'd rather print first:
+ * functions, then the fewest leading underscores, so that e.g. "fp" beats
+ * the linker's "__data_start__". */
+static int symbol_cmp(const void *a, const void *b) {
+    const struct symbol *sa = a, *sb = b;
+    size_t ua, ub;
+
+    if (sa->addr != sb->addr)
+        return (sa->addr < sb->addr) ? -1 : 1;
+    if ((sa->flags ^ sb->flags) & SYMBOL_FUNC)
+        return (sa->flags & SYMBOL_FUNC) ? -1 : 1;
+    ua = strspn(sa->name, "_");
+    ub = strspn(sb->name, "_");
+    if (ua != ub)
+        return (ua < ub) ? -1 : 1;
+    return strcmp(sa->name, sb->name);
+}
+
+/* Reads every --symbols file into the table, which may already hold symbols
+ * from the image itself, then sorts by address and drops duplicates (map
+ * files list every public twice). */
+void load_symbols(struct symbol_table *table, symbol_addr_func get_addr, const void *ctx) {
+    unsigned i, j, run;
+
+    for (i = 0; i < symbol_file_count; i++)
+        load_file(table, symbol_files[i], get_addr, ctx);
+
+    if (table->count)
+        qsort(table->symbols, table->count, sizeof(*table->symbols), symbol_cmp);
+
+    /* drop repeated names, which needn't be adjacent if their flags differ */
+    for (i = j = run = 0; i < table->count; i++) {
+        const struct symbol *s = &table->symbols[i];
+        unsigned k;
+
+        if (j && table->symbols[j-1].addr != s->addr)
+            run = j;
+        for (k = run; k < j; k++) {
+            if (!strcmp(table->symbols[k].name, s->name))
+                break;
+        }
+        if (k < j) {
+            table->symbols[k].flags |= s->flags;
+            continue;
+        }
+        table->symbols[j++] = *s;
+    }
+    table->count = j;
+}
+
+/* Returns the name of the symbol at exactly "addr", or NULL. If several
+ * names share an address, the one sorted first wins. */
+const char *symbol_name(const struct symbol_table *table, dword addr) {
+    unsigned lo = 0, hi = table->count;
+
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (table->symbols[mid].addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < table->count && table->symbols[lo].addr == addr)
+        return table->symbols[lo].name;
+    return NULL;
+}
+
+void free_symbols(struct symbol_table *table) {
+    free(table->symbols);
+    table->symbols = NULL;
+    table->count = table->size = 0;
+    arena_free(&table->arena);
+}
@@ -0,0 +1,35 @@
+#ifndef __SYMBOLS_H
+#define __SYMBOLS_H
+
+#include "semblance.h"
+#include "arena.h"
+
+/* Names read from --symbols files. Addresses use the same scheme as
+ * xref.h. */
+
+#define SYMBOL_FUNC     1   /* known to be the start of a function */
+
+struct symbol {
+    dword addr;
+    const char *name;
+    byte flags;
+};
+
+struct symbol_table {
+    struct symbol *symbols;     /* sorted by address */
+    unsigned count;
+    unsigned size;
+    struct arena arena;         /* names */
+};
+
+/* Converts a segment:offset pair as written in a symbol file to an address,
+ * returning 0 if it doesn't point into the image. "seg" is a section number
+ * for PE, a segment number for NE, and a paragraph frame for MZ. */
+typedef int (*symbol_addr_func)(word seg, dword offset, dword *addr, const void *ctx);
+
+extern void symbol_add(struct symbol_table *table, dword addr, const char *name, size_t len, byte flags);
+extern void load_symbols(struct symbol_table *table, symbol_addr_func get_addr, const void *ctx);
+extern const char *symbol_name(const struct symbol_table *table, dword addr);
+extern void free_symbols(struct symbol_table *table);
+
+#endif /* __SYMBOLS_H */
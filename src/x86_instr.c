@@ -20,6 +20,8 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 #include "x86_instr.h"
 
@@ -28,6 +30,59 @@
 #define REGOF(x)    (((x) >> 3) & 7)
 #define MEMOF(x)    ((x) & 7)
 
+/* The tables below stay the one place instructions are described, but
+ * scanning them from the top for every instruction is slow. Each is indexed
+ * by one byte of the encoding: the entries sharing that byte are kept
+ * together, in table order so that the first match still wins, and a lookup
+ * only looks at those. The indexes are built by init_instr_tables() before
+ * anything is decoded, and are read-only afterwards, so decoding from several
+ * threads is safe. */
+enum op_key {
+    KEY_OPCODE,     /* the opcode byte */
+    KEY_SUBCODE,    /* the subcode (instructions_fpu_single: the ModRM byte) */
+    KEY_ESCAPE,     /* the byte after 0F 38 / 0F 3A for three-byte entries, else the opcode */
+};
+
+struct op_table {
+    const struct op *ops;
+    unsigned count;
+    enum op_key key;
+    unsigned short start[257];  /* per key byte, into order */
+    unsigned short *order;      /* NULL until indexed */
+};
+
+#define OP_TABLE(t, key) {t, sizeof(t)/sizeof(struct op), key}
+
+static byte op_key(const struct op_table *table, const struct op *op) {
+    if (table->key == KEY_SUBCODE ||
+        (table->key == KEY_ESCAPE && (op->opcode == 0x38 || op->opcode == 0x3A)))
+        return op->subcode;
+    return op->opcode;
+}
+
+static void index_op_table(struct op_table *table) {
+    unsigned pos[256];
+    unsigned i;
+
+    memset(table->start, 0, sizeof(table->start));
+    for (i = 0; i < table->count; i++)
+        table->start[op_key(table, &table->ops[i]) + 1]++;
+    for (i = 0; i < 256; i++) {
+        table->start[i+1] += table->start[i];
+        pos[i] = table->start[i];
+    }
+
+    table->order = malloc(table->count * sizeof(*table->order));
+    for (i = 0; i < table->count; i++)
+        table->order[pos[op_key(table, &table->ops[i])]++] = i;
+}
+
+/* Returns the entries filed under key as [*first, *end) into table->order. */
+static inline void op_bucket(const struct op_table *table, byte key, unsigned *first, unsigned *end) {
+    *first = table->start[key];
+    *end = table->start[key+1];
+}
+
 static const struct op instructions[256] = {
     {0x00, 8,  8, "add",        RM,     REG,    OP_LOCK},
     {0x01, 8, -1, "add",        RM,     REG,    OP_LOCK},
@@ -60,7 +115,7 @@ static const struct op instructions[256] = {
     {0x1C, 8,  8, "sbb",        AL,     IMM},
     {0x1D, 8, -1, "sbb",        AX,     IMM},
     {0x1E, 8, -1, "push",       DS,     0,      OP_STACK},
-    {0x2F, 8, -1, "pop",        DS,     0,      OP_STACK},
+    {0x1F, 8, -1, "pop",        DS,     0,      OP_STACK},
     {0x20, 8,  8, "and",        RM,     REG,    OP_LOCK},
     {0x21, 8, -1, "and",        RM,     REG,    OP_LOCK},
     {0x22, 8,  8, "and",        REG,    RM},
@@ -183,7 +238,7 @@ static const struct op instructions[256] = {
     {0x97, 8, -1, "xchg",       AX,     DI},
     {0x98, 8, -1, "cbw"},       /* handled separately */
     {0x99, 8, -1, "cwd"},       /* handled separately */
-    {0x9A, 8, -1, "call",       SEGPTR, 0,      OP_FAR},
+    {0x9A, 8, -1, "call",       SEGPTR, 0,      OP_FAR|OP_CALL},
     {0x9B, 8,  0, "wait"},  /* wait ~prefix~ */
     {0x9C, 8, -1, "pushf",      0,      0,      OP_STACK},
     {0x9D, 8, -1, "popf",       0,      0,      OP_STACK},
@@ -257,11 +312,11 @@ static const struct op instructions[256] = {
     {0xE1, 8,  0, "loopz",      REL8,   0,      OP_BRANCH},
     {0xE2, 8,  0, "loop",       REL8,   0,      OP_BRANCH},
     {0xE3, 8, -1, "jcxz",       REL8,   0,      OP_BRANCH},  /* name handled separately */
-    {0xE4, 8,  8, "in",         AL,     IMM},
-    {0xE5, 8, -1, "in",         AX,     IMM},
-    {0xE6, 8,  8, "out",        IMM,    AL},
-    {0xE7, 8, -1, "out",        IMM,    AX},
-    {0xE8, 8, -1, "call",       REL,    0,      OP_BRANCH},
+    {0xE4, 8,  8, "in",         AL,     IMM8},
+    {0xE5, 8, -1, "in",         AX,     IMM8},
+    {0xE6, 8,  8, "out",        IMM8,   AL},
+    {0xE7, 8, -1, "out",        IMM8,   AX},
+    {0xE8, 8, -1, "call",       REL,    0,      OP_BRANCH|OP_CALL},
     {0xE9, 8, -1, "jmp",        REL,    0,      OP_BRANCH|OP_STOP},
     {0xEA, 8, -1, "jmp",        SEGPTR, 0,      OP_FAR|OP_STOP},    /* a change in bitness should only happen across segment boundaries */
     {0xEB, 8,  0, "jmp",        REL8,   0,      OP_BRANCH|OP_STOP},
@@ -516,11 +571,11 @@ static const struct op instructions64[256] = {
     {0xE1, 8,  0, "loopz",      REL8,   0,      OP_BRANCH},
     {0xE2, 8,  0, "loop",       REL8,   0,      OP_BRANCH},
     {0xE3, 8, -1, "jcxz",       REL8,   0,      OP_BRANCH},  /* name handled separately */
-    {0xE4, 8,  8, "in",         AL,     IMM},
-    {0xE5, 8, -1, "in",         AX,     IMM},
-    {0xE6, 8,  8, "out",        IMM,    AL},
-    {0xE7, 8, -1, "out",        IMM,    AX},
-    {0xE8, 8, -1, "call",       REL,    0,      OP_BRANCH},
+    {0xE4, 8,  8, "in",         AL,     IMM8},
+    {0xE5, 8, -1, "in",         AX,     IMM8},
+    {0xE6, 8,  8, "out",        IMM8,   AL},
+    {0xE7, 8, -1, "out",        IMM8,   AX},
+    {0xE8, 8, -1, "call",       REL,    0,      OP_BRANCH|OP_CALL},
     {0xE9, 8, -1, "jmp",        REL,    0,      OP_BRANCH|OP_STOP},
     {0xEA, 8},  /* undefined (was jmp/SEGPTR) */
     {0xEB, 8,  0, "jmp",        REL8,   0,      OP_BRANCH|OP_STOP},
@@ -656,8 +711,8 @@ static const struct op instructions_group[] = {
     {0xFE, 1,  8, "dec",        RM,     0,      OP_LOCK},
     {0xFF, 0, -1, "inc",        RM,     0,      OP_LOCK},
     {0xFF, 1, -1, "dec",        RM,     0,      OP_LOCK},
-    {0xFF, 2, -1, "call",       RM,     0,      OP_64},
-    {0xFF, 3, -1, "call",       MEM,    0,      OP_64|OP_FAR},          /* a change in bitness should only happen across segment boundaries */
+    {0xFF, 2, -1, "call",       RM,     0,      OP_64|OP_CALL},
+    {0xFF, 3, -1, "call",       MEM,    0,      OP_64|OP_FAR|OP_CALL},          /* a change in bitness should only happen across segment boundaries */
     {0xFF, 4, -1, "jmp",        RM,     0,      OP_64|OP_STOP},
     {0xFF, 5, -1, "jmp",        MEM,    0,      OP_64|OP_STOP|OP_FAR},  /* a change in bitness should only happen across segment boundaries */
     {0xFF, 6, -1, "push",       RM,     0,      OP_STACK},
@@ -693,10 +748,10 @@ static const struct op instructions_0F[] = {
 
     {0x0d, 8, -1, "prefetch",   RM},    /* Intel has NOP here; we're just following GCC */
 
-    {0x18, 0,  8, "prefetchnta",MEM},
-    {0x18, 1,  8, "prefetcht0", MEM},
-    {0x18, 2,  8, "prefetcht1", MEM},
-    {0x18, 3,  8, "prefetcht2", MEM},
+    {0x18, 0,  0, "prefetchnta",MEM},
+    {0x18, 1,  0, "prefetcht0", MEM},
+    {0x18, 2,  0, "prefetcht1", MEM},
+    {0x18, 3,  0, "prefetcht2", MEM},
 
     {0x1f, 8, -1, "nop",        RM},
 
@@ -992,25 +1047,27 @@ static const struct op instructions_fpu_single[] = {
     {0xDF, 0xE0, 0, "fnstsw", AX},
 };
 
-static int get_fpu_instr(const byte *p, struct op *op) {
+static struct op_table table_fpu_single = OP_TABLE(instructions_fpu_single, KEY_SUBCODE);
+
+static int get_fpu_instr(const byte *p, const struct op **op) {
     byte subcode = REGOF(p[1]);
     byte index = (p[0] & 7)*8 + subcode;
-    unsigned i;
 
     if (MODOF(p[1]) < 3) {
         if (instructions_fpu_m[index].name[0])
-            *op = instructions_fpu_m[index];
+            *op = &instructions_fpu_m[index];
         return 0;
     } else {
         if (instructions_fpu_r[index].name[0]) {
-            *op = instructions_fpu_r[index];
+            *op = &instructions_fpu_r[index];
             return 0;
         } else {
             /* try the single op list */
-            for (i=0; i<sizeof(instructions_fpu_single)/sizeof(struct op); i++) {
-                if (p[0] == instructions_fpu_single[i].opcode &&
-                    p[1] == instructions_fpu_single[i].subcode) {
-                    *op = instructions_fpu_single[i];
+            unsigned i, end;
+
+            for (op_bucket(&table_fpu_single, p[1], &i, &end); i < end; i++) {
+                if (instructions_fpu_single[table_fpu_single.order[i]].opcode == p[0]) {
+                    *op = &instructions_fpu_single[table_fpu_single.order[i]];
                     break;
                 }
             }
@@ -1020,36 +1077,36 @@ static int get_fpu_instr(const byte *p, struct op *op) {
 }
 
 static const struct op instructions_sse[] = {
-    {0x10, 8,  0, "movups",     XMM,    XM},
+    {0x10, 8,  0, "movups",     XMM,    XM,     OP_NOVVVV},
     {0x11, 8,  0, "movups",     XM,     XMM},
-    {0x12, 8,  0, "movlps",     XMM,    XM},    /* fixme: movhlps */
-    {0x13, 8,  0, "movlps",     MEM,    XMM},
+    {0x12, 8,  0, "movlps",     XMM,    XM,     OP_SCALAR},    /* fixme: movhlps */
+    {0x13, 8,  0, "movlps",     MEM,    XMM,    OP_SCALAR},
     {0x14, 8,  0, "unpcklps",   XMM,    XM},
     {0x15, 8,  0, "unpckhps",   XMM,    XM},
-    {0x16, 8,  0, "movhps",     XMM,    XM},    /* fixme: movlhps */
-    {0x17, 8,  0, "movhps",     MEM,    XMM},
+    {0x16, 8,  0, "movhps",     XMM,    XM,     OP_SCALAR},    /* fixme: movlhps */
+    {0x17, 8,  0, "movhps",     MEM,    XMM,    OP_SCALAR},
 
-    {0x28, 8,  0, "movaps",     XMM,    XM},
+    {0x28, 8,  0, "movaps",     XMM,    XM,     OP_NOVVVV},
     {0x29, 8,  0, "movaps",     XM,     XMM},
     {0x2A, 8,  0, "cvtpi2ps",   XMM,    MM},
     {0x2B, 8,  0, "movntps",    MEM,    XMM},
     {0x2C, 8,  0, "cvttps2pi",  MMX,    XM},
     {0x2D, 8,  0, "cvtps2pi",   MMX,    XM},
-    {0x2E, 8,  0, "ucomiss",    XMM,    XM},
-    {0x2F, 8,  0, "comiss",     XMM,    XM},
+    {0x2E, 8,  0, "ucomiss",    XMM,    XM,     OP_NOVVVV|OP_SCALAR},
+    {0x2F, 8,  0, "comiss",     XMM,    XM,     OP_NOVVVV|OP_SCALAR},
 
-    {0x50, 8,  0, "movmskps",   REGONLY,XMM},
-    {0x51, 8,  0, "sqrtps",     XMM,    XM},
-    {0x52, 8,  0, "rsqrtps",    XMM,    XM},
-    {0x53, 8,  0, "rcpps",      XMM,    XM},
+    {0x50, 8, 32, "movmskps",   REG,    XMMONLY},
+    {0x51, 8,  0, "sqrtps",     XMM,    XM,     OP_NOVVVV},
+    {0x52, 8,  0, "rsqrtps",    XMM,    XM,     OP_NOVVVV},
+    {0x53, 8,  0, "rcpps",      XMM,    XM,     OP_NOVVVV},
     {0x54, 8,  0, "andps",      XMM,    XM},
     {0x55, 8,  0, "andnps",     XMM,    XM},
     {0x56, 8,  0, "orps",       XMM,    XM},
     {0x57, 8,  0, "xorps",      XMM,    XM},
     {0x58, 8,  0, "addps",      XMM,    XM},
     {0x59, 8,  0, "mulps",      XMM,    XM},
-    {0x5A, 8,  0, "cvtps2pd",   XMM,    XM},
-    {0x5B, 8,  0, "cvtdq2ps",   XMM,    XM},
+    {0x5A, 8,  0, "cvtps2pd",   XMM,    XMH,    OP_NOVVVV},
+    {0x5B, 8,  0, "cvtdq2ps",   XMM,    XM,     OP_NOVVVV},
     {0x5C, 8,  0, "subps",      XMM,    XM},
     {0x5D, 8,  0, "minps",      XMM,    XM},
     {0x5E, 8,  0, "divps",      XMM,    XM},
@@ -1087,9 +1144,9 @@ static const struct op instructions_sse[] = {
     {0x7F, 8,  0, "movq",       MM,     MMX},
 
     {0xC2, 8,  0, "cmpps",      XMM,    XM,     OP_ARG2_IMM8},
-    {0xC3, 8,  0, "movnti",     MEM,    REG},
-    {0xC4, 8,  0, "pinsrw",     MMX,    RM,     OP_ARG2_IMM8},
-    {0xC5, 8,  0, "pextrw",     REGONLY,MMX,    OP_ARG2_IMM8},
+    {0xC3, 8, -1, "movnti",     MEM,    REG},
+    {0xC4, 8, 32, "pinsrw",     MMX,    RM,     OP_ARG2_IMM8},
+    {0xC5, 8, 32, "pextrw",     REG,    MMXONLY,OP_ARG2_IMM8},
     {0xC6, 8,  0, "shufps",     XMM,    XM,     OP_ARG2_IMM8},
 
     {0xD1, 8,  0, "psrlw",      MMX,    MM},
@@ -1098,7 +1155,7 @@ static const struct op instructions_sse[] = {
     {0xD4, 8,  0, "paddq",      MMX,    MM},
     {0xD5, 8,  0, "pmullw",     MMX,    MM},
     /* D6 unused */
-    {0xD7, 8,  0, "pmovmskb",   REGONLY,MMX},
+    {0xD7, 8, 32, "pmovmskb",   REG,    MMXONLY},
     {0xD8, 8,  0, "psubusb",    MMX,    MM},
     {0xD9, 8,  0, "psubusw",    MMX,    MM},
     {0xDA, 8,  0, "pminub",     MMX,    MM},
@@ -1141,26 +1198,26 @@ static const struct op instructions_sse[] = {
 };
 
 static const struct op instructions_sse_op32[] = {
-    {0x10, 8,  0, "movupd",     XMM,    XM},
+    {0x10, 8,  0, "movupd",     XMM,    XM,     OP_NOVVVV},
     {0x11, 8,  0, "movupd",     XM,     XMM},
-    {0x12, 8,  0, "movlpd",     XMM,    XM},    /* fixme: movhlps */
-    {0x13, 8,  0, "movlpd",     MEM,    XMM},
+    {0x12, 8,  0, "movlpd",     XMM,    XM,     OP_SCALAR},    /* fixme: movhlps */
+    {0x13, 8,  0, "movlpd",     MEM,    XMM,    OP_SCALAR},
     {0x14, 8,  0, "unpcklpd",   XMM,    XM},
     {0x15, 8,  0, "unpckhpd",   XMM,    XM},
-    {0x16, 8,  0, "movhpd",     XMM,    XM},    /* fixme: movlhps */
-    {0x17, 8,  0, "movhpd",     MEM,    XMM},
+    {0x16, 8,  0, "movhpd",     XMM,    XM,     OP_SCALAR},    /* fixme: movlhps */
+    {0x17, 8,  0, "movhpd",     MEM,    XMM,    OP_SCALAR},
 
-    {0x28, 8,  0, "movapd",     XMM,    XM},
+    {0x28, 8,  0, "movapd",     XMM,    XM,     OP_NOVVVV},
     {0x29, 8,  0, "movapd",     XM,     XMM},
     {0x2A, 8,  0, "cvtpi2pd",   XMM,    MM},
     {0x2B, 8,  0, "movntpd",    MEM,    XMM},
     {0x2C, 8,  0, "cvttpd2pi",  MMX,    XM},
     {0x2D, 8,  0, "cvtpd2pi",   MMX,    XM},
-    {0x2E, 8,  0, "ucomisd",    XMM,    XM},
-    {0x2F, 8,  0, "comisd",     XMM,    XM},
+    {0x2E, 8,  0, "ucomisd",    XMM,    XM,     OP_NOVVVV|OP_SCALAR},
+    {0x2F, 8,  0, "comisd",     XMM,    XM,     OP_NOVVVV|OP_SCALAR},
 
-    {0x50, 8, 32, "movmskpd",   REGONLY,XMM},
-    {0x51, 8,  0, "sqrtpd",     XMM,    XM},
+    {0x50, 8, 32, "movmskpd",   REG,    XMMONLY},
+    {0x51, 8,  0, "sqrtpd",     XMM,    XM,     OP_NOVVVV},
     /* 52/3 unused */
     {0x54, 8,  0, "andpd",      XMM,    XM},
     {0x55, 8,  0, "andnpd",     XMM,    XM},
@@ -1168,8 +1225,8 @@ static const struct op instructions_sse_op32[] = {
     {0x57, 8,  0, "xorpd",      XMM,    XM},
     {0x58, 8,  0, "addpd",      XMM,    XM},
     {0x59, 8,  0, "mulpd",      XMM,    XM},
-    {0x5A, 8,  0, "cvtpd2ps",   XMM,    XM},
-    {0x5B, 8,  0, "cvtps2dq",   XMM,    XM},
+    {0x5A, 8,  0, "cvtpd2ps",   XMMH,   XM,     OP_NOVVVV},
+    {0x5B, 8,  0, "cvtps2dq",   XMM,    XM,     OP_NOVVVV},
     {0x5C, 8,  0, "subpd",      XMM,    XM},
     {0x5D, 8,  0, "minpd",      XMM,    XM},
     {0x5E, 8,  0, "divpd",      XMM,    XM},
@@ -1188,9 +1245,9 @@ static const struct op instructions_sse_op32[] = {
     {0x6B, 8,  0, "packssdw",   XMM,    XM},
     {0x6C, 8,  0, "punpcklqdq", XMM,    XM},
     {0x6D, 8,  0, "punpckhqdq", XMM,    XM},
-    {0x6E, 8, -1, "mov",        XMM,    RM},
-    {0x6F, 8,  0, "movdqa",     XMM,    XM},
-    {0x70, 8,  0, "pshufd",     XMM,    XM,    OP_ARG2_IMM8},
+    {0x6E, 8, -1, "mov",        XMM,    RM,     OP_NOVVVV|OP_SCALAR},
+    {0x6F, 8,  0, "movdqa",     XMM,    XM,     OP_NOVVVV},
+    {0x70, 8,  0, "pshufd",     XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
     {0x71, 2,  0, "psrlw",      XMMONLY,IMM8},
     {0x71, 4,  0, "psraw",      XMMONLY,IMM8},
     {0x71, 6,  0, "psllw",      XMMONLY,IMM8},
@@ -1207,23 +1264,23 @@ static const struct op instructions_sse_op32[] = {
 
     {0x7C, 8,  0, "haddpd",     XMM,    XM},
     {0x7D, 8,  0, "hsubpd",     XMM,    XM},
-    {0x7E, 8, -1, "mov",        RM,     XMM},
+    {0x7E, 8, -1, "mov",        RM,     XMM,    OP_SCALAR},
     {0x7F, 8,  0, "movdqa",     XM,     XMM},
 
     {0xC2, 8,  0, "cmppd",      XMM,    XM,     OP_ARG2_IMM8},
     /* C3 unused */
-    {0xC4, 8,  0, "pinsrw",     XMM,    RM,     OP_ARG2_IMM8},
-    {0xC5, 8,  0, "pextrw",     REGONLY,XMM,    OP_ARG2_IMM8},
+    {0xC4, 8, 32, "pinsrw",     XMM,    RM,     OP_ARG2_IMM8|OP_SCALAR},
+    {0xC5, 8, 32, "pextrw",     REG,    XMMONLY,OP_ARG2_IMM8},
     {0xC6, 8,  0, "shufpd",     XMM,    XM,     OP_ARG2_IMM8},
 
     {0xD0, 8,  0, "addsubpd",   XMM,    XM},
-    {0xD1, 8,  0, "psrlw",      XMM,    XM},
-    {0xD2, 8,  0, "psrld",      XMM,    XM},
-    {0xD3, 8,  0, "psrlq",      XMM,    XM},
-    {0xD4, 8,  0, "paddd",      XMM,    XM},
+    {0xD1, 8,  0, "psrlw",      XMM,    XM128},
+    {0xD2, 8,  0, "psrld",      XMM,    XM128},
+    {0xD3, 8,  0, "psrlq",      XMM,    XM128},
+    {0xD4, 8,  0, "paddq",      XMM,    XM},
     {0xD5, 8,  0, "pmullw",     XMM,    XM},
-    {0xD6, 8,  0, "movq",       XM,     XMM},
-    {0xD7, 8, 32, "pmovmskb",   REGONLY,XMM},
+    {0xD6, 8,  0, "movq",       XM,     XMM,    OP_SCALAR},
+    {0xD7, 8, 32, "pmovmskb",   REG,    XMMONLY},
     {0xD8, 8,  0, "psubusb",    XMM,    XM},
     {0xD9, 8,  0, "psubusw",    XMM,    XM},
     {0xDA, 8,  0, "pminub",     XMM,    XM},
@@ -1233,12 +1290,12 @@ static const struct op instructions_sse_op32[] = {
     {0xDE, 8,  0, "pmaxub",     XMM,    XM},
     {0xDF, 8,  0, "pandn",      XMM,    XM},
     {0xE0, 8,  0, "pavgb",      XMM,    XM},
-    {0xE1, 8,  0, "psraw",      XMM,    XM},
-    {0xE2, 8,  0, "psrad",      XMM,    XM},
+    {0xE1, 8,  0, "psraw",      XMM,    XM128},
+    {0xE2, 8,  0, "psrad",      XMM,    XM128},
     {0xE3, 8,  0, "pavgw",      XMM,    XM},
     {0xE4, 8,  0, "pmulhuw",    XMM,    XM},
     {0xE5, 8,  0, "pmulhw",     XMM,    XM},
-    {0xE6, 8,  0, "cvttpd2dq",  XMM,    XM},
+    {0xE6, 8,  0, "cvttpd2dq",  XMMH,   XM,     OP_NOVVVV},
     {0xE7, 8,  0, "movntdq",    MEM,    XMM},
     {0xE8, 8,  0, "psubsb",     XMM,    XM},
     {0xE9, 8,  0, "psubsw",     XMM,    XM},
@@ -1249,13 +1306,13 @@ static const struct op instructions_sse_op32[] = {
     {0xEE, 8,  0, "pmaxsw",     XMM,    XM},
     {0xEF, 8,  0, "pxor",       XMM,    XM},
     /* F0 unused */
-    {0xF1, 8,  0, "psllw",      XMM,    XM},
-    {0xF2, 8,  0, "pslld",      XMM,    XM},
-    {0xF3, 8,  0, "psllq",      XMM,    XM},
+    {0xF1, 8,  0, "psllw",      XMM,    XM128},
+    {0xF2, 8,  0, "pslld",      XMM,    XM128},
+    {0xF3, 8,  0, "psllq",      XMM,    XM128},
     {0xF4, 8,  0, "pmuludq",    XMM,    XM},
     {0xF5, 8,  0, "pmaddwd",    XMM,    XM},
     {0xF6, 8,  0, "psadbw",     XMM,    XM},
-    {0xF7, 8,  0, "maskmovdqu", XMM,    XMMONLY},
+    {0xF7, 8,  0, "maskmovdqu", XMM,    XMMONLY,OP_NOVVVV},
     {0xF8, 8,  0, "psubb",      XMM,    XM},
     {0xF9, 8,  0, "psubw",      XMM,    XM},
     {0xFA, 8,  0, "psubd",      XMM,    XM},
@@ -1266,80 +1323,80 @@ static const struct op instructions_sse_op32[] = {
 };
 
 static const struct op instructions_sse_repne[] = {
-    {0x10, 8,  0, "movsd",      XMM,    XM},
-    {0x11, 8,  0, "movsd",      XM,     XMM},
-    {0x12, 8,  0, "movddup",    XMM,    XM},
+    {0x10, 8,  0, "movsd",      XMM,    XM,     OP_VVVV_REG|OP_SCALAR},
+    {0x11, 8,  0, "movsd",      XM,     XMM,    OP_VVVV_REG|OP_SCALAR},
+    {0x12, 8,  0, "movddup",    XMM,    XM,     OP_NOVVVV},
 
-    {0x2A, 8,  0, "cvtsi2sd",   XMM,    RM},
+    {0x2A, 8, -1, "cvtsi2sd",   XMM,    RM,     OP_SCALAR},
 
-    {0x2C, 8,  0, "cvttsd2si",  REG,    XM},
-    {0x2D, 8,  0, "cvtsd2si",   REG,    XM},
+    {0x2C, 8, -1, "cvttsd2si",  REG,    XM,     OP_SCALAR},
+    {0x2D, 8, -1, "cvtsd2si",   REG,    XM,     OP_SCALAR},
 
-    {0x51, 8,  0, "sqrtsd",     XMM,    XM},
+    {0x51, 8,  0, "sqrtsd",     XMM,    XM,     OP_SCALAR},
 
-    {0x58, 8,  0, "addsd",      XMM,    XM},
-    {0x59, 8,  0, "mulsd",      XMM,    XM},
-    {0x5A, 8,  0, "cvtsd2ss",   XMM,    XM},
+    {0x58, 8,  0, "addsd",      XMM,    XM,     OP_SCALAR},
+    {0x59, 8,  0, "mulsd",      XMM,    XM,     OP_SCALAR},
+    {0x5A, 8,  0, "cvtsd2ss",   XMM,    XM,     OP_SCALAR},
 
-    {0x5C, 8,  0, "subsd",      XMM,    XM},
-    {0x5D, 8,  0, "minsd",      XMM,    XM},
-    {0x5E, 8,  0, "divsd",      XMM,    XM},
-    {0x5F, 8,  0, "maxsd",      XMM,    XM},
+    {0x5C, 8,  0, "subsd",      XMM,    XM,     OP_SCALAR},
+    {0x5D, 8,  0, "minsd",      XMM,    XM,     OP_SCALAR},
+    {0x5E, 8,  0, "divsd",      XMM,    XM,     OP_SCALAR},
+    {0x5F, 8,  0, "maxsd",      XMM,    XM,     OP_SCALAR},
 
-    {0x70, 8,  0, "pshuflw",    XMM,    XM,     OP_ARG2_IMM8},
+    {0x70, 8,  0, "pshuflw",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
 
     {0x7C, 8,  0, "haddps",     XMM,    XM},
     {0x7D, 8,  0, "hsubps",     XMM,    XM},
 
-    {0xC2, 8,  0, "cmpsd",      XMM,    XM,     OP_ARG2_IMM8},
+    {0xC2, 8,  0, "cmpsd",      XMM,    XM,     OP_ARG2_IMM8|OP_SCALAR},
 
     {0xD0, 8,  0, "addsubps",   XMM,    XM},
 
 /*    {0xD6, 8,  0, "movdq2q",    MMX,    XMM}, */
 
-    {0xE6, 8,  0, "cvtpd2dq",   XMM,    XM},
+    {0xE6, 8,  0, "cvtpd2dq",   XMMH,   XM,     OP_NOVVVV},
 
-    {0xF0, 8,  0, "lddqu",      XMM,    MEM},
+    {0xF0, 8,  0, "lddqu",      XMM,    MEM,    OP_NOVVVV},
 };
 
 static const struct op instructions_sse_repe[] = {
-    {0x10, 8,  0, "movss",      XMM,    XM},
-    {0x11, 8,  0, "movss",      XM,     XMM},
-    {0x12, 8,  0, "movsldup",   XMM,    XM},
+    {0x10, 8,  0, "movss",      XMM,    XM,     OP_VVVV_REG|OP_SCALAR},
+    {0x11, 8,  0, "movss",      XM,     XMM,    OP_VVVV_REG|OP_SCALAR},
+    {0x12, 8,  0, "movsldup",   XMM,    XM,     OP_NOVVVV},
 
-    {0x16, 8,  0, "movshdup",   XMM,    XM},
+    {0x16, 8,  0, "movshdup",   XMM,    XM,     OP_NOVVVV},
 
-    {0x2A, 8,  0, "cvtsi2ss",   XMM,    RM},
+    {0x2A, 8, -1, "cvtsi2ss",   XMM,    RM,     OP_SCALAR},
 
-    {0x2C, 8,  0, "cvttss2si",  REG,    XM},
-    {0x2D, 8,  0, "cvtss2si",   REG,    XM},
+    {0x2C, 8, -1, "cvttss2si",  REG,    XM,     OP_SCALAR},
+    {0x2D, 8, -1, "cvtss2si",   REG,    XM,     OP_SCALAR},
 
-    {0x51, 8,  0, "sqrtss",     XMM,    XM},
-    {0x52, 8,  0, "rsqrtss",    XMM,    XM},
-    {0x53, 8,  0, "rcpss",      XMM,    XM},
+    {0x51, 8,  0, "sqrtss",     XMM,    XM,     OP_SCALAR},
+    {0x52, 8,  0, "rsqrtss",    XMM,    XM,     OP_SCALAR},
+    {0x53, 8,  0, "rcpss",      XMM,    XM,     OP_SCALAR},
 
-    {0x58, 8,  0, "addss",      XMM,    XM},
-    {0x59, 8,  0, "mulss",      XMM,    XM},
-    {0x5A, 8,  0, "cvtss2sd",   XMM,    XM},
-    {0x5B, 8,  0, "cvttps2dq",  XMM,    XM},
-    {0x5C, 8,  0, "subss",      XMM,    XM},
-    {0x5D, 8,  0, "minss",      XMM,    XM},
-    {0x5E, 8,  0, "divss",      XMM,    XM},
-    {0x5F, 8,  0, "maxss",      XMM,    XM},
+    {0x58, 8,  0, "addss",      XMM,    XM,     OP_SCALAR},
+    {0x59, 8,  0, "mulss",      XMM,    XM,     OP_SCALAR},
+    {0x5A, 8,  0, "cvtss2sd",   XMM,    XM,     OP_SCALAR},
+    {0x5B, 8,  0, "cvttps2dq",  XMM,    XM,     OP_NOVVVV},
+    {0x5C, 8,  0, "subss",      XMM,    XM,     OP_SCALAR},
+    {0x5D, 8,  0, "minss",      XMM,    XM,     OP_SCALAR},
+    {0x5E, 8,  0, "divss",      XMM,    XM,     OP_SCALAR},
+    {0x5F, 8,  0, "maxss",      XMM,    XM,     OP_SCALAR},
 
-    {0x6F, 8,  0, "movdqu",     XMM,    XM},
-    {0x70, 8,  0, "pshufhw",    XMM,    XM,     OP_ARG2_IMM8},
+    {0x6F, 8,  0, "movdqu",     XMM,    XM,     OP_NOVVVV},
+    {0x70, 8,  0, "pshufhw",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
 
-    {0x7E, 8,  0, "movq",       XMM,    XM},
+    {0x7E, 8,  0, "movq",       XMM,    XM,     OP_NOVVVV|OP_SCALAR},
     {0x7F, 8,  0, "movdqu",     XM,     XMM},
 
     {0xB8, 8, 16, "popcnt",     REG,    RM},    /* not SSE */
 
-    {0xC2, 8,  0, "cmpss",      XMM,    XM,     OP_ARG2_IMM8},
+    {0xC2, 8,  0, "cmpss",      XMM,    XM,     OP_ARG2_IMM8|OP_SCALAR},
 
 /*    {0xD6, 8,  0, "movq2dq",    XMM,    MMX}, */
 
-    {0xE6, 8,  0, "cvtdq2pd",   XMM,    XM},
+    {0xE6, 8,  0, "cvtdq2pd",   XMM,    XMH,    OP_NOVVVV},
 };
 
 static const struct op instructions_sse_single[] = {
@@ -1385,30 +1442,30 @@ static const struct op instructions_sse_single_op32[] = {
     {0x38, 0x14, 0, "blendvps",     XMM,    XM},
     {0x38, 0x15, 0, "blendvpd",     XMM,    XM},
 
-    {0x38, 0x17, 0, "ptest",        XMM,    XM},
+    {0x38, 0x17, 0, "ptest",        XMM,    XM,     OP_NOVVVV},
 
-    {0x38, 0x1C, 0, "pabsb",        XMM,    XM},
-    {0x38, 0x1D, 0, "pabsw",        XMM,    XM},
-    {0x38, 0x1E, 0, "pabsd",        XMM,    XM},
+    {0x38, 0x1C, 0, "pabsb",        XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x1D, 0, "pabsw",        XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x1E, 0, "pabsd",        XMM,    XM,     OP_NOVVVV},
 
-    {0x38, 0x20, 0, "pmovsxbw",     XMM,    XM},
-    {0x38, 0x21, 0, "pmovsxbd",     XMM,    XM},
-    {0x38, 0x22, 0, "pmovsxbq",     XMM,    XM},
-    {0x38, 0x23, 0, "pmovsxwd",     XMM,    XM},
-    {0x38, 0x24, 0, "pmovsxwq",     XMM,    XM},
-    {0x38, 0x25, 0, "pmovsxdq",     XMM,    XM},
+    {0x38, 0x20, 0, "pmovsxbw",     XMM,    XMH,    OP_NOVVVV},
+    {0x38, 0x21, 0, "pmovsxbd",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x22, 0, "pmovsxbq",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x23, 0, "pmovsxwd",     XMM,    XMH,    OP_NOVVVV},
+    {0x38, 0x24, 0, "pmovsxwq",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x25, 0, "pmovsxdq",     XMM,    XMH,    OP_NOVVVV},
 
     {0x38, 0x28, 0, "pmuldq",       XMM,    XM},
     {0x38, 0x29, 0, "pcmpeqq",      XMM,    XM},
-    {0x38, 0x2A, 0, "movntdqa",     XMM,    MEM},
+    {0x38, 0x2A, 0, "movntdqa",     XMM,    MEM,    OP_NOVVVV},
     {0x38, 0x2B, 0, "packusdw",     XMM,    XM},
 
-    {0x38, 0x30, 0, "pmovzxbw",     XMM,    XM},
-    {0x38, 0x31, 0, "pmovzxbd",     XMM,    XM},
-    {0x38, 0x32, 0, "pmovzxbq",     XMM,    XM},
-    {0x38, 0x33, 0, "pmovzxwd",     XMM,    XM},
-    {0x38, 0x34, 0, "pmovzxwq",     XMM,    XM},
-    {0x38, 0x35, 0, "pmovzxdq",     XMM,    XM},
+    {0x38, 0x30, 0, "pmovzxbw",     XMM,    XMH,    OP_NOVVVV},
+    {0x38, 0x31, 0, "pmovzxbd",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x32, 0, "pmovzxbq",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x33, 0, "pmovzxwd",     XMM,    XMH,    OP_NOVVVV},
+    {0x38, 0x34, 0, "pmovzxwq",     XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x35, 0, "pmovzxdq",     XMM,    XMH,    OP_NOVVVV},
 
     {0x38, 0x37, 0, "pcmpgtq",      XMM,    XM},
     {0x38, 0x38, 0, "pminsb",       XMM,    XM},
@@ -1419,88 +1476,427 @@ static const struct op instructions_sse_single_op32[] = {
     {0x38, 0x3D, 0, "pmaxsd",       XMM,    XM},
     {0x38, 0x3E, 0, "pmaxuw",       XMM,    XM},
     {0x38, 0x3F, 0, "pmaxud",       XMM,    XM},
-    {0x38, 0x40, 0, "pmaxlld",      XMM,    XM},
-    {0x38, 0x41, 0, "phminposuw",   XMM,    XM},
-
-    {0x3A, 0x08, 0, "roundps",      XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x09, 0, "roundpd",      XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x0A, 0, "roundss",      XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x0B, 0, "roundsd",      XMM,    XM,     OP_ARG2_IMM8},
+    {0x38, 0x40, 0, "pmulld",       XMM,    XM},
+    {0x38, 0x41, 0, "phminposuw",   XMM,    XM,     OP_NOVVVV},
+
+    {0x38, 0xDB, 0, "aesimc",       XMM,    XM,     OP_NOVVVV},
+    {0x38, 0xDC, 0, "aesenc",       XMM,    XM},
+    {0x38, 0xDD, 0, "aesenclast",   XMM,    XM},
+    {0x38, 0xDE, 0, "aesdec",       XMM,    XM},
+    {0x38, 0xDF, 0, "aesdeclast",   XMM,    XM},
+
+    {0x3A, 0x08, 0, "roundps",      XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x09, 0, "roundpd",      XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x0A, 0, "roundss",      XMM,    XM,     OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x0B, 0, "roundsd",      XMM,    XM,     OP_ARG2_IMM8|OP_SCALAR},
     {0x3A, 0x0C, 0, "blendps",      XMM,    XM,     OP_ARG2_IMM8},
     {0x3A, 0x0D, 0, "blendpd",      XMM,    XM,     OP_ARG2_IMM8},
     {0x3A, 0x0E, 0, "pblendw",      XMM,    XM,     OP_ARG2_IMM8},
     {0x3A, 0x0F, 0, "palignr",      XMM,    XM,     OP_ARG2_IMM8},
 
-    {0x3A, 0x14, 0, "pextrb",       RM,     XMM,    OP_ARG2_IMM8},
-    {0x3A, 0x15, 0, "pextrw",       RM,     XMM,    OP_ARG2_IMM8},
-    {0x3A, 0x16, 0, "pextrd",       RM,     XMM,    OP_ARG2_IMM8},
-    {0x3A, 0x17, 0, "extractps",    RM,     XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x14,32, "pextrb",       RM,     XMM,    OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x15,32, "pextrw",       RM,     XMM,    OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x16,-1, "pextrd",       RM,     XMM,    OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x17,32, "extractps",    RM,     XMM,    OP_ARG2_IMM8|OP_SCALAR},
 
-    {0x3A, 0x20, 0, "pinsrb",       XMM,    RM,     OP_ARG2_IMM8},
-    {0x3A, 0x21, 0, "insertps",     XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x22, 0, "pinsrd",       XMM,    RM,     OP_ARG2_IMM8},
+    {0x3A, 0x20,32, "pinsrb",       XMM,    RM,     OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x21, 0, "insertps",     XMM,    XM,     OP_ARG2_IMM8|OP_SCALAR},
+    {0x3A, 0x22,-1, "pinsrd",       XMM,    RM,     OP_ARG2_IMM8|OP_SCALAR},
 
-    {0x3A, 0x40, 0, "dpps",         XMM,    XM},
-    {0x3A, 0x41, 0, "dppd",         XMM,    XM},
-    {0x3A, 0x42, 0, "mpsqdbw",      XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x40, 0, "dpps",         XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x41, 0, "dppd",         XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x42, 0, "mpsadbw",      XMM,    XM,     OP_ARG2_IMM8},
 
     {0x3A, 0x44, 0, "pclmulqdq",    XMM,    XM,     OP_ARG2_IMM8},
 
-    {0x3A, 0x60, 0, "pcmpestrm",    XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x61, 0, "pcmpestri",    XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x62, 0, "pcmpistrm",    XMM,    XM,     OP_ARG2_IMM8},
-    {0x3A, 0x63, 0, "pcmpistri",    XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x60, 0, "pcmpestrm",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x61, 0, "pcmpestri",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x62, 0, "pcmpistrm",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x63, 0, "pcmpistri",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+
+    {0x3A, 0xDF, 0, "aeskeygenassist", XMM, XM,     OP_ARG2_IMM8|OP_NOVVVV},
+};
+
+/* Instructions only encodable with VEX. Like the SSE tables, these are split
+ * by the prefix that VEX.pp stands for. Names are given in full, since not all
+ * of them begin with v. */
+static const struct op instructions_vex[] = {
+    {0x38, 0xF2,-1, "andn",         REG,    RM,     OP_VVVV},
+    {0x38, 0xF5,-1, "bzhi",         REG,    RM,     OP_VVVV_LAST},
+    {0x38, 0xF7,-1, "bextr",        REG,    RM,     OP_VVVV_LAST},
+};
+
+/* VEX 0F38 F3 is a group, indexed by ModRM.reg - 1; vvvv is the destination */
+static const struct op instructions_vex_38F3[] = {
+    {0x38, 0xF3,-1, "blsr",         RM,     0,      OP_VVVV_DST},
+    {0x38, 0xF3,-1, "blsmsk",       RM,     0,      OP_VVVV_DST},
+    {0x38, 0xF3,-1, "blsi",         RM,     0,      OP_VVVV_DST},
+};
+
+static const struct op instructions_vex_op32[] = {
+    {0x38, 0x0C, 0, "vpermilps",    XMM,    XM},
+    {0x38, 0x0D, 0, "vpermilpd",    XMM,    XM},
+    {0x38, 0x0E, 0, "vtestps",      XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x0F, 0, "vtestpd",      XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x13, 0, "vcvtph2ps",    XMM,    XMH,    OP_NOVVVV},
+    {0x38, 0x16, 0, "vpermps",      XMM,    XM},
+    {0x38, 0x18, 0, "vbroadcastss", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x19, 0, "vbroadcastsd", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x1A, 0, "vbroadcastf128", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x2C, 0, "vmaskmovps",   XMM,    MEM},
+    {0x38, 0x2D, 0, "vmaskmovpd",   XMM,    MEM},
+    {0x38, 0x2E, 0, "vmaskmovps",   MEM,    XMM,    OP_VVVV},
+    {0x38, 0x2F, 0, "vmaskmovpd",   MEM,    XMM,    OP_VVVV},
+    {0x38, 0x36, 0, "vpermd",       XMM,    XM},
+    {0x38, 0x45, 0, "vpsrlvq",      XMM,    XM,     OP_W1},
+    {0x38, 0x45, 0, "vpsrlvd",      XMM,    XM},
+    {0x38, 0x46, 0, "vpsravd",      XMM,    XM},
+    {0x38, 0x47, 0, "vpsllvq",      XMM,    XM,     OP_W1},
+    {0x38, 0x47, 0, "vpsllvd",      XMM,    XM},
+    {0x38, 0x58, 0, "vpbroadcastd", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x59, 0, "vpbroadcastq", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x5A, 0, "vbroadcasti128", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x78, 0, "vpbroadcastb", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x79, 0, "vpbroadcastw", XMM,    XM128,  OP_NOVVVV},
+    {0x38, 0x8C, 0, "vpmaskmovq",   XMM,    MEM,    OP_W1},
+    {0x38, 0x8C, 0, "vpmaskmovd",   XMM,    MEM},
+    {0x38, 0x8E, 0, "vpmaskmovq",   MEM,    XMM,    OP_W1|OP_VVVV},
+    {0x38, 0x8E, 0, "vpmaskmovd",   MEM,    XMM,    OP_VVVV},
+    {0x38, 0x90, 0, "vpgatherdq",   XMM,    XMH,    OP_W1|OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x90, 0, "vpgatherdd",   XMM,    XM,     OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x91, 0, "vpgatherqq",   XMM,    XM,     OP_W1|OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x91, 0, "vpgatherqd",   XMMH,   XM,     OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x92, 0, "vgatherdpd",   XMM,    XMH,    OP_W1|OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x92, 0, "vgatherdps",   XMM,    XM,     OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x93, 0, "vgatherqpd",   XMM,    XM,     OP_W1|OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x93, 0, "vgatherqps",   XMMH,   XM,     OP_VSIB|OP_VVVV_LAST},
+    {0x38, 0x96, 0, "vfmaddsub132pd", XMM,    XM,     OP_W1},
+    {0x38, 0x96, 0, "vfmaddsub132ps", XMM,    XM},
+    {0x38, 0x97, 0, "vfmsubadd132pd", XMM,    XM,     OP_W1},
+    {0x38, 0x97, 0, "vfmsubadd132ps", XMM,    XM},
+    {0x38, 0x98, 0, "vfmadd132pd",  XMM,    XM,     OP_W1},
+    {0x38, 0x98, 0, "vfmadd132ps",  XMM,    XM},
+    {0x38, 0x99, 0, "vfmadd132sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0x99, 0, "vfmadd132ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0x9A, 0, "vfmsub132pd",  XMM,    XM,     OP_W1},
+    {0x38, 0x9A, 0, "vfmsub132ps",  XMM,    XM},
+    {0x38, 0x9B, 0, "vfmsub132sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0x9B, 0, "vfmsub132ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0x9C, 0, "vfnmadd132pd", XMM,    XM,     OP_W1},
+    {0x38, 0x9C, 0, "vfnmadd132ps", XMM,    XM},
+    {0x38, 0x9D, 0, "vfnmadd132sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0x9D, 0, "vfnmadd132ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0x9E, 0, "vfnmsub132pd", XMM,    XM,     OP_W1},
+    {0x38, 0x9E, 0, "vfnmsub132ps", XMM,    XM},
+    {0x38, 0x9F, 0, "vfnmsub132sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0x9F, 0, "vfnmsub132ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0xA6, 0, "vfmaddsub213pd", XMM,    XM,     OP_W1},
+    {0x38, 0xA6, 0, "vfmaddsub213ps", XMM,    XM},
+    {0x38, 0xA7, 0, "vfmsubadd213pd", XMM,    XM,     OP_W1},
+    {0x38, 0xA7, 0, "vfmsubadd213ps", XMM,    XM},
+    {0x38, 0xA8, 0, "vfmadd213pd",  XMM,    XM,     OP_W1},
+    {0x38, 0xA8, 0, "vfmadd213ps",  XMM,    XM},
+    {0x38, 0xA9, 0, "vfmadd213sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xA9, 0, "vfmadd213ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0xAA, 0, "vfmsub213pd",  XMM,    XM,     OP_W1},
+    {0x38, 0xAA, 0, "vfmsub213ps",  XMM,    XM},
+    {0x38, 0xAB, 0, "vfmsub213sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xAB, 0, "vfmsub213ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0xAC, 0, "vfnmadd213pd", XMM,    XM,     OP_W1},
+    {0x38, 0xAC, 0, "vfnmadd213ps", XMM,    XM},
+    {0x38, 0xAD, 0, "vfnmadd213sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xAD, 0, "vfnmadd213ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0xAE, 0, "vfnmsub213pd", XMM,    XM,     OP_W1},
+    {0x38, 0xAE, 0, "vfnmsub213ps", XMM,    XM},
+    {0x38, 0xAF, 0, "vfnmsub213sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xAF, 0, "vfnmsub213ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0xB6, 0, "vfmaddsub231pd", XMM,    XM,     OP_W1},
+    {0x38, 0xB6, 0, "vfmaddsub231ps", XMM,    XM},
+    {0x38, 0xB7, 0, "vfmsubadd231pd", XMM,    XM,     OP_W1},
+    {0x38, 0xB7, 0, "vfmsubadd231ps", XMM,    XM},
+    {0x38, 0xB8, 0, "vfmadd231pd",  XMM,    XM,     OP_W1},
+    {0x38, 0xB8, 0, "vfmadd231ps",  XMM,    XM},
+    {0x38, 0xB9, 0, "vfmadd231sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xB9, 0, "vfmadd231ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0xBA, 0, "vfmsub231pd",  XMM,    XM,     OP_W1},
+    {0x38, 0xBA, 0, "vfmsub231ps",  XMM,    XM},
+    {0x38, 0xBB, 0, "vfmsub231sd",  XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xBB, 0, "vfmsub231ss",  XMM,    XM,     OP_SCALAR},
+    {0x38, 0xBC, 0, "vfnmadd231pd", XMM,    XM,     OP_W1},
+    {0x38, 0xBC, 0, "vfnmadd231ps", XMM,    XM},
+    {0x38, 0xBD, 0, "vfnmadd231sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xBD, 0, "vfnmadd231ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0xBE, 0, "vfnmsub231pd", XMM,    XM,     OP_W1},
+    {0x38, 0xBE, 0, "vfnmsub231ps", XMM,    XM},
+    {0x38, 0xBF, 0, "vfnmsub231sd", XMM,    XM,     OP_W1|OP_SCALAR},
+    {0x38, 0xBF, 0, "vfnmsub231ss", XMM,    XM,     OP_SCALAR},
+    {0x38, 0xF7,-1, "shlx",         REG,    RM,     OP_VVVV_LAST},
+
+    {0x3A, 0x00, 0, "vpermq",       XMM,    XM,     OP_ARG2_IMM8|OP_W1|OP_NOVVVV},
+    {0x3A, 0x01, 0, "vpermpd",      XMM,    XM,     OP_ARG2_IMM8|OP_W1|OP_NOVVVV},
+    {0x3A, 0x02, 0, "vpblendd",     XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x04, 0, "vpermilps",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x05, 0, "vpermilpd",    XMM,    XM,     OP_ARG2_IMM8|OP_NOVVVV},
+    {0x3A, 0x06, 0, "vperm2f128",   XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x18, 0, "vinsertf128",  XMM,    XM128,  OP_ARG2_IMM8},
+    {0x3A, 0x19, 0, "vextractf128", XM128,  XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x1D, 0, "vcvtps2ph",    XMH,    XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x38, 0, "vinserti128",  XMM,    XM128,  OP_ARG2_IMM8},
+    {0x3A, 0x39, 0, "vextracti128", XM128,  XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x46, 0, "vperm2i128",   XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x4A, 0, "vblendvps",    XMM,    XM,     OP_ARG2_IS4},
+    {0x3A, 0x4B, 0, "vblendvpd",    XMM,    XM,     OP_ARG2_IS4},
+    {0x3A, 0x4C, 0, "vpblendvb",    XMM,    XM,     OP_ARG2_IS4},
+};
+
+static const struct op instructions_vex_repne[] = {
+    {0x38, 0xF5,-1, "pdep",         REG,    RM,     OP_VVVV},
+    {0x38, 0xF6,-1, "mulx",         REG,    RM,     OP_VVVV},
+    {0x38, 0xF7,-1, "shrx",         REG,    RM,     OP_VVVV_LAST},
+
+    {0x3A, 0xF0,-1, "rorx",         REG,    RM,     OP_ARG2_IMM8},
+};
+
+static const struct op instructions_vex_repe[] = {
+    {0x38, 0xF5,-1, "pext",         REG,    RM,     OP_VVVV},
+    {0x38, 0xF7,-1, "sarx",         REG,    RM,     OP_VVVV_LAST},
+};
+
+/* Likewise for instructions which are new or renamed with EVEX. Comparisons
+ * write to a mask register. */
+static const struct op instructions_evex[] = {
+    {0xC2, 8,  0, "vcmpps",     KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+};
+
+static const struct op instructions_evex_op32[] = {
+    {0x64, 8,  0, "vpcmpgtb",   KREG,   XM,     OP_VVVV},
+    {0x65, 8,  0, "vpcmpgtw",   KREG,   XM,     OP_VVVV},
+    {0x66, 8,  0, "vpcmpgtd",   KREG,   XM,     OP_VVVV},
+    {0x6F, 8,  0, "vmovdqa64",  XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x6F, 8,  0, "vmovdqa32",  XMM,    XM,     OP_NOVVVV},
+    {0x72, 0,  0, "vprorq",     XMMONLY,IMM8,   OP_W1},
+    {0x72, 0,  0, "vprord",     XMMONLY,IMM8},
+    {0x72, 1,  0, "vprolq",     XMMONLY,IMM8,   OP_W1},
+    {0x72, 1,  0, "vprold",     XMMONLY,IMM8},
+    {0x72, 4,  0, "vpsraq",     XMMONLY,IMM8,   OP_W1},
+    {0x74, 8,  0, "vpcmpeqb",   KREG,   XM,     OP_VVVV},
+    {0x75, 8,  0, "vpcmpeqw",   KREG,   XM,     OP_VVVV},
+    {0x76, 8,  0, "vpcmpeqd",   KREG,   XM,     OP_VVVV},
+    {0x7F, 8,  0, "vmovdqa64",  XM,     XMM,    OP_W1},
+    {0x7F, 8,  0, "vmovdqa32",  XM,     XMM},
+    {0xC2, 8,  0, "vcmppd",     KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+    {0xDB, 8,  0, "vpandq",     XMM,    XM,     OP_W1},
+    {0xDB, 8,  0, "vpandd",     XMM,    XM},
+    {0xDF, 8,  0, "vpandnq",    XMM,    XM,     OP_W1},
+    {0xDF, 8,  0, "vpandnd",    XMM,    XM},
+    {0xEB, 8,  0, "vporq",      XMM,    XM,     OP_W1},
+    {0xEB, 8,  0, "vpord",      XMM,    XM},
+    {0xEF, 8,  0, "vpxorq",     XMM,    XM,     OP_W1},
+    {0xEF, 8,  0, "vpxord",     XMM,    XM},
+
+    {0x38, 0x10, 0, "vpsrlvw",      XMM,    XM,     OP_W1},
+    {0x38, 0x11, 0, "vpsravw",      XMM,    XM,     OP_W1},
+    {0x38, 0x12, 0, "vpsllvw",      XMM,    XM,     OP_W1},
+    {0x38, 0x1F, 0, "vpabsq",       XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x38, 0x29, 0, "vpcmpeqq",     KREG,   XM,     OP_W1|OP_VVVV},
+    {0x38, 0x37, 0, "vpcmpgtq",     KREG,   XM,     OP_W1|OP_VVVV},
+    {0x38, 0x39, 0, "vpminsq",      XMM,    XM,     OP_W1},
+    {0x38, 0x3B, 0, "vpminuq",      XMM,    XM,     OP_W1},
+    {0x38, 0x3D, 0, "vpmaxsq",      XMM,    XM,     OP_W1},
+    {0x38, 0x3F, 0, "vpmaxuq",      XMM,    XM,     OP_W1},
+    {0x38, 0x40, 0, "vpmullq",      XMM,    XM,     OP_W1},
+    {0x38, 0x64, 0, "vpblendmq",    XMM,    XM,     OP_W1},
+    {0x38, 0x64, 0, "vpblendmd",    XMM,    XM},
+    {0x38, 0x65, 0, "vblendmpd",    XMM,    XM,     OP_W1},
+    {0x38, 0x65, 0, "vblendmps",    XMM,    XM},
+    {0x38, 0x75, 0, "vpermi2w",     XMM,    XM,     OP_W1},
+    {0x38, 0x75, 0, "vpermi2b",     XMM,    XM},
+    {0x38, 0x76, 0, "vpermi2q",     XMM,    XM,     OP_W1},
+    {0x38, 0x76, 0, "vpermi2d",     XMM,    XM},
+    {0x38, 0x77, 0, "vpermi2pd",    XMM,    XM,     OP_W1},
+    {0x38, 0x77, 0, "vpermi2ps",    XMM,    XM},
+    {0x38, 0x7A,32, "vpbroadcastb", XMM,    RM,     OP_NOVVVV},
+    {0x38, 0x7B,32, "vpbroadcastw", XMM,    RM,     OP_NOVVVV},
+    {0x38, 0x7C,64, "vpbroadcastq", XMM,    RM,     OP_W1|OP_NOVVVV},
+    {0x38, 0x7C,32, "vpbroadcastd", XMM,    RM,     OP_NOVVVV},
+    {0x38, 0x7D, 0, "vpermt2w",     XMM,    XM,     OP_W1},
+    {0x38, 0x7D, 0, "vpermt2b",     XMM,    XM},
+    {0x38, 0x7E, 0, "vpermt2q",     XMM,    XM,     OP_W1},
+    {0x38, 0x7E, 0, "vpermt2d",     XMM,    XM},
+    {0x38, 0x7F, 0, "vpermt2pd",    XMM,    XM,     OP_W1},
+    {0x38, 0x7F, 0, "vpermt2ps",    XMM,    XM},
+    {0x38, 0x88, 0, "vexpandpd",    XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x38, 0x88, 0, "vexpandps",    XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x89, 0, "vpexpandq",    XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x38, 0x89, 0, "vpexpandd",    XMM,    XM,     OP_NOVVVV},
+    {0x38, 0x8A, 0, "vcompresspd",  XM,     XMM,    OP_W1},
+    {0x38, 0x8A, 0, "vcompressps",  XM,     XMM},
+    {0x38, 0x8B, 0, "vpcompressq",  XM,     XMM,    OP_W1},
+    {0x38, 0x8B, 0, "vpcompressd",  XM,     XMM},
+    {0x38, 0x90, 0, "vpgatherdq",   XMM,    XMH,    OP_W1|OP_VSIB|OP_NOVVVV},
+    {0x38, 0x90, 0, "vpgatherdd",   XMM,    XM,     OP_VSIB|OP_NOVVVV},
+    {0x38, 0x91, 0, "vpgatherqq",   XMM,    XM,     OP_W1|OP_VSIB|OP_NOVVVV},
+    {0x38, 0x91, 0, "vpgatherqd",   XMMH,   XM,     OP_VSIB|OP_NOVVVV},
+    {0x38, 0x92, 0, "vgatherdpd",   XMM,    XMH,    OP_W1|OP_VSIB|OP_NOVVVV},
+    {0x38, 0x92, 0, "vgatherdps",   XMM,    XM,     OP_VSIB|OP_NOVVVV},
+    {0x38, 0x93, 0, "vgatherqpd",   XMM,    XM,     OP_W1|OP_VSIB|OP_NOVVVV},
+    {0x38, 0x93, 0, "vgatherqps",   XMMH,   XM,     OP_VSIB|OP_NOVVVV},
+    {0x38, 0xA0, 0, "vpscatterdq",  XMH,    XMM,    OP_W1|OP_VSIB},
+    {0x38, 0xA0, 0, "vpscatterdd",  XM,     XMM,    OP_VSIB},
+    {0x38, 0xA1, 0, "vpscatterqq",  XM,     XMM,    OP_W1|OP_VSIB},
+    {0x38, 0xA1, 0, "vpscatterqd",  XM,     XMMH,   OP_VSIB},
+    {0x38, 0xA2, 0, "vscatterdpd",  XMH,    XMM,    OP_W1|OP_VSIB},
+    {0x38, 0xA2, 0, "vscatterdps",  XM,     XMM,    OP_VSIB},
+    {0x38, 0xA3, 0, "vscatterqpd",  XM,     XMM,    OP_W1|OP_VSIB},
+    {0x38, 0xA3, 0, "vscatterqps",  XM,     XMMH,   OP_VSIB},
+    {0x38, 0xC4, 0, "vpconflictq",  XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x38, 0xC4, 0, "vpconflictd",  XMM,    XM,     OP_NOVVVV},
+
+    {0x3A, 0x03, 0, "valignq",      XMM,    XM,     OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x03, 0, "valignd",      XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x18, 0, "vinsertf64x2", XMM,    XM128,  OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x18, 0, "vinsertf32x4", XMM,    XM128,  OP_ARG2_IMM8},
+    {0x3A, 0x19, 0, "vextractf64x2", XM128,  XMM,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x19, 0, "vextractf32x4", XM128,  XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x1A, 0, "vinsertf64x4", XMM,    XMH,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x1A, 0, "vinsertf32x8", XMM,    XMH,    OP_ARG2_IMM8},
+    {0x3A, 0x1B, 0, "vextractf64x4", XMH,    XMM,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x1B, 0, "vextractf32x8", XMH,    XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x1E, 0, "vpcmpuq",      KREG,   XM,     OP_W1|OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x1E, 0, "vpcmpud",      KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x1F, 0, "vpcmpq",       KREG,   XM,     OP_W1|OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x1F, 0, "vpcmpd",       KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x23, 0, "vshuff64x2",   XMM,    XM,     OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x23, 0, "vshuff32x4",   XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x25, 0, "vpternlogq",   XMM,    XM,     OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x25, 0, "vpternlogd",   XMM,    XM,     OP_ARG2_IMM8},
+    {0x3A, 0x38, 0, "vinserti64x2", XMM,    XM128,  OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x38, 0, "vinserti32x4", XMM,    XM128,  OP_ARG2_IMM8},
+    {0x3A, 0x39, 0, "vextracti64x2", XM128,  XMM,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x39, 0, "vextracti32x4", XM128,  XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x3A, 0, "vinserti64x4", XMM,    XMH,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x3A, 0, "vinserti32x8", XMM,    XMH,    OP_ARG2_IMM8},
+    {0x3A, 0x3B, 0, "vextracti64x4", XMH,    XMM,    OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x3B, 0, "vextracti32x8", XMH,    XMM,    OP_ARG2_IMM8},
+    {0x3A, 0x3E, 0, "vpcmpuw",      KREG,   XM,     OP_W1|OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x3E, 0, "vpcmpub",      KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x3F, 0, "vpcmpw",       KREG,   XM,     OP_W1|OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x3F, 0, "vpcmpb",       KREG,   XM,     OP_ARG2_IMM8|OP_VVVV},
+    {0x3A, 0x43, 0, "vshufi64x2",   XMM,    XM,     OP_W1|OP_ARG2_IMM8},
+    {0x3A, 0x43, 0, "vshufi32x4",   XMM,    XM,     OP_ARG2_IMM8},
+};
+
+static const struct op instructions_evex_repne[] = {
+    {0x6F, 8,  0, "vmovdqu16",  XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x6F, 8,  0, "vmovdqu8",   XMM,    XM,     OP_NOVVVV},
+    {0x7F, 8,  0, "vmovdqu16",  XM,     XMM,    OP_W1},
+    {0x7F, 8,  0, "vmovdqu8",   XM,     XMM},
+    {0xC2, 8,  0, "vcmpsd",     KREG,   XM,     OP_ARG2_IMM8|OP_VVVV|OP_SCALAR},
+};
+
+static const struct op instructions_evex_repe[] = {
+    {0x6F, 8,  0, "vmovdqu64",  XMM,    XM,     OP_W1|OP_NOVVVV},
+    {0x6F, 8,  0, "vmovdqu32",  XMM,    XM,     OP_NOVVVV},
+    {0x7F, 8,  0, "vmovdqu64",  XM,     XMM,    OP_W1},
+    {0x7F, 8,  0, "vmovdqu32",  XM,     XMM},
+    {0xC2, 8,  0, "vcmpss",     KREG,   XM,     OP_ARG2_IMM8|OP_VVVV|OP_SCALAR},
+    {0xE6, 8,  0, "vcvtqq2pd",  XMM,    XM,     OP_W1|OP_NOVVVV},
+
+    {0x38, 0x30, 0, "vpmovwb",      XMH,    XMM},
+    {0x38, 0x31, 0, "vpmovdb",      XM128,  XMM},
+    {0x38, 0x32, 0, "vpmovqb",      XM128,  XMM},
+    {0x38, 0x33, 0, "vpmovdw",      XMH,    XMM},
+    {0x38, 0x34, 0, "vpmovqw",      XM128,  XMM},
+    {0x38, 0x35, 0, "vpmovqd",      XMH,    XMM},
 };
 
+/* The prefix bits of each byte, or 0 if it isn't a prefix. REX prefixes (40-4F)
+ * only count in 64-bit mode. */
+#define REX(wrxb) (PREFIX_REX | (wrxb) * PREFIX_REXB)
+static const word prefix_table[256] = {
+    /* 00 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 10 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 20 */ 0, 0, 0, 0, 0, 0, PREFIX_ES, 0, 0, 0, 0, 0, 0, 0, PREFIX_CS, 0,
+    /* 30 */ 0, 0, 0, 0, 0, 0, PREFIX_SS, 0, 0, 0, 0, 0, 0, 0, PREFIX_DS, 0,
+    /* 40 */ REX(0), REX(1), REX(2), REX(3), REX(4), REX(5), REX(6), REX(7),
+             REX(8), REX(9), REX(10), REX(11), REX(12), REX(13), REX(14), REX(15),
+    /* 50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 60 */ 0, 0, 0, 0, PREFIX_FS, PREFIX_GS, PREFIX_OP32, PREFIX_ADDR32, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 70 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 80 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* 90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, PREFIX_WAIT, 0, 0, 0, 0,
+    /* A0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* B0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* C0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* D0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* E0 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    /* F0 */ PREFIX_LOCK, 0, PREFIX_REPNE, PREFIX_REPE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+#undef REX
+
 /* returns the flag if it's a prefix, 0 otherwise */
-static word get_prefix(word opcode, int bits) {
-    if (bits == 64) {
-        if ((opcode & 0xFFF0) == 0x40)
-            return PREFIX_REX | ((opcode & 0xF) * 0x1000);
-    }
+static inline word get_prefix(word opcode, int bits) {
+    word prefix = (opcode <= 0xFF) ? prefix_table[opcode] : 0;
 
-    switch(opcode) {
-    case 0x26: return PREFIX_ES;
-    case 0x2E: return PREFIX_CS;
-    case 0x36: return PREFIX_SS;
-    case 0x3E: return PREFIX_DS;
-    case 0x64: return PREFIX_FS;
-    case 0x65: return PREFIX_GS;
-    case 0x66: return PREFIX_OP32;
-    case 0x67: return PREFIX_ADDR32;
-    case 0x9B: return PREFIX_WAIT;
-    case 0xF0: return PREFIX_LOCK;
-    case 0xF2: return PREFIX_REPNE;
-    case 0xF3: return PREFIX_REPE;
-    default: return 0;
-    }
+    if ((prefix & PREFIX_REX) && bits != 64)
+        return 0;
+    return prefix;
 }
 
 static int instr_matches(const byte opcode, const byte subcode, const struct op *op) {
     return ((opcode == op->opcode) && ((op->subcode == 8) || (subcode == op->subcode)));
 }
 
+static struct op_table sse_tables[] = {
+    OP_TABLE(instructions_sse, KEY_OPCODE),
+    OP_TABLE(instructions_sse_op32, KEY_OPCODE),
+    OP_TABLE(instructions_sse_repe, KEY_OPCODE),
+    OP_TABLE(instructions_sse_repne, KEY_OPCODE),
+};
+
+static struct op_table sse_single_tables[] = {
+    OP_TABLE(instructions_sse_single, KEY_ESCAPE),
+    OP_TABLE(instructions_sse_single_op32, KEY_ESCAPE),
+};
+
+static struct op_table table_0F = OP_TABLE(instructions_0F, KEY_OPCODE);
+static struct op_table table_group = OP_TABLE(instructions_group, KEY_OPCODE);
+
+/* Finds the first entry of a table (indexed by opcode) matching
+ * instr_matches(). */
+static const struct op *find_op(struct op_table *table, byte opcode, byte subcode) {
+    unsigned i, end;
+
+    for (op_bucket(table, opcode, &i, &end); i < end; i++) {
+        const struct op *op = &table->ops[table->order[i]];
+        if (instr_matches(opcode, subcode, op))
+            return op;
+    }
+    return NULL;
+}
+
+/* Likewise, for a three-byte entry (escape is 0x38 or 0x3A). */
+static const struct op *find_op_escape(struct op_table *table, byte escape, byte opcode) {
+    unsigned i, end;
+
+    for (op_bucket(table, opcode, &i, &end); i < end; i++) {
+        const struct op *op = &table->ops[table->order[i]];
+        if (op->opcode == escape && op->subcode == opcode)
+            return op;
+    }
+    return NULL;
+}
+
 /* aka 3 byte opcode */
 static int get_sse_single(byte opcode, byte subcode, struct instr *instr) {
-    int i;
-
     if (instr->prefix & PREFIX_OP32) {
-        for (i = 0; i < sizeof(instructions_sse_single_op32)/sizeof(struct op); i++) {
-            if (instructions_sse_single_op32[i].opcode == opcode &&
-                instructions_sse_single_op32[i].subcode == subcode) {
-                instr->op = instructions_sse_single_op32[i];
-                instr->prefix &= ~PREFIX_OP32;
-                return 1;
-            }
+        if ((instr->op = find_op_escape(&sse_single_tables[1], opcode, subcode))) {
+            instr->prefix &= ~PREFIX_OP32;
+            return 1;
         }
     } else {
-        for (i = 0; i < sizeof(instructions_sse_single)/sizeof(struct op); i++) {
-            if (instructions_sse_single[i].opcode == opcode &&
-                instructions_sse_single[i].subcode == subcode) {
-                instr->op = instructions_sse_single[i];
-                return 1;
-            }
-        }
+        if ((instr->op = find_op_escape(&sse_single_tables[0], opcode, subcode)))
+            return 1;
     }
 
     return 0;
@@ -1508,101 +1904,313 @@ static int get_sse_single(byte opcode, byte subcode, struct instr *instr) {
 
 static int get_sse_instr(const byte *p, struct instr *instr) {
     byte subcode = REGOF(p[1]);
-    unsigned i;
 
     /* Clear the prefix if it matches. This makes the disassembler work right,
      * but it might break things later if we want to interpret these. The
      * solution in that case is probably to modify the size/name instead. */
 
     if (instr->prefix & PREFIX_OP32) {
-        for (i = 0; i < sizeof(instructions_sse_op32)/sizeof(struct op); i++) {
-            if (instr_matches(p[0], subcode, &instructions_sse_op32[i])) {
-                instr->op = instructions_sse_op32[i];
-                instr->prefix &= ~PREFIX_OP32;
-                return 0;
-            }
+        if ((instr->op = find_op(&sse_tables[1], p[0], subcode))) {
+            instr->prefix &= ~PREFIX_OP32;
+            return 0;
         }
     } else if (instr->prefix & PREFIX_REPNE) {
-        for (i = 0; i < sizeof(instructions_sse_repne)/sizeof(struct op); i++) {
-            if (instr_matches(p[0], subcode, &instructions_sse_repne[i])) {
-                instr->op = instructions_sse_repne[i];
-                instr->prefix &= ~PREFIX_REPNE;
-                return 0;
-            }
+        if ((instr->op = find_op(&sse_tables[3], p[0], subcode))) {
+            instr->prefix &= ~PREFIX_REPNE;
+            return 0;
         }
     } else if (instr->prefix & PREFIX_REPE) {
-        for (i = 0; i < sizeof(instructions_sse_repe)/sizeof(struct op); i++) {
-            if (instr_matches(p[0], subcode, &instructions_sse_repe[i])) {
-                instr->op = instructions_sse_repe[i];
-                instr->prefix &= ~PREFIX_REPE;
-                return 0;
-            }
+        if ((instr->op = find_op(&sse_tables[2], p[0], subcode))) {
+            instr->prefix &= ~PREFIX_REPE;
+            return 0;
         }
     } else {
-        for (i = 0; i < sizeof(instructions_sse)/sizeof(struct op); i++) {
-            if (instr_matches(p[0], subcode, &instructions_sse[i])) {
-                instr->op = instructions_sse[i];
-                return 0;
-            }
-        }
+        if ((instr->op = find_op(&sse_tables[0], p[0], subcode)))
+            return 0;
     }
 
     return get_sse_single(p[0], p[1], instr);
 }
 
+/* 0F01 and 0FAE with mod == 3 are encoded by the whole modrm byte */
+static const struct op instructions_0F01_reg[] = {
+    {0x0F01, 0xC1, 0, "vmcall"},
+    {0x0F01, 0xC2, 0, "vmlaunch"},
+    {0x0F01, 0xC3, 0, "vmresume"},
+    {0x0F01, 0xC4, 0, "vmcall"},
+    {0x0F01, 0xC8, 0, "monitor"},
+    {0x0F01, 0xC9, 0, "mwait"},
+    {0x0F01, 0xD0, 0, "xgetbv"},
+    {0x0F01, 0xD1, 0, "xsetbv"},
+    {0x0F01, 0xF9, 0, "rdtscp"},
+};
+
+static const struct op instructions_0FAE_reg[] = {
+    {0x0FAE, 5, 0, "lfence"},
+    {0x0FAE, 6, 0, "mfence"},
+    {0x0FAE, 7, 0, "sfence"},
+};
+
 static int get_0f_instr(const byte *p, struct instr *instr) {
     byte subcode = REGOF(p[1]);
     unsigned i;
-    int len;
+    int len = 0;
 
     /* a couple of special (read: annoying) cases first */
     if (p[0] == 0x01 && MODOF(p[1]) == 3) {
-        instr->op.opcode = 0x0F01;
-        instr->op.subcode = p[1];
-        switch (p[1]) {
-        case 0xC1: strcpy(instr->op.name, "vmcall"); break;
-        case 0xC2: strcpy(instr->op.name, "vmlaunch"); break;
-        case 0xC3: strcpy(instr->op.name, "vmresume"); break;
-        case 0xC4: strcpy(instr->op.name, "vmcall"); break;
-        case 0xC8: strcpy(instr->op.name, "monitor"); break;
-        case 0xC9: strcpy(instr->op.name, "mwait"); break;
-        case 0xD0: strcpy(instr->op.name, "xgetbv"); break;
-        case 0xD1: strcpy(instr->op.name, "xsetbv"); break;
-        case 0xF9: strcpy(instr->op.name, "rdtscp"); break;
+        instr->opcode = 0x0F01;
+        instr->subcode = p[1];
+        for (i = 0; i < sizeof(instructions_0F01_reg)/sizeof(struct op); i++) {
+            if (instructions_0F01_reg[i].subcode == p[1])
+                instr->op = &instructions_0F01_reg[i];
         }
         return 1;
     } else if (p[0] == 0xAE && MODOF(p[1]) == 3) {
-        instr->op.opcode = 0x0FAE;
-        instr->op.subcode = subcode;
-        if (subcode == 0x5) strcpy(instr->op.name, "lfence");
-        if (subcode == 0x6) strcpy(instr->op.name, "mfence");
-        if (subcode == 0x7) strcpy(instr->op.name, "sfence");
+        instr->opcode = 0x0FAE;
+        instr->subcode = subcode;
+        for (i = 0; i < sizeof(instructions_0FAE_reg)/sizeof(struct op); i++) {
+            if (instructions_0FAE_reg[i].subcode == subcode)
+                instr->op = &instructions_0FAE_reg[i];
+        }
         return 1;
     }
 
-    for (i = 0; i < sizeof(instructions_0F)/sizeof(struct op); i++) {
-        if (instr_matches(p[0], subcode, &instructions_0F[i])) {
-            instr->op = instructions_0F[i];
-            len = 0;
-            break;
+    instr->op = find_op(&table_0F, p[0], subcode);
+    if (!instr->op)
+        len = get_sse_instr(p, instr);
+
+    instr->opcode = 0x0F00 | p[0];
+    if (instr->op)
+        instr->subcode = instr->op->subcode;
+    return len;
+}
+
+/* indexed by VEX.pp */
+static struct op_table vex_tables[4] = {
+    OP_TABLE(instructions_vex, KEY_ESCAPE),
+    OP_TABLE(instructions_vex_op32, KEY_ESCAPE),
+    OP_TABLE(instructions_vex_repe, KEY_ESCAPE),
+    OP_TABLE(instructions_vex_repne, KEY_ESCAPE),
+};
+
+static struct op_table evex_tables[4] = {
+    OP_TABLE(instructions_evex, KEY_ESCAPE),
+    OP_TABLE(instructions_evex_op32, KEY_ESCAPE),
+    OP_TABLE(instructions_evex_repe, KEY_ESCAPE),
+    OP_TABLE(instructions_evex_repne, KEY_ESCAPE),
+};
+
+/* Builds the lookup indexes. Call it once, before decoding anything. */
+void init_instr_tables(void) {
+    unsigned i;
+
+    if (table_0F.order)
+        return;
+
+    index_op_table(&table_fpu_single);
+    index_op_table(&table_0F);
+    index_op_table(&table_group);
+    for (i = 0; i < sizeof(sse_tables)/sizeof(sse_tables[0]); i++)
+        index_op_table(&sse_tables[i]);
+    for (i = 0; i < sizeof(sse_single_tables)/sizeof(sse_single_tables[0]); i++)
+        index_op_table(&sse_single_tables[i]);
+    for (i = 0; i < 4; i++) {
+        index_op_table(&vex_tables[i]);
+        index_op_table(&evex_tables[i]);
+    }
+}
+
+static const word vex_prefix[4] = {0, PREFIX_OP32, PREFIX_REPE, PREFIX_REPNE};
+
+static const struct op vzeroupper_op = {0x77, 8, 0, "vzeroupper"};
+static const struct op vzeroall_op = {0x77, 8, 0, "vzeroall"};
+
+/* Placeholders for VEX instructions we don't know. All of them but the above
+ * have a ModRM byte, so we can at least get the length right. */
+static const struct op unknown_vex_op = {0, 8, 0, "?", XMM, XM, OP_NOVVVV};
+static const struct op unknown_vex_imm_op = {0, 8, 0, "?", XMM, XM, OP_NOVVVV|OP_ARG2_IMM8};
+
+/* Map 1 entries are stored like the two-byte SSE tables, and maps 2 and 3
+ * like the three-byte ones. */
+static const struct op *find_vex_op(struct op_table *table, byte map, const byte *p, int w) {
+    unsigned i, end;
+
+    for (op_bucket(table, p[0], &i, &end); i < end; i++) {
+        const struct op *op = &table->ops[table->order[i]];
+
+        if ((op->flags & OP_W1) && !w)
+            continue;
+        if (map == 1 && op->opcode != 0x38 && op->opcode != 0x3A &&
+                instr_matches(p[0], REGOF(p[1]), op))
+            return op;
+        if (map == 2 && op->opcode == 0x38 && op->subcode == p[0])
+            return op;
+        if (map == 3 && op->opcode == 0x3A && op->subcode == p[0])
+            return op;
+    }
+    return NULL;
+}
+
+/* Most VEX instructions are SSE instructions with a v in front; look them up
+ * as if they had the prefix VEX.pp stands for. MMX forms don't exist. */
+static const struct op *find_vex_sse_op(byte map, const byte *p, byte pp, struct instr *instr) {
+    const struct op *op;
+
+    instr->prefix |= vex_prefix[pp];
+    if (map == 1 && p[0] != 0x38 && p[0] != 0x3A)
+        get_sse_instr(p, instr);
+    else if (map == 2 || map == 3)
+        get_sse_single((map == 2) ? 0x38 : 0x3A, p[0], instr);
+    instr->prefix &= ~(PREFIX_OP32 | PREFIX_REPE | PREFIX_REPNE);
+
+    op = instr->op;
+    instr->op = NULL;
+    if (!op)
+        return NULL;
+    if (op->arg0 == MMX || op->arg0 == MM || op->arg0 == MMXONLY ||
+        op->arg1 == MMX || op->arg1 == MM || op->arg1 == MMXONLY)
+        return NULL;
+    if (!(op->arg0 >= XM && op->arg0 <= XM128) && op->arg0 != XMMONLY && op->arg0 != XMM && op->arg0 != XMMH &&
+        !(op->arg1 >= XM && op->arg1 <= XM128) && op->arg1 != XMMONLY && op->arg1 != XMM && op->arg1 != XMMH)
+        return NULL;    /* popcnt, movbe, movnti */
+    return op;
+}
+
+/* whether an instruction we don't know has an imm8, going by the opcode */
+static int vex_has_imm8(byte map, byte opcode) {
+    if (map == 3)
+        return 1;
+    if (map == 1)
+        return (opcode >= 0x70 && opcode <= 0x73) || opcode == 0xC2 || (opcode >= 0xC4 && opcode <= 0xC6);
+    return 0;
+}
+
+/* Decode a VEX (C4, C5) or EVEX (62) prefix and find the instruction it
+ * introduces. Returns the length of the prefix; the opcode byte itself is
+ * counted by the caller. */
+static int get_vex_instr(const byte *p, struct instr *instr, int bits) {
+    byte map, pp, vvvv, r, x, b, w = 0;
+    const struct op *op = NULL;
+    int len;
+
+    instr->vex = 1;
+    if (p[0] == 0xC5) {
+        r = !(p[1] & 0x80);
+        x = b = 0;
+        map = 1;
+        vvvv = (~p[1] >> 3) & 0xF;
+        instr->vex_l = (p[1] >> 2) & 1;
+        pp = p[1] & 3;
+        len = 2;
+    } else {
+        r = !(p[1] & 0x80);
+        x = !(p[1] & 0x40);
+        b = !(p[1] & 0x20);
+        w = p[2] >> 7;
+        vvvv = (~p[2] >> 3) & 0xF;
+        pp = p[2] & 3;
+        if (p[0] == 0xC4) {
+            map = p[1] & 0x1F;
+            instr->vex_l = (p[2] >> 2) & 1;
+            len = 3;
+        } else {
+            instr->evex = 1;
+            map = p[1] & 7;
+            instr->evex_z = p[3] >> 7;
+            instr->vex_l = (p[3] >> 5) & 3;
+            instr->evex_b = (p[3] >> 4) & 1;
+            instr->evex_aaa = p[3] & 7;
+            if (bits == 64) {
+                instr->evex_r = !(p[1] & 0x10);
+                if (!(p[3] & 0x08)) vvvv |= 0x10;
+            }
+            len = 4;
         }
     }
-    if (!instr->op.name[0])
-        len = get_sse_instr(p, instr);
 
-    instr->op.opcode = 0x0F00 | p[0];
+    /* outside of 64-bit mode only eight registers are encodable */
+    if (bits == 64) {
+        if (r) instr->prefix |= PREFIX_REXR;
+        if (x) instr->prefix |= PREFIX_REXX;
+        if (b) instr->prefix |= PREFIX_REXB;
+        if (w) instr->prefix |= PREFIX_REXW;
+    } else
+        vvvv &= 7;
+    instr->vex_reg = vvvv;
+    instr->vex_w = w;
+
+    p += len;
+    /* only maps 1-3 are defined; EVEX has room for 4-7 and VEX for up to 31,
+     * but they're reserved */
+    if (map < 1 || map > 3)
+        op = &unknown_vex_op;
+    if (!op && map == 1 && p[0] == 0x77 && pp == 0 && !instr->evex)
+        op = instr->vex_l ? &vzeroall_op : &vzeroupper_op;
+    if (!op && map == 2 && p[0] == 0xF3 && pp == 0 && !instr->evex && REGOF(p[1]) >= 1 && REGOF(p[1]) <= 3)
+        op = &instructions_vex_38F3[REGOF(p[1]) - 1];
+    if (!op && instr->evex)
+        op = find_vex_op(&evex_tables[pp], map, p, w);
+    if (!op)
+        op = find_vex_op(&vex_tables[pp], map, p, w);
+    if (!op && (op = find_vex_sse_op(map, p, pp, instr)))
+        instr->vex_sse = 1;
+    if (!op)
+        op = vex_has_imm8(map, p[0]) ? &unknown_vex_imm_op : &unknown_vex_op;
+
+    instr->op = op;
+    if (map == 1) {
+        instr->opcode = 0x0F00 | p[0];
+        instr->subcode = op->subcode;
+    } else if (map == 2 || map == 3) {
+        instr->opcode = (map == 2) ? 0x0F38 : 0x0F3A;
+        instr->subcode = p[0];
+    } else {
+        /* anything but the raw byte, which could look like a prefix */
+        instr->opcode = 0x0F00 | map;
+        instr->subcode = p[0];
+    }
+
+    if (op->flags & OP_NOVVVV)
+        instr->vex_vvvv = VVVV_NONE;
+    else if (op->flags & OP_VVVV_DST)
+        instr->vex_vvvv = VVVV_FIRST;
+    else if (op->flags & OP_VVVV_LAST)
+        instr->vex_vvvv = VVVV_LAST;
+    else if (op->flags & OP_VVVV)
+        instr->vex_vvvv = VVVV_SECOND;
+    else if (op->flags & OP_VVVV_REG)
+        instr->vex_vvvv = (MODOF(p[1]) == 3) ? VVVV_SECOND : VVVV_NONE;
+    else if (op->arg0 == XMM)
+        instr->vex_vvvv = VVVV_SECOND;
+    else if (op->arg0 == XMMONLY)   /* shifts by an immediate */
+        instr->vex_vvvv = VVVV_FIRST;
+
     return len;
 }
 
+/* Size of the memory operand, by which EVEX scales an 8-bit displacement.
+ * This covers full-vector, half-vector, broadcast, and scalar operands; the
+ * rarer tuple types come out wrong. */
+static int evex_disp_scale(const struct instr *instr, enum argtype type) {
+    if (instr->evex_b || (instr->op->flags & (OP_SCALAR | OP_VSIB)))
+        return instr->vex_w ? 8 : 4;
+    if (type == XM128)
+        return 16;
+    if (type == XMH)
+        return 8 << instr->vex_l;
+    return 16 << instr->vex_l;
+}
+
 /* Parameters:
  * ip      - [i] NOT current IP, but rather IP of the *argument*. This
  *               is necessary for REL to work right.
  * p       - [i] pointer to the current argument to be parsed
- * arg     - [i/o] pointer to the relevant arg struct
- *      ->ip         [o]
- *      ->value      [o]
- *      ->type       [i]
+ * i       - [i] which argument to parse
  * instr   - [i/o] pointer to the relevant instr struct
+ *      ->args[i]    [o]
+ *      ->argoff[i]  [o]
+ *      ->argtype[i] [i]
+ *      ->ip         [i]
  *      ->prefix     [i]
  *      ->op         [i]
  *      ->modrm_disp [o]
@@ -1614,72 +2222,79 @@ static int get_0f_instr(const byte *p, struct instr *instr) {
  * Does not process specific arguments (e.g. registers, DSBX, ONE...)
  * The parameter out is given as a dword but may require additional casting.
  */
-static int get_arg(dword ip, const byte *p, struct arg *arg, struct instr *instr, int bits) {
-    arg->value = 0;
+static int get_arg(dword ip, const byte *p, int i, struct instr *instr, int bits) {
+    qword *value = &instr->args[i];
 
-    switch (arg->type) {
+    switch (instr->argtype[i]) {
     case IMM8:
-        arg->ip = ip;
-        arg->value = *p;
+        instr->argoff[i] = ip - instr->ip;
+        *value = *p;
+        return 1;
+    case IS4:
+        instr->argoff[i] = ip - instr->ip;
+        *value = (*p >> 4) & ((bits == 64) ? 0xF : 7);
         return 1;
     case IMM16:
-        arg->ip = ip;
-        arg->value = *((word *) p);
+        instr->argoff[i] = ip - instr->ip;
+        *value = *((word *) p);
         return 2;
     case IMM:
-        arg->ip = ip;
-        if (instr->op.size == 8) {
-            arg->value = *p;
+        instr->argoff[i] = ip - instr->ip;
+        if (instr->size == 8) {
+            *value = *p;
             return 1;
-        } else if (instr->op.size == 16) {
-            arg->value = *((word *) p);
+        } else if (instr->size == 16) {
+            *value = *((word *) p);
             return 2;
-        } else if (instr->op.size == 64 && (instr->op.flags & OP_IMM64)) {
-            arg->value = *((qword *) p);
+        } else if (instr->size == 64 && (instr->op->flags & OP_IMM64)) {
+            *value = *((qword *) p);
             return 8;
         } else {
-            arg->value = *((dword *) p);
+            *value = *((dword *) p);
             return 4;
         }
     case REL8:
-        arg->ip = ip;
-        arg->value = ip+1+*((int8_t *) p);  /* signed */
+        instr->argoff[i] = ip - instr->ip;
+        *value = ip+1+*((int8_t *) p);  /* signed */
         return 1;
     case REL:
-        arg->ip = ip;
+        instr->argoff[i] = ip - instr->ip;
         /* Equivalently signed or unsigned (i.e. clipped) */
-        if (instr->op.size == 16) {
-            arg->value = (ip+2+*((word *) p)) & 0xffff;
+        if (instr->size == 16) {
+            *value = (ip+2+*((word *) p)) & 0xffff;
             return 2;
         } else {
-            arg->value = (ip+4+*((dword *) p)) & 0xffffffff;
+            *value = (ip+4+*((dword *) p)) & 0xffffffff;
             return 4;
         }
     case SEGPTR:
-        arg->ip = ip;
-        if (instr->op.size == 16) {
-            arg->value = *((word *) p);
+        instr->argoff[i] = ip - instr->ip;
+        if (instr->size == 16) {
+            *value = *((word *) p);
             return 4;
         } else {
-            arg->value = *((dword *) p);
+            *value = *((dword *) p);
             return 6;
         }
     case MOFFS:
-        arg->ip = ip;
+        instr->argoff[i] = ip - instr->ip;
+        instr->usedmem = 1;
         if (instr->addrsize == 64) {
-            arg->value = *((qword *) p);
+            *value = *((qword *) p);
             return 8;
         } else if (instr->addrsize == 32) {
-            arg->value = *((dword *) p);
+            *value = *((dword *) p);
             return 4;
         } else {
-            arg->value = *((word *) p);
+            *value = *((word *) p);
             return 2;
         }
     case RM:
     case MEM:
     case MM:
     case XM:
+    case XMH:
+    case XM128:
     {
         byte mod = MODOF(*p);
         byte rm  = MEMOF(*p);
@@ -1689,35 +2304,44 @@ static int get_arg(dword ip, const byte *p, struct arg *arg, struct instr *instr
             instr->modrm_disp = DISP_REG;
             instr->modrm_reg = rm;
             if (instr->prefix & PREFIX_REXB) instr->modrm_reg += 8;
+            /* EVEX.X extends a vector register to 32 */
+            if (instr->evex && (instr->prefix & PREFIX_REXX) && instr->argtype[i] >= XM && instr->argtype[i] <= XM128)
+                instr->modrm_reg += 16;
             return 1;
         }
 
+        instr->usedmem = 1;
+
         if (instr->addrsize != 16 && rm == 4) {
             /* SIB byte */
             p++;
             instr->sib_scale = 1 << MODOF(*p);
             instr->sib_index = REGOF(*p);
             if (instr->prefix & PREFIX_REXX) instr->sib_index += 8;
-            if (instr->sib_index == 4) instr->sib_index = -1;
+            if (instr->op->flags & OP_VSIB) {
+                /* a vector index, which EVEX.V' extends to 32 */
+                if (instr->evex && (instr->vex_reg & 0x10)) instr->sib_index += 16;
+            } else if (instr->sib_index == 4)
+                instr->sib_index = -1;
             rm = MEMOF(*p);
             ret++;
         }
 
         if (mod == 0 && bits == 64 && rm == 5 && !instr->sib_scale) {
             /* IP-relative addressing... */
-            arg->ip = ip + 1;
-            arg->value = *((dword *) (p+1));
+            instr->argoff[i] = ip + 1 - instr->ip;
+            *value = *((dword *) (p+1));
             instr->modrm_disp = DISP_16;
             instr->modrm_reg = 16;
             ret += 4;
         } else if (mod == 0 && ((instr->addrsize == 16 && rm == 6) ||
                                 (instr->addrsize != 16 && rm == 5))) {
-            arg->ip = ip + 1;
+            instr->argoff[i] = ip + 1 - instr->ip;
             if (instr->addrsize == 16) {
-                arg->value = *((word *) (p+1));
+                *value = *((word *) (p+1));
                 ret += 2;
             } else {
-                arg->value = *((dword *) (p+1));
+                *value = *((dword *) (p+1));
                 ret += 4;
             }
             instr->modrm_disp = DISP_16;
@@ -1727,19 +2351,19 @@ static int get_arg(dword ip, const byte *p, struct arg *arg, struct instr *instr
             instr->modrm_reg = rm;
             if (instr->prefix & PREFIX_REXB) instr->modrm_reg += 8;
         } else if (mod == 1) {
-            arg->ip = ip + 1;
-            arg->value = *(p+1);
+            instr->argoff[i] = ip + 1 - instr->ip;
+            *value = *(p+1);
             instr->modrm_disp = DISP_8;
             instr->modrm_reg = rm;
             if (instr->prefix & PREFIX_REXB) instr->modrm_reg += 8;
             ret += 1;
         } else if (mod == 2) {
-            arg->ip = ip + 1;
+            instr->argoff[i] = ip + 1 - instr->ip;
             if (instr->addrsize == 16) {
-                arg->value = *((word *) (p+1));
+                *value = *((word *) (p+1));
                 ret += 2;
             } else {
-                arg->value = *((dword *) (p+1));
+                *value = *((dword *) (p+1));
                 ret += 4;
             }
             instr->modrm_disp = DISP_16;
@@ -1750,26 +2374,37 @@ static int get_arg(dword ip, const byte *p, struct arg *arg, struct instr *instr
     }
     case REG:
     case XMM:
+    case XMMH:
     case CR32:
     case DR32:
     case TR32:  /* doesn't exist in 64-bit mode */
-        arg->value = REGOF(*p);
+        *value = REGOF(*p);
         if (instr->prefix & PREFIX_REXR)
-            arg->value += 8;
+            *value += 8;
+        if (instr->evex_r && (instr->argtype[i] == XMM || instr->argtype[i] == XMMH))
+            *value += 16;
         return 0;
     case MMX:
+    case KREG:
     case SEG16:
-        arg->value = REGOF(*p);
+        *value = REGOF(*p);
         return 0;
     case REG32:
     case STX:
     case REGONLY:
     case MMXONLY:
     case XMMONLY:
-        arg->value = MEMOF(*p);
+        *value = MEMOF(*p);
         if (instr->prefix & PREFIX_REXB)
-            arg->value += 8;
+            *value += 8;
+        if (instr->evex && (instr->prefix & PREFIX_REXX) && instr->argtype[i] == XMMONLY)
+            *value += 16;
         return 1;
+    case DSBX:
+    case DSSI:
+    case ESDI:
+        instr->usedmem = 1;
+        return 0;
     /* all others should be implicit */
     default:
         return 0;
@@ -1800,21 +2435,21 @@ static const char reg64[17][4] = {
     "rax","rcx","rdx","rbx","rsp","rbp","rsi","rdi","r8","r9","r10","r11","r12","r13","r14","r15","rip"
 };
 
-static void get_seg16(char *out, byte reg) {
-    if (asm_syntax == GAS)
+static void get_seg16(char *out, byte reg, enum asm_syntax syntax) {
+    if (syntax == GAS)
         strcat(out, "%");
     strcat(out, seg16[reg]);
 }
 
-static void get_reg8(char *out, byte reg, int rex) {
-    if (asm_syntax == GAS)
+static void get_reg8(char *out, byte reg, int rex, enum asm_syntax syntax) {
+    if (syntax == GAS)
         strcat(out, "%");
     strcat(out, rex ? reg8_rex[reg] : reg8[reg]);
 }
 
-static void get_reg16(char *out, byte reg, int size) {
+static void get_reg16(char *out, byte reg, int size, enum asm_syntax syntax) {
     if (reg != -1) {
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         if (size == 16)
             strcat(out, reg16[reg]);
@@ -1825,15 +2460,28 @@ static void get_reg16(char *out, byte reg, int size) {
     }
 }
 
-static void get_xmm(char *out, byte reg) {
-    if (asm_syntax == GAS)
-        strcat(out, "%");
-    strcat(out, "xmm0");
-    out[strlen(out)-1] = '0'+reg;
+/* xmm, ymm, or zmm register, by width in bits */
+static void get_vreg(char *out, byte reg, int width, enum asm_syntax syntax) {
+    sprintf(out+strlen(out), "%s%cmm%d", (syntax == GAS) ? "%" : "",
+            (width == 512) ? 'z' : (width == 256) ? 'y' : 'x', reg);
+}
+
+/* width of a vector operand of the given type */
+static int vector_width(const struct instr *instr, enum argtype type) {
+    int l = instr->vex_l;
+
+    /* with a register operand, EVEX.b makes L'L a rounding mode */
+    if (instr->evex && instr->evex_b && instr->modrm_disp == DISP_REG)
+        l = 2;
+    if ((instr->op->flags & OP_SCALAR) || type == XM128 || l > 2)
+        return 128;
+    if ((type == XMH || type == XMMH) && l)
+        l--;
+    return 128 << l;
 }
 
-static void get_mmx(char *out, byte reg) {
-    if (asm_syntax == GAS)
+static void get_mmx(char *out, byte reg, enum asm_syntax syntax) {
+    if (syntax == GAS)
         strcat(out, "%");
     strcat(out, "mm0");
     out[strlen(out)-1] = '0'+reg;
@@ -1847,6 +2495,14 @@ static const char modrm16_masm[8][6] = {
     "bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "bp", "bx"
 };
 
+/* index register of a SIB byte; a vector register for gathers and scatters */
+static void get_sib_index(char *out, const struct instr *instr, enum argtype type, enum asm_syntax syntax) {
+    if (instr->op->flags & OP_VSIB)
+        get_vreg(out, instr->sib_index, vector_width(instr, type), syntax);
+    else
+        get_reg16(out, instr->sib_index, instr->addrsize, syntax);
+}
+
 /* Figure out whether it's a register, so we know whether to dispense with size
  * indicators on a memory access. */
 static int is_reg(enum argtype arg) {
@@ -1863,112 +2519,125 @@ static int is_reg(enum argtype arg) {
 
 /* With MASM/NASM, use capital letters to help disambiguate them from the following 'h'. */
 
-static void print_arg(char *ip, struct instr *instr, int i, int bits) {
-    struct arg *arg = &instr->args[i];
-    char *out = arg->string;
-    qword value = arg->value;
+/* Renders argument i of instr into out, which must hold 2 * ARG_LEN bytes; print_arg() below is the bounded
+ * interface. Doesn't modify instr, so the same decoded instruction can be printed in any syntax. If label is not
+ * NULL, it stands in for the address the argument refers to (immediate, branch target, or displacement), and must
+ * be shorter than ARG_LEN. */
+static void render_arg(const char *ip, const struct instr *instr, int i, int bits, enum asm_syntax syntax, const char *label, char *out) {
+    qword value = instr->args[i];
+    enum argtype type = instr->argtype[i];
 
-    if (arg->string[0]) return; /* someone wants to print something special */
+    out[0] = 0;
 
-    if (arg->type >= AL && arg->type <= BH)
-        get_reg8(out, arg->type-AL, 0);
-    else if (arg->type >= AX && arg->type <= DI)
-        get_reg16(out, arg->type-AX + ((instr->prefix & PREFIX_REXB) ? 8 : 0), instr->op.size);
-    else if (arg->type >= ES && arg->type <= GS)
-        get_seg16(out, arg->type-ES);
+    if (type >= AL && type <= BH)
+        get_reg8(out, type-AL, 0, syntax);
+    else if (type >= AX && type <= DI)
+        get_reg16(out, type-AX + ((instr->prefix & PREFIX_REXB) ? 8 : 0), instr->size, syntax);
+    else if (type >= ES && type <= GS)
+        get_seg16(out, type-ES, syntax);
 
-    switch (arg->type) {
+    switch (type) {
     case ONE:
-        strcat(out, (asm_syntax == GAS) ? "$0x1" : "1h");
+        strcat(out, (syntax == GAS) ? "$0x1" : "1h");
         break;
     case IMM8:
-        if (instr->op.flags & OP_STACK) { /* 6a */
-            if (instr->op.size == 64)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%016lx" : "qword %016lxh", (qword) (int8_t) value);
-            else if (instr->op.size == 32)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%08x" : "dword %08Xh", (dword) (int8_t) value);
+        if (instr->op->flags & OP_STACK) { /* 6a */
+            if (instr->size == 64)
+                sprintf(out, (syntax == GAS) ? "$0x%016lx" : "qword %016lxh", (qword) (int8_t) value);
+            else if (instr->size == 32)
+                sprintf(out, (syntax == GAS) ? "$0x%08x" : "dword %08Xh", (dword) (int8_t) value);
             else
-                sprintf(out, (asm_syntax == GAS) ? "$0x%04x" : "word %04Xh", (word) (int8_t) value);
+                sprintf(out, (syntax == GAS) ? "$0x%04x" : "word %04Xh", (word) (int8_t) value);
         } else
-            sprintf(out, (asm_syntax == GAS) ? "$0x%02lx" : "%02lXh", value);
+            sprintf(out, (syntax == GAS) ? "$0x%02lx" : "%02lXh", value);
         break;
     case IMM16:
-        sprintf(out, (asm_syntax == GAS) ? "$0x%04lx" : "%04lXh", value);
+        sprintf(out, (syntax == GAS) ? "$0x%04lx" : "%04lXh", value);
         break;
     case IMM:
-        if (instr->op.flags & OP_STACK) {
-            if (instr->op.size == 64)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%016lx" : "qword %016lXh", value);
-            else if (instr->op.size == 32)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%08lx" : "dword %08lXh", value);
+        if (label) {
+            sprintf(out, (syntax == GAS) ? "$%s" : (syntax == MASM) ? "offset %s" : "%s", label);
+        } else if (instr->op->flags & OP_STACK) {
+            if (instr->size == 64)
+                sprintf(out, (syntax == GAS) ? "$0x%016lx" : "qword %016lXh", value);
+            else if (instr->size == 32)
+                sprintf(out, (syntax == GAS) ? "$0x%08lx" : "dword %08lXh", value);
             else
-                sprintf(out, (asm_syntax == GAS) ? "$0x%04lx" : "word %04lXh", value);
+                sprintf(out, (syntax == GAS) ? "$0x%04lx" : "word %04lXh", value);
         } else {
-            if (instr->op.size == 8)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%02lx" : "%02lXh", value);
-            else if (instr->op.size == 16)
-                sprintf(out, (asm_syntax == GAS) ? "$0x%04lx" : "%04lXh", value);
-            else if (instr->op.size == 64 && (instr->op.flags & OP_IMM64))
-                sprintf(out, (asm_syntax == GAS) ? "$0x%016lx" : "%016lXh", value);
+            if (instr->size == 8)
+                sprintf(out, (syntax == GAS) ? "$0x%02lx" : "%02lXh", value);
+            else if (instr->size == 16)
+                sprintf(out, (syntax == GAS) ? "$0x%04lx" : "%04lXh", value);
+            else if (instr->size == 64 && (instr->op->flags & OP_IMM64))
+                sprintf(out, (syntax == GAS) ? "$0x%016lx" : "%016lXh", value);
+            else if (instr->size == 64 && (value & 0x80000000))    /* sign-extended */
+                sprintf(out, (syntax == GAS) ? "$0x%016lx" : "%016lXh", (qword) (int32_t) value);
             else
-                sprintf(out, (asm_syntax == GAS) ? "$0x%08lx" : "%08lXh", value);
+                sprintf(out, (syntax == GAS) ? "$0x%08lx" : "%08lXh", value);
         }
         break;
     case REL8:
     case REL:
-        sprintf(out, "%04lx", value);
+        if (label)
+            strcpy(out, label);
+        else
+            sprintf(out, "%04lx", value);
         break;
     case SEGPTR:
         /* should always be relocated */
         break;
     case MOFFS:
-        if (asm_syntax == GAS) {
+        if (syntax == GAS) {
             if (instr->prefix & PREFIX_SEG_MASK) {
-                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1);
+                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1, syntax);
                 strcat(out, ":");
             }
-            sprintf(out+strlen(out), "0x%04lx", value);
+            if (label)
+                strcat(out, label);
+            else
+                sprintf(out+strlen(out), "0x%04lx", value);
         } else {
-            out[0] = '[';
+            strcat(out, "[");
             if (instr->prefix & PREFIX_SEG_MASK) {
-                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1);
+                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1, syntax);
                 strcat(out, ":");
             }
-            sprintf(out+strlen(out), "%04lXh]", value);
+            if (label)
+                sprintf(out+strlen(out), "%s]", label);
+            else
+                sprintf(out+strlen(out), "%04lXh]", value);
         }
-        instr->usedmem = 1;
         break;
     case DSBX:
     case DSSI:
-        if (asm_syntax != NASM) {
+        if (syntax != NASM) {
             if (instr->prefix & PREFIX_SEG_MASK) {
-                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1);
+                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1, syntax);
                 strcat(out, ":");
             }
-            strcat(out, (asm_syntax == GAS) ? "(" : "[");
-            get_reg16(out, (arg->type == DSBX) ? 3 : 6, instr->addrsize);
-            strcat(out, (asm_syntax == GAS) ? ")" : "]");
+            strcat(out, (syntax == GAS) ? "(" : "[");
+            get_reg16(out, (type == DSBX) ? 3 : 6, instr->addrsize, syntax);
+            strcat(out, (syntax == GAS) ? ")" : "]");
         }
-        instr->usedmem = 1;
         break;
     case ESDI:
-        if (asm_syntax != NASM) {
-            strcat(out, (asm_syntax == GAS) ? "%es:(" : "es:[");
-            get_reg16(out, 7, instr->addrsize);
-            strcat(out, (asm_syntax == GAS) ? ")" : "]");
+        if (syntax != NASM) {
+            strcat(out, (syntax == GAS) ? "%es:(" : "es:[");
+            get_reg16(out, 7, instr->addrsize, syntax);
+            strcat(out, (syntax == GAS) ? ")" : "]");
         }
-        instr->usedmem = 1;
         break;
     case ALS:
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcpy(out, "%al");
         break;
     case AXS:
-        if (asm_syntax == GAS)
-            strcpy(out, "%ax");
+        if (syntax == GAS)
+            get_reg16(out, 0, instr->size, syntax);
         break;
     case DXS:
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcpy(out, "(%dx)");
         else
             strcpy(out, "dx");
@@ -1981,46 +2650,52 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
     case MEM:
     case MM:
     case XM:
+    case XMH:
+    case XM128:
         if (instr->modrm_disp == DISP_REG) {
-            if (arg->type == XM) {
-                get_xmm(out, instr->modrm_reg);
-                if (instr->vex_256)
-                    out[asm_syntax == GAS ? 1 : 0] = 'y';
+            if (syntax == GAS && instr->opcode == 0xFF && instr->subcode >= 2 && instr->subcode <= 5)
+                strcat(out, "*");
+            if (type == XM || type == XMH || type == XM128) {
+                get_vreg(out, instr->modrm_reg, vector_width(instr, type), syntax);
                 break;
-            } else if (arg->type == MM) {
-                get_mmx(out, instr->modrm_reg);
+            } else if (type == MM) {
+                get_mmx(out, instr->modrm_reg, syntax);
                 break;
             }
 
-            if (arg->type == MEM)
+            if (type == MEM)
                 warn_at("ModRM byte has mod 3, but opcode only allows accessing memory.\n");
 
-            if (instr->op.size == 8 || instr->op.opcode == 0x0FB6 || instr->op.opcode == 0x0FBE) { /* mov*b* */
-                get_reg8(out, instr->modrm_reg, instr->prefix & PREFIX_REX);
-            } else if (instr->op.opcode == 0x0FB7 || instr->op.opcode == 0x0FBF) /* mov*w* */
-                get_reg16(out, instr->modrm_reg, 16);   /* fixme: 64-bit? */
+            if (instr->size == 8 || instr->opcode == 0x0FB6 || instr->opcode == 0x0FBE) { /* mov*b* */
+                get_reg8(out, instr->modrm_reg, instr->prefix & PREFIX_REX, syntax);
+            } else if (instr->opcode == 0x0FB7 || instr->opcode == 0x0FBF) /* mov*w* */
+                get_reg16(out, instr->modrm_reg, 16, syntax);   /* fixme: 64-bit? */
+            else if (bits == 64 && instr->opcode == 0x63)   /* movsxd */
+                get_reg16(out, instr->modrm_reg, 32, syntax);
             else
-                get_reg16(out, instr->modrm_reg, instr->op.size);
+                get_reg16(out, instr->modrm_reg, instr->size, syntax);
             break;
         }
 
-        instr->usedmem = 1;
-
         /* NASM: <size>    [<seg>: <reg>+<reg>+/-<offset>h] */
         /* MASM: <size> ptr <seg>:[<reg>+<reg>+/-<offset>h] */
         /* GAS:           *%<seg>:<->0x<offset>(%<reg>,%<reg>) */
 
-        if (asm_syntax == GAS) {
-            if (instr->op.opcode == 0xFF && instr->op.subcode >= 2 && instr->op.subcode <= 5)
+        if (syntax == GAS) {
+            if (instr->opcode == 0xFF && instr->subcode >= 2 && instr->subcode <= 5)
                 strcat(out, "*");
 
             if (instr->prefix & PREFIX_SEG_MASK) {
-                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1);
+                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1, syntax);
                 strcat(out, ":");
             }
 
             /* offset */
-            if (instr->modrm_disp == DISP_8) {
+            if (label && instr->modrm_disp == DISP_16) {
+                strcat(out, label);
+                if (instr->modrm_reg == -1 && !(instr->sib_scale && instr->sib_index != -1))
+                    return;
+            } else if (instr->modrm_disp == DISP_8) {
                 int8_t svalue = (int8_t) value;
                 if (svalue < 0)
                     sprintf(out+strlen(out), "-0x%02x", -svalue);
@@ -2053,10 +2728,10 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
             if (instr->addrsize == 16) {
                 strcat(out, modrm16_gas[instr->modrm_reg]);
             } else {
-                get_reg16(out, instr->modrm_reg, instr->addrsize);
+                get_reg16(out, instr->modrm_reg, instr->addrsize, syntax);
                 if (instr->sib_scale && instr->sib_index != -1) {
                     strcat(out, ",");
-                    get_reg16(out, instr->sib_index, instr->addrsize);
+                    get_sib_index(out, instr, type, syntax);
                     strcat(out, ",0");
                     out[strlen(out)-1] = '0'+instr->sib_scale;
                 }
@@ -2064,10 +2739,10 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
             strcat(out, ")");
         } else {
             int has_sib = (instr->sib_scale != 0 && instr->sib_index != -1);
-            if (instr->op.flags & OP_FAR)
+            if (instr->op->flags & OP_FAR)
                 strcat(out, "far ");
-            else if (!is_reg(instr->op.arg0) && !is_reg(instr->op.arg1)) {
-                switch (instr->op.size) {
+            else if (!is_reg(instr->op->arg0) && !is_reg(instr->op->arg1)) {
+                switch (instr->size) {
                 case  8: strcat(out, "byte "); break;
                 case 16: strcat(out, "word "); break;
                 case 32: strcat(out, "dword "); break;
@@ -2075,45 +2750,54 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
                 case 80: strcat(out, "tword "); break;
                 default: break;
                 }
-                if (asm_syntax == MASM) /* && instr->op.size == 0? */
+                if (syntax == MASM) /* && instr->size == 0? */
                     strcat(out, "ptr ");
-            } else if (instr->op.opcode == 0x0FB6 || instr->op.opcode == 0x0FBE) { /* mov*b* */
+            } else if (instr->opcode == 0x0FB6 || instr->opcode == 0x0FBE) { /* mov*b* */
                 strcat(out,"byte ");
-                if (asm_syntax == MASM)
+                if (syntax == MASM)
                     strcat(out, "ptr ");
-            } else if (instr->op.opcode == 0x0FB7 || instr->op.opcode == 0x0FBF) { /* mov*w* */
+            } else if (instr->opcode == 0x0FB7 || instr->opcode == 0x0FBF) { /* mov*w* */
                 strcat(out,"word ");
-                if (asm_syntax == MASM)
+                if (syntax == MASM)
                     strcat(out, "ptr ");
             }
 
-            if (asm_syntax == NASM)
+            if (syntax == NASM)
                 strcat(out, "[");
 
             if (instr->prefix & PREFIX_SEG_MASK) {
-                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1);
+                get_seg16(out, (instr->prefix & PREFIX_SEG_MASK)-1, syntax);
                 strcat(out, ":");
             }
 
-            if (asm_syntax == MASM)
+            if (syntax == MASM)
                 strcat(out, "[");
 
+            if (label && instr->modrm_disp == DISP_16 && instr->modrm_reg == 16 && !has_sib) {
+                sprintf(out+strlen(out), (syntax == NASM) ? "rel %s]" : "%s]", label);
+                break;
+            }
+
             if (instr->modrm_reg != -1) {
                 if (instr->addrsize == 16)
                     strcat(out, modrm16_masm[instr->modrm_reg]);
                 else
-                    get_reg16(out, instr->modrm_reg, instr->addrsize);
+                    get_reg16(out, instr->modrm_reg, instr->addrsize, syntax);
                 if (has_sib)
                     strcat(out, "+");
             }
 
             if (has_sib) {
-                get_reg16(out, instr->sib_index, instr->addrsize);
+                get_sib_index(out, instr, type, syntax);
                 strcat(out, "*0");
                 out[strlen(out)-1] = '0'+instr->sib_scale;
             }
 
-            if (instr->modrm_disp == DISP_8) {
+            if (label && instr->modrm_disp == DISP_16) {
+                if (instr->modrm_reg != -1 || has_sib)
+                    strcat(out, "+");
+                strcat(out, label);
+            } else if (instr->modrm_disp == DISP_8) {
                 int8_t svalue = (int8_t) value;
                 if (svalue < 0)
                     sprintf(out+strlen(out), "-%02Xh", -svalue);
@@ -2141,20 +2825,22 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
         break;
     case REG:
     case REGONLY:
-        if (instr->op.size == 8)
-            get_reg8(out, value, instr->prefix & PREFIX_REX);
-        else if (bits == 64 && instr->op.opcode == 0x63)
-            get_reg16(out, value, 64);
+        if (instr->size == 8)
+            get_reg8(out, value, instr->prefix & PREFIX_REX, syntax);
+        else if (bits == 64 && instr->opcode == 0x63)
+            get_reg16(out, value, 64, syntax);
         else
-            get_reg16(out, value, instr->op.size);
+            get_reg16(out, value, instr->size, syntax);
         break;
     case REG32:
-        get_reg16(out, value, bits);
+        get_reg16(out, value, bits, syntax);
         break;
     case SEG16:
-        if (value > 5)
+        if (value > 5) {
             warn_at("Invalid segment register %ld\n", value);
-        get_seg16(out, value);
+            strcat(out, "?");
+        } else
+            get_seg16(out, value, syntax);
         break;
     case CR32:
         switch (value) {
@@ -2168,13 +2854,13 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
             warn_at("Invalid control register %ld\n", value);
             break;
         }
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         strcat(out, "cr0");
         out[strlen(out)-1] = '0'+value;
         break;
     case DR32:
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         strcat(out, "dr0");
         out[strlen(out)-1] = '0'+value;
@@ -2182,62 +2868,277 @@ static void print_arg(char *ip, struct instr *instr, int i, int bits) {
     case TR32:
         if (value < 3)
             warn_at("Invalid test register %ld\n", value);
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         strcat(out, "tr0");
         out[strlen(out)-1] = '0'+value;
         break;
     case ST:
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         strcat(out, "st");
-        if (asm_syntax == NASM)
+        if (syntax == NASM)
             strcat(out, "0");
         break;
     case STX:
-        if (asm_syntax == GAS)
+        if (syntax == GAS)
             strcat(out, "%");
         strcat(out, "st");
-        if (asm_syntax != NASM)
+        if (syntax != NASM)
             strcat(out, "(");
         strcat(out, "0");
         out[strlen(out)-1] = '0' + value;
-        if (asm_syntax != NASM)
+        if (syntax != NASM)
             strcat(out, ")");
         break;
     case MMX:
     case MMXONLY:
-        get_mmx(out, value);
+        get_mmx(out, value, syntax);
         break;
     case XMM:
+    case XMMH:
     case XMMONLY:
-        get_xmm(out, value);
-        if (instr->vex_256)
-            out[asm_syntax == GAS ? 1 : 0] = 'y';
+        get_vreg(out, value, vector_width(instr, type), syntax);
+        break;
+    case IS4:
+        get_vreg(out, value, vector_width(instr, XMM), syntax);
+        break;
+    case KREG:
+        sprintf(out, (syntax == GAS) ? "%%k%ld" : "k%ld", value);
         break;
     default:
         break;
     }
 }
 
+/* Writes argument i of instr into out, truncating it to size bytes. Returns
+ * the length of the whole argument, as snprintf() does. A label too long to
+ * fit is ignored. */
+static int print_arg(const char *ip, const struct instr *instr, int i, int bits, enum asm_syntax syntax, const char *label, char *out, size_t size) {
+    char buffer[2 * ARG_LEN];
+    size_t len;
+
+    if (label && strlen(label) >= ARG_LEN)
+        label = NULL;
+    render_arg(ip, instr, i, bits, syntax, label, buffer);
+
+    len = strlen(buffer);
+    if (size) {
+        size_t copy = min(len, size - 1);
+        memcpy(out, buffer, copy);
+        out[copy] = 0;
+    }
+    return len;
+}
+
 /* helper to tack a length suffix onto a name */
-static void suffix_name(struct instr *instr) {
-    if ((instr->op.flags & OP_LL) == OP_LL)
-        strcat(instr->op.name, "ll");
-    else if (instr->op.flags & OP_S)
-        strcat(instr->op.name, "s");
-    else if (instr->op.flags & OP_L)
-        strcat(instr->op.name, "l");
-    else if (instr->op.size == 80)
-        strcat(instr->op.name, "t");
-    else if (instr->op.size == 8)
-        strcat(instr->op.name, "b");
-    else if (instr->op.size == 16)
-        strcat(instr->op.name, "w");
-    else if (instr->op.size == 32)
-        strcat(instr->op.name, (asm_syntax == GAS) ? "l" : "d");
-    else if (instr->op.size == 64)
-        strcat(instr->op.name, "q");
+static void suffix_name(char *name, const struct instr *instr, enum asm_syntax syntax) {
+    if ((instr->op->flags & OP_LL) == OP_LL)
+        strcat(name, "ll");
+    else if (instr->op->flags & OP_S)
+        strcat(name, "s");
+    else if (instr->op->flags & OP_L)
+        strcat(name, "l");
+    else if (instr->size == 80)
+        strcat(name, "t");
+    else if (instr->size == 8)
+        strcat(name, "b");
+    else if (instr->size == 16)
+        strcat(name, "w");
+    else if (instr->size == 32)
+        strcat(name, (syntax == GAS) ? "l" : "d");
+    else if (instr->size == 64)
+        strcat(name, "q");
+}
+
+/* Writes the mnemonic of instr, as spelled in the given syntax, into name
+ * (which must hold at least sizeof(instr->op->name)+2 bytes). The decoder
+ * only ever stores the bare table name. The v of VEX-encoded SSE
+ * instructions isn't included. */
+void get_instr_name(char *name, const struct instr *instr, int bits, enum asm_syntax syntax) {
+    strcpy(name, instr->op->name);
+
+    if (syntax == GAS) {
+        if (instr->opcode == 0x0FB6) {
+            strcpy(name, "movzb");
+            suffix_name(name, instr, syntax);
+        } else if (instr->opcode == 0x0FB7) {
+            strcpy(name, "movzw");
+            suffix_name(name, instr, syntax);
+        } else if (instr->opcode == 0x0FBE) {
+            strcpy(name, "movsb");
+            suffix_name(name, instr, syntax);
+        } else if (instr->opcode == 0x0FBF) {
+            strcpy(name, "movsw");
+            suffix_name(name, instr, syntax);
+        } else if (instr->opcode == 0x63 && bits == 64)
+            strcpy(name, "movslq");
+    }
+
+    if ((instr->op->flags & OP_STACK) && (instr->prefix & PREFIX_OP32))
+        suffix_name(name, instr, syntax);
+    else if ((instr->op->flags & OP_STRING) && syntax != GAS)
+        suffix_name(name, instr, syntax);
+    else if (instr->opcode == 0x98)
+        strcpy(name, instr->size == 16 ? "cbw" : instr->size == 32 ? "cwde" : "cdqe");
+    else if (instr->opcode == 0x99)
+        strcpy(name, instr->size == 16 ? "cwd" : instr->size == 32 ? "cdq" : "cqo");
+    else if (instr->opcode == 0xE3)
+        strcpy(name, instr->size == 16 ? "jcxz" : instr->size == 32 ? "jecxz" : "jrcxz");
+    else if (instr->opcode == 0xD4 && instr->args[0] == 10)
+        strcpy(name, "aam");
+    else if (instr->opcode == 0xD5 && instr->args[0] == 10)
+        strcpy(name, "aad");
+    else if (instr->opcode == 0x0FC7 && instr->subcode == 1 && (instr->prefix & PREFIX_REXW))
+        strcpy(name, "cmpxchg16b");
+    else if ((instr->opcode == 0x0F6E || instr->opcode == 0x0F7E) && instr->op->size == -1)
+        strcpy(name, instr->size == 64 ? "movq" : "movd");
+    else if (instr->opcode == 0x0F3A && (instr->subcode == 0x16 || instr->subcode == 0x22) &&
+             (instr->prefix & PREFIX_REXW))
+        name[strlen(name)-1] = 'q';     /* pextrq, pinsrq */
+    else if (syntax == GAS) {
+        if (instr->op->flags & OP_FAR) {
+            memmove(name+1, name, strlen(name)+1);
+            name[0] = 'l';
+        } else if (instr->op->arg0 && !is_reg(instr->op->arg0) && !is_reg(instr->op->arg1) &&
+                   instr->modrm_disp != DISP_REG && instr->op->arg0 != REL && instr->op->arg0 != REL8)
+            suffix_name(name, instr, syntax);
+    } else if (syntax != GAS && (instr->opcode == 0xCA || instr->opcode == 0xCB))
+        strcat(name, "f");
+}
+
+/* placeholder for anything we can't decode */
+static const struct op unknown_op = {0, 0, 0, "?"}; /* less arrogant than objdump's (bad) */
+
+/* placeholder for anything newer than --isa; we're probably looking at data */
+static const struct op invalid_op = {0, 0, 0, "?", 0, 0, OP_STOP};
+
+#define IN_TABLE(op, t) ((op) >= (t) && (op) < (t) + sizeof(t)/sizeof(struct op))
+
+/* The first instruction set an instruction appeared in, as finely as --isa
+ * needs and no finer: extensions from other vendors are lumped in with their
+ * Intel contemporaries, and a few rarely used instructions are approximate. */
+static enum isa instr_isa(const struct instr *instr) {
+    const struct op *op = instr->op;
+    byte opcode = instr->opcode & 0xFF;
+    byte sub = instr->subcode;
+    word seg = instr->prefix & PREFIX_SEG_MASK;
+    enum isa level = ISA_8086;
+
+    if ((instr->prefix & (PREFIX_OP32 | PREFIX_ADDR32)) || seg == PREFIX_FS || seg == PREFIX_GS)
+        level = ISA_386;
+
+    if (instr->evex)
+        return ISA_AVX512;
+    if (instr->vex) {
+        if (instr->vex_sse)     /* integer ops were widened to 256 bits in AVX2 */
+            return (instr->vex_l && op->name[0] == 'p') ? ISA_AVX2 : ISA_AVX;
+        if (instr->opcode == 0x0F77)
+            return ISA_AVX;
+        if (instr->opcode == 0x0F38 && ((sub >= 0x0C && sub <= 0x0F) || sub == 0x13 ||
+                (sub >= 0x18 && sub <= 0x1A) || (sub >= 0x2C && sub <= 0x2F)))
+            return ISA_AVX;
+        if (instr->opcode == 0x0F3A && ((sub >= 0x04 && sub <= 0x06) || sub == 0x18 ||
+                sub == 0x19 || sub == 0x1D || (sub >= 0x4A && sub <= 0x4C)))
+            return ISA_AVX;
+        return ISA_AVX2;
+    }
+
+    if (instr->opcode < 0x100) {
+        if (IN_TABLE(op, instructions_fpu_single)) {
+            if (op->opcode == 0xDB && op->subcode == 0xE4)
+                return max(level, ISA_286);
+            if ((op->opcode == 0xD9 && (op->subcode == 0xF5 || op->subcode >= 0xFB)) ||
+                    (op->opcode == 0xDA && op->subcode == 0xE9))
+                return max(level, ISA_386);
+        } else if (IN_TABLE(op, instructions_fpu_r)) {
+            if ((opcode == 0xDA || opcode == 0xDB) && op->subcode <= 3)
+                return max(level, ISA_P6);
+            if ((opcode == 0xDB || opcode == 0xDF) && (op->subcode == 5 || op->subcode == 6))
+                return max(level, ISA_P6);
+            if (opcode == 0xDD && (op->subcode == 4 || op->subcode == 5))
+                return max(level, ISA_386);
+        } else if (IN_TABLE(op, instructions_fpu_m)) {
+            if ((opcode == 0xDB || opcode == 0xDD || opcode == 0xDF) && op->subcode == 1)
+                return ISA_SSE3;    /* fisttp */
+        } else if ((opcode >= 0x60 && opcode <= 0x62) || (opcode >= 0x68 && opcode <= 0x6F) ||
+                   opcode == 0xC0 || opcode == 0xC1 || opcode == 0xC8 || opcode == 0xC9) {
+            return max(level, ISA_186);
+        } else if (opcode == 0x63) {
+            return max(level, ISA_286);
+        }
+        return level;
+    }
+
+    /* three-byte opcodes */
+    if (instr->opcode == 0x0F38 || instr->opcode == 0x0F3A) {
+        if ((instr->opcode == 0x0F38 && (sub <= 0x0B || (sub >= 0x1C && sub <= 0x1E))) ||
+                (instr->opcode == 0x0F3A && sub == 0x0F))
+            return ISA_SSSE3;
+        return ISA_SSE4;
+    }
+
+    if (IN_TABLE(op, instructions_0F)) {
+        if (opcode == 0x01 && op->subcode == 7)
+            return max(level, ISA_486);     /* invlpg */
+        if (opcode <= 0x06)
+            return (opcode == 0x05) ? ISA_P6 : max(level, ISA_286);
+        if (opcode == 0x08 || opcode == 0x09 || (opcode >= 0xB0 && opcode <= 0xB1) ||
+                opcode == 0xC0 || opcode == 0xC1 || opcode >= 0xC8)
+            return max(level, ISA_486);
+        if ((opcode >= 0x30 && opcode <= 0x32) || opcode == 0xA2 || opcode == 0xC7)
+            return max(level, ISA_586);
+        if (opcode == 0x18)
+            return ISA_SSE;
+        if (opcode == 0xAE)     /* fxsave, ldmxcsr, xsave, clflush */
+            return (op->subcode <= 1) ? ISA_P6 : (op->subcode <= 3) ? ISA_SSE :
+                   (op->subcode <= 5) ? ISA_AVX : ISA_SSE2;
+        if (opcode >= 0x20 && opcode <= 0x26)
+            return ISA_386;
+        if (opcode >= 0x80 && opcode <= 0xBF)
+            return max(level, ISA_386);
+        return max(level, ISA_P6);  /* sysret, prefetch, nop, rdpmc, sysenter, cmov */
+    }
+    if (IN_TABLE(op, instructions_0F01_reg))
+        return ISA_SSE3;
+    if (IN_TABLE(op, instructions_0FAE_reg))
+        return (sub == 7) ? ISA_SSE : ISA_SSE2;
+
+    if (IN_TABLE(op, instructions_sse)) {
+        if (op->arg0 == MMX || op->arg0 == MM || op->arg1 == MMX || op->arg1 == MM ||
+                op->arg1 == MMXONLY) {
+            if (opcode == 0xD4 || opcode == 0xF4 || opcode == 0xFB)
+                return ISA_SSE2;
+            if (opcode == 0x2A || opcode == 0x2C || opcode == 0x2D || opcode == 0x70 ||
+                    opcode == 0xC4 || opcode == 0xC5 || opcode == 0xD7 || opcode == 0xDA ||
+                    opcode == 0xDE || opcode == 0xE0 || opcode == 0xE3 || opcode == 0xE4 ||
+                    opcode == 0xE7 || opcode == 0xEA || opcode == 0xEE || opcode == 0xF6 ||
+                    opcode == 0xF7)
+                return ISA_SSE;
+            return max(level, ISA_P6);
+        }
+        return (opcode == 0x5A || opcode == 0x5B || opcode == 0xC3) ? ISA_SSE2 : ISA_SSE;
+    }
+    if (IN_TABLE(op, instructions_sse_op32))
+        return (opcode == 0x7C || opcode == 0x7D || opcode == 0xD0) ? ISA_SSE3 : ISA_SSE2;
+    if (IN_TABLE(op, instructions_sse_repne))
+        return (opcode == 0x12 || opcode == 0x7C || opcode == 0x7D || opcode == 0xD0 ||
+                opcode == 0xF0) ? ISA_SSE3 : ISA_SSE2;
+    if (IN_TABLE(op, instructions_sse_repe)) {
+        if (opcode == 0x12 || opcode == 0x16)
+            return ISA_SSE3;
+        if (opcode == 0xB8)
+            return ISA_SSE4;
+        if (opcode == 0xBC || opcode == 0xBD)
+            return ISA_AVX2;
+        if (opcode == 0x10 || opcode == 0x11 || opcode == 0x2A || opcode == 0x2C ||
+                opcode == 0x2D || (opcode >= 0x51 && opcode <= 0x53) || opcode == 0x58 ||
+                opcode == 0x59 || (opcode >= 0x5C && opcode <= 0x5F) || opcode == 0xC2)
+            return ISA_SSE;
+        return ISA_SSE2;
+    }
+
+    return level;   /* unknown_op */
 }
 
 /* Paramters:
@@ -2252,6 +3153,10 @@ static void suffix_name(struct instr *instr) {
  * while actually dumping output, both to keep this function agnostic and to
  * ensure they only get printed once), so we will need to watch out for
  * multiple prefixes, invalid instructions, etc.
+ *
+ * Nor does anything here depend on the output syntax; mnemonics are spelled
+ * and arguments formatted by print_instr(), so the result can be cached or
+ * printed more than once.
  */
 int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
     int len = 0;
@@ -2259,16 +3164,28 @@ int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
     word prefix;
 
     memset(instr, 0, sizeof(*instr));
+    instr->ip = ip;
 
     while ((prefix = get_prefix(p[len], bits))) {
-        if ((instr->prefix & PREFIX_SEG_MASK) && (prefix & PREFIX_SEG_MASK)) {
-            instr->op = instructions[p[len]];
+        if (len == MAX_INSTR - 1) {
+            /* No instruction is this long; don't read past the window.
+             * Treat the last prefix as the opcode, like a repeated one. */
+            instr->op = &invalid_op;
+            instr->opcode = p[len-1];
+            return len;
+        }
+        if (!instr->prefix) {
+            /* the usual case; there's nothing to clash with yet */
+        } else if ((instr->prefix & PREFIX_SEG_MASK) && (prefix & PREFIX_SEG_MASK)) {
+            instr->op = &instructions[p[len]];
+            instr->opcode = p[len];
             instr->prefix &= ~PREFIX_SEG_MASK;
         } else if (instr->prefix & prefix & PREFIX_OP32) {
             /* Microsoft likes to repeat this on NOPs for alignment, so just
              * ignore it */
         } else if (instr->prefix & prefix) {
-            instr->op = instructions[p[len]];
+            instr->op = &instructions[p[len]];
+            instr->opcode = p[len];
             instr->prefix &= ~prefix;
             return len;
         }
@@ -2278,35 +3195,20 @@ int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
 
     opcode = p[len];
 
-    /* copy the op_info */
-    if (opcode == 0xC4 && MODOF(p[len+1]) == 3 && bits != 16) {
-        byte subcode = 0xcc;
-        len++;
-        instr->vex = 1;
-        if ((p[len] & 0x1F) == 2) subcode = 0x38;
-        else if ((p[len] & 0x1F) == 3) subcode = 0x3A;
-        else warn("Unhandled subcode %x at %x\n", p[len], ip);
-        len++;
-        instr->vex_reg = ~((p[len] >> 3) & 7);
-        instr->vex_256 = (p[len] & 4) ? 1 : 0;
-        if ((p[len] & 3) == 3) instr->prefix |= PREFIX_REPNE;
-        else if ((p[len] & 3) == 2) instr->prefix |= PREFIX_REPE;
-        else if ((p[len] & 3) == 1) instr->prefix |= PREFIX_OP32;
-        len += get_sse_single(subcode, p[len+1], instr);
-    } else if (opcode == 0xC5 && MODOF(p[len+1]) == 3 && bits != 16) {
-        len++;
-        instr->vex = 1;
-        instr->vex_reg = ~((p[len] >> 3) & 7);
-        instr->vex_256 = (p[len] & 4) ? 1 : 0;
-        if ((p[len] & 3) == 3) instr->prefix |= PREFIX_REPNE;
-        else if ((p[len] & 3) == 2) instr->prefix |= PREFIX_REPE;
-        else if ((p[len] & 3) == 1) instr->prefix |= PREFIX_OP32;
-        len++;
-        len += get_0f_instr(p+len, instr);
+    /* find the op_info. Outside of 64-bit mode, C4, C5, and 62 are only VEX
+     * or EVEX if they would otherwise have an invalid (register) ModRM. */
+    if ((opcode == 0xC4 || opcode == 0xC5) && bits != 16 &&
+            (bits == 64 || MODOF(p[len+1]) == 3)) {
+        len += get_vex_instr(p+len, instr, bits);
+    } else if (opcode == 0x62 && bits != 16 && (bits == 64 || MODOF(p[len+1]) == 3) &&
+            !(p[len+1] & 0x08) && (p[len+2] & 0x04)) {
+        len += get_vex_instr(p+len, instr, bits);
     } else if (bits == 64 && instructions64[opcode].name[0]) {
-        instr->op = instructions64[opcode];
+        instr->op = &instructions64[opcode];
+        instr->opcode = opcode;
     } else if (bits != 64 && instructions[opcode].name[0]) {
-        instr->op = instructions[opcode];
+        instr->op = &instructions[opcode];
+        instr->opcode = opcode;
     } else {
         byte subcode = REGOF(p[len+1]);
 
@@ -2316,42 +3218,43 @@ int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
             len += get_0f_instr(p+len, instr);
         } else if (opcode >= 0xD8 && opcode <= 0xDF) {
             len += get_fpu_instr(p+len, &instr->op);
+            instr->opcode = opcode;
+            if (instr->op) instr->subcode = instr->op->subcode;
         } else {
-            unsigned i;
-            for (i=0; i<sizeof(instructions_group)/sizeof(struct op); i++) {
-                if (opcode == instructions_group[i].opcode &&
-                    subcode == instructions_group[i].subcode) {
-                    instr->op = instructions_group[i];
-                    break;
-                }
-            }
+            instr->opcode = opcode;
+            instr->op = find_op(&table_group, opcode, subcode);
+            if (instr->op)
+                instr->subcode = subcode;
         }
 
         /* if we get here and we haven't found a suitable instruction,
          * we ran into something unused (or inadequately documented) */
-        if (!instr->op.name[0]) {
+        if (!instr->op) {
             /* supply some default values so we can keep parsing */
-            strcpy(instr->op.name, "?"); /* less arrogant than objdump's (bad) */
-            instr->op.subcode = subcode;
-            instr->op.size = 0;
-            instr->op.arg0 = 0;
-            instr->op.arg1 = 0;
-            instr->op.flags = 0;
+            instr->op = &unknown_op;
+            instr->subcode = subcode;
         }
     }
 
     len++;
 
+    /* anything the target CPU doesn't have is as good as invalid */
+    if (isa != ISA_ALL && instr_isa(instr) > isa) {
+        instr->op = &invalid_op;
+        return len;
+    }
+
     /* resolve the size */
-    if (instr->op.size == -1) {
+    instr->size = instr->op->size;
+    if (instr->size == -1) {
         if (instr->prefix & PREFIX_OP32)
-            instr->op.size = (bits == 16) ? 32 : 16;
+            instr->size = (bits == 16) ? 32 : 16;
         else if (instr->prefix & PREFIX_REXW)
-            instr->op.size = 64;
-        else if (instr->op.flags & (OP_STACK | OP_64))
-            instr->op.size = bits;
+            instr->size = 64;
+        else if (instr->op->flags & (OP_STACK | OP_64))
+            instr->size = bits;
         else
-            instr->op.size = (bits == 16) ? 16 : 32;
+            instr->size = (bits == 16) ? 16 : 32;
     }
 
     if (instr->prefix & PREFIX_ADDR32)
@@ -2360,119 +3263,222 @@ int get_instr(dword ip, const byte *p, struct instr *instr, int bits) {
         instr->addrsize = bits;
 
     /* figure out what arguments we have */
-    if (instr->op.arg0) {
+    if (instr->op->arg0) {
         int base = len;
 
-        instr->args[0].type = instr->op.arg0;
-        instr->args[1].type = instr->op.arg1;
+        instr->argtype[0] = instr->op->arg0;
+        instr->argtype[1] = instr->op->arg1;
 
-        /* The convention is that an arg whose value is one or more bytes has
-         * IP pointing to that value, but otherwise it points to the beginning
-         * of the instruction. This way, we'll never think that e.g. a register
-         * value is supposed to be relocated. */
-        instr->args[0].ip = instr->args[1].ip = instr->args[2].ip = ip;
-
-        len += get_arg(ip+len, &p[len], &instr->args[0], instr, bits);
+        len += get_arg(ip+len, &p[len], 0, instr, bits);
 
         /* registers that read from the modrm byte, which we might have just processed */
-        if (instr->op.arg1 >= REG && instr->op.arg1 <= TR32)
-            len += get_arg(ip+len, &p[base], &instr->args[1], instr, bits);
+        if (instr->op->arg1 >= REG && instr->op->arg1 <= TR32)
+            len += get_arg(ip+len, &p[base], 1, instr, bits);
         else
-            len += get_arg(ip+len, &p[len], &instr->args[1], instr, bits);
+            len += get_arg(ip+len, &p[len], 1, instr, bits);
 
         /* arg2 */
-        if (instr->op.flags & OP_ARG2_IMM)
-            instr->args[2].type = IMM;
-        else if (instr->op.flags & OP_ARG2_IMM8)
-            instr->args[2].type = IMM8;
-        else if (instr->op.flags & OP_ARG2_CL)
-            instr->args[2].type = CL;
-
-        len += get_arg(ip+len, &p[len], &instr->args[2], instr, bits);
+        if (instr->op->flags & OP_ARG2_IMM)
+            instr->argtype[2] = IMM;
+        else if (instr->op->flags & OP_ARG2_IMM8)
+            instr->argtype[2] = IMM8;
+        else if (instr->op->flags & OP_ARG2_IS4)
+            instr->argtype[2] = IS4;
+        else if (instr->op->flags & OP_ARG2_CL)
+            instr->argtype[2] = CL;
+
+        len += get_arg(ip+len, &p[len], 2, instr, bits);
     }
 
-    /* modify the instruction name if appropriate */
-
-    if (asm_syntax == GAS) {
-        if (instr->op.opcode == 0x0FB6) {
-            strcpy(instr->op.name, "movzb");
-            suffix_name(instr);
-        } else if (instr->op.opcode == 0x0FB7) {
-            strcpy(instr->op.name, "movzw");
-            suffix_name(instr);
-        } else if (instr->op.opcode == 0x0FBE) {
-            strcpy(instr->op.name, "movsb");
-            suffix_name(instr);
-        } else if (instr->op.opcode == 0x0FBF) {
-            strcpy(instr->op.name, "movsw");
-            suffix_name(instr);
-        } else if (instr->op.opcode == 0x63 && bits == 64)
-            strcpy(instr->op.name, "movslq");
-    }
+    /* gathers and scatters can't do without a SIB byte */
+    if ((instr->op->flags & OP_VSIB) && (instr->modrm_disp == DISP_REG || !instr->sib_scale))
+        instr->op = &unknown_vex_op;
+
+    /* EVEX scales an 8-bit displacement by the size of the memory operand */
+    if (instr->evex && instr->modrm_disp == DISP_8) {
+        int i;
+
+        for (i = 0; i < 2; i++) {
+            enum argtype type = instr->argtype[i];
 
-    if ((instr->op.flags & OP_STACK) && (instr->prefix & PREFIX_OP32))
-        suffix_name(instr);
-    else if ((instr->op.flags & OP_STRING) && asm_syntax != GAS)
-        suffix_name(instr);
-    else if (instr->op.opcode == 0x98)
-        strcpy(instr->op.name, instr->op.size == 16 ? "cbw" : instr->op.size == 32 ? "cwde" : "cdqe");
-    else if (instr->op.opcode == 0x99)
-        strcpy(instr->op.name, instr->op.size == 16 ? "cwd" : instr->op.size == 32 ? "cdq" : "cqo");
-    else if (instr->op.opcode == 0xE3)
-        strcpy(instr->op.name, instr->op.size == 16 ? "jcxz" : instr->op.size == 32 ? "jecxz" : "jrcxz");
-    else if (instr->op.opcode == 0xD4 && instr->args[0].value == 10) {
-        strcpy(instr->op.name, "aam");
-        instr->op.arg0 = NONE;
-    } else if (instr->op.opcode == 0xD5 && instr->args[0].value == 10) {
-        strcpy(instr->op.name, "aad");
-        instr->op.arg0 = NONE;
-    } else if (instr->op.opcode == 0x0FC7 && instr->op.subcode == 1 && (instr->prefix & PREFIX_REXW))
-        strcpy(instr->op.name, "cmpxchg16b");
-    else if (asm_syntax == GAS) {
-        if (instr->op.flags & OP_FAR) {
-            memmove(instr->op.name+1, instr->op.name, strlen(instr->op.name));
-            instr->op.name[0] = 'l';
-        } else if (!is_reg(instr->op.arg0) && !is_reg(instr->op.arg1) &&
-                   instr->modrm_disp != DISP_REG)
-            suffix_name(instr);
-    } else if (asm_syntax != GAS && (instr->op.opcode == 0xCA || instr->op.opcode == 0xCB))
-        strcat(instr->op.name, "f");
+            if (type == RM || type == MEM || (type >= XM && type <= XM128)) {
+                instr->args[i] = (dword) ((int8_t) instr->args[i] * evex_disp_scale(instr, type));
+                instr->modrm_disp = DISP_16;
+            }
+        }
+    }
 
     return len;
 }
 
-void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits) {
+/* Print the operands of a VEX or EVEX instruction. VEX.vvvv goes in among the
+ * others, and EVEX adds masking, broadcast, and rounding. The third argument
+ * (an immediate, or a register given in one) is last in Intel syntax and
+ * first in GAS, as it is for other instructions. */
+static void print_vex_args(const struct instr *instr, char args[3][ARG_LEN], enum asm_syntax syntax) {
+    static const char rounding[4][7] = {"rn-sae", "rd-sae", "ru-sae", "rz-sae"};
+    int rc = instr->evex && instr->evex_b && instr->modrm_disp == DISP_REG;
+    const char *ops[4];
+    char deco[4][16];
+    char vreg[32] = "";
+    int count = 0, i;
+
+    memset(deco, 0, sizeof(deco));
+
+    if (!instr->evex && (instr->op->arg0 == REG || instr->op->arg0 == RM))  /* BMI */
+        get_reg16(vreg, instr->vex_reg, instr->size, syntax);
+    else if (instr->op->flags & OP_VSIB)    /* the mask of a gather */
+        get_vreg(vreg, instr->vex_reg, vector_width(instr, instr->op->arg0), syntax);
+    else
+        get_vreg(vreg, instr->vex_reg, vector_width(instr, XMM), syntax);
+
+    if (instr->vex_vvvv == VVVV_FIRST)
+        ops[count++] = vreg;
+    for (i = 0; i < 2; i++) {
+        enum argtype type = instr->argtype[i];
+
+        if (args[i][0]) {
+            if (instr->evex_b && !rc && (type == RM || type == MEM || (type >= XM && type <= XM128)))
+                sprintf(deco[count], "{1to%d}", vector_width(instr, XMM) / (instr->vex_w ? 64 : 32));
+            ops[count++] = args[i];
+        }
+        if (i == 0 && instr->vex_vvvv == VVVV_SECOND)
+            ops[count++] = vreg;
+    }
+    if (instr->vex_vvvv == VVVV_LAST)
+        ops[count++] = vreg;
+
+    /* masking applies to the destination */
+    if (count && instr->evex_aaa)
+        sprintf(deco[0] + strlen(deco[0]), (syntax == GAS) ? "{%%k%d}" : "{k%d}", instr->evex_aaa);
+    if (count && instr->evex_z)
+        strcat(deco[0], "{z}");
+
+    if (count)
+        printf("\t");
+
+    if (syntax == GAS) {
+        if (args[2][0])
+            printf("%s,", args[2]);
+        if (rc)
+            printf("{%s},", rounding[instr->vex_l]);
+        for (i = count - 1; i >= 0; i--)
+            printf("%s%s%s", ops[i], deco[i], i ? "," : "");
+    } else {
+        for (i = 0; i < count; i++)
+            printf("%s%s%s", i ? ", " : "", ops[i], deco[i]);
+        if (args[2][0])
+            printf(", %s", args[2]);
+        if (rc)
+            printf(", {%s}", rounding[instr->vex_l]);
+    }
+}
+
+/* MASM and NASM take a hex number starting with a letter for a symbol, so
+ * give any such number in s a leading zero. */
+static void fix_hex(char *s) {
+    char *p = s, *q;
+
+    while (*p) {
+        if (*p >= 'A' && *p <= 'F' && (p == s || !(isalnum(p[-1]) || p[-1] == '_'))) {
+            for (q = p; isxdigit(*q) && !islower(*q); q++);
+            if (*q == 'h' && !(isalnum(q[1]) || q[1] == '_') && strlen(s) < ARG_LEN - 1) {
+                memmove(p + 1, p, strlen(p) + 1);
+                *p = '0';
+                p = q + 1;
+            }
+        }
+        p++;
+    }
+}
+
+/* whether s is a far pointer as we print it without a label: "seg:offset",
+ * or nothing at all */
+static int is_far_literal(const char *s) {
+    unsigned segment, offset;
+    int n = 0;
+
+    return !s[0] || (sscanf(s, "%x:%x%n", &segment, &offset, &n) == 2 && !s[n]);
+}
+
+static void print_db(const byte *p, unsigned len, enum asm_syntax syntax) {
+    unsigned i;
+
+    while (len) {
+        unsigned count = min(len, 16);
+
+        printf((syntax == GAS) ? "\t.byte\t" : "\tdb\t");
+        for (i = 0; i < count; i++) {
+            if (syntax == GAS)
+                printf("%s0x%02x", i ? "," : "", p[i]);
+            else
+                printf((p[i] >= 0xA0) ? "%s0%02Xh" : "%s%02Xh", i ? ", " : "", p[i]);
+        }
+        putchar('\n');
+        p += count;
+        len -= count;
+    }
+}
+
+/* argstr, if not NULL, gives replacement text for any of the arguments
+ * (used for relocations); empty strings are ignored. */
+void print_instr(const char *ip, const byte *p, int len, byte flags, const struct instr *instr, char argstr[3][ARG_LEN], const char *comment, int bits, enum asm_syntax syntax) {
+    char name[sizeof(instr->op->name)+2];
+    char args[3][ARG_LEN];
     int i;
 
     /* FIXME: now that we've had to add bits to this function, get rid of ip_string */
 
     /* get the arguments */
 
-    print_arg(ip, instr, 0, bits);
-    print_arg(ip, instr, 1, bits);
-    print_arg(ip, instr, 2, bits);
+    for (i = 0; i < 3; i++) {
+        if (argstr && argstr[i][0])
+            strcpy(args[i], argstr[i]);
+        else
+            print_arg(ip, instr, i, bits, syntax, NULL, args[i], sizeof(args[i]));
+    }
+
+    get_instr_name(name, instr, bits, syntax);
 
     /* did we find too many prefixes? */
-    if (get_prefix(instr->op.opcode, bits)) {
-        if (get_prefix(instr->op.opcode, bits) & PREFIX_SEG_MASK)
+    if (get_prefix(instr->opcode, bits)) {
+        if (get_prefix(instr->opcode, bits) & PREFIX_SEG_MASK)
             warn_at("Multiple segment prefixes found: %s, %s. Skipping to next instruction.\n",
-                    seg16[(instr->prefix & PREFIX_SEG_MASK)-1], instr->op.name);
+                    seg16[(instr->prefix & PREFIX_SEG_MASK)-1], name);
         else
-            warn_at("Prefix specified twice: %s. Skipping to next instruction.\n", instr->op.name);
-        instr->op.name[0] = 0;
+            warn_at("Prefix specified twice: %s. Skipping to next instruction.\n", name);
+        name[0] = 0;
     }
 
     /* check that the instruction exists */
-    if (instr->op.name[0] == '?')
-        warn_at("Unknown opcode 0x%02x (extension %d)\n", instr->op.opcode, instr->op.subcode);
+    if (instr->op == &invalid_op && !get_prefix(instr->opcode, bits))
+        warn_at("Opcode 0x%02x (extension %d) isn't in the selected instruction set.\n", instr->opcode, instr->subcode);
+    else if (name[0] == '?')
+        warn_at("Unknown opcode 0x%02x (extension %d)\n", instr->opcode, instr->subcode);
 
     /* okay, now we begin dumping */
-    if ((flags & INSTR_JUMP) && (opts & COMPILABLE)) {
-        /* output a label, which is like an address but without the segment prefix */
-        /* FIXME: check masm */
-        if (asm_syntax == NASM)
-            printf(".");
-        printf("%s:", ip);
+    if (opts & COMPILABLE) {
+        /* the caller prints labels; all we have to do is make sure that what
+         * we print assembles back to the same bytes */
+        if (!name[0] || name[0] == '?' || !strcmp(name, "amx") || !strcmp(name, "adx")) {
+            print_db(p, len, syntax);
+            return;
+        }
+        /* A far pointer nobody gave a label to: write it out as numbers.
+         * MASM can only spell far jumps and calls to labels. */
+        if (instr->argtype[0] == SEGPTR && is_far_literal(args[0])) {
+            word segment = *(word *)(p + instr->argoff[0] + instr->size / 8);
+
+            if (syntax == MASM) {
+                print_db(p, len, syntax);
+                return;
+            }
+            snprintf(args[0], sizeof(args[0]), (syntax == GAS) ? "$0x%x,$0x%lx" : "0x%x:0x%lx", segment, instr->args[0]);
+        }
+        if (syntax != GAS) {
+            for (i = 0; i < 3; i++)
+                fix_hex(args[i]);
+        }
     }
 
     if (!(opts & NO_SHOW_ADDRESSES))
@@ -2495,71 +3501,69 @@ void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *ins
     /* print prefixes, including (fake) prefixes if ours are invalid */
     if (instr->prefix & PREFIX_SEG_MASK) {
         /* note: is it valid to use overrides with lods and outs? */
-        if (!instr->usedmem || (instr->op.arg0 == ESDI || (instr->op.arg1 == ESDI && instr->op.arg0 != DSSI))) {  /* can't be overridden */
-            warn_at("Segment prefix %s used with opcode 0x%02x %s\n", seg16[(instr->prefix & PREFIX_SEG_MASK)-1], instr->op.opcode, instr->op.name);
+        if (!instr->usedmem || (instr->op->arg0 == ESDI || (instr->op->arg1 == ESDI && instr->op->arg0 != DSSI))) {  /* can't be overridden */
+            warn_at("Segment prefix %s used with opcode 0x%02x %s\n", seg16[(instr->prefix & PREFIX_SEG_MASK)-1], instr->opcode, name);
             printf("%s ", seg16[(instr->prefix & PREFIX_SEG_MASK)-1]);
         }
     }
-    if ((instr->prefix & PREFIX_OP32) && instr->op.size != 16 && instr->op.size != 32) {
-        warn_at("Operand-size override used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((asm_syntax == GAS) ? "data32 " : "o32 "); /* fixme: how should MASM print it? */
+    if ((instr->prefix & PREFIX_OP32) && instr->size != 16 && instr->size != 32) {
+        warn_at("Operand-size override used with opcode 0x%02x %s\n", instr->opcode, name);
+        printf((syntax == GAS) ? "data32 " : "o32 "); /* fixme: how should MASM print it? */
     }
-    if ((instr->prefix & PREFIX_ADDR32) && (asm_syntax == NASM) && (instr->op.flags & OP_STRING)) {
+    if ((instr->prefix & PREFIX_ADDR32) && (syntax == NASM) && (instr->op->flags & OP_STRING)) {
         printf("a32 ");
-    } else if ((instr->prefix & PREFIX_ADDR32) && !instr->usedmem && instr->op.opcode != 0xE3) { /* jecxz */
-        warn_at("Address-size prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((asm_syntax == GAS) ? "addr32 " : "a32 "); /* fixme: how should MASM print it? */
+    } else if ((instr->prefix & PREFIX_ADDR32) && !instr->usedmem && instr->opcode != 0xE3) { /* jecxz */
+        warn_at("Address-size prefix used with opcode 0x%02x %s\n", instr->opcode, name);
+        printf((syntax == GAS) ? "addr32 " : "a32 "); /* fixme: how should MASM print it? */
     }
     if (instr->prefix & PREFIX_LOCK) {
-        if(!(instr->op.flags & OP_LOCK))
-            warn_at("lock prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
+        if(!(instr->op->flags & OP_LOCK))
+            warn_at("lock prefix used with opcode 0x%02x %s\n", instr->opcode, name);
         printf("lock ");
     }
     if (instr->prefix & PREFIX_REPNE) {
-        if(!(instr->op.flags & OP_REPNE))
-            warn_at("repne prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
+        if(!(instr->op->flags & OP_REPNE))
+            warn_at("repne prefix used with opcode 0x%02x %s\n", instr->opcode, name);
         printf("repne ");
     }
     if (instr->prefix & PREFIX_REPE) {
-        if(!(instr->op.flags & OP_REPE))
-            warn_at("repe prefix used with opcode 0x%02x %s\n", instr->op.opcode, instr->op.name);
-        printf((instr->op.flags & OP_REPNE) ? "repe ": "rep ");
+        if(!(instr->op->flags & OP_REPE))
+            warn_at("repe prefix used with opcode 0x%02x %s\n", instr->opcode, name);
+        printf((instr->op->flags & OP_REPNE) ? "repe ": "rep ");
     }
     if (instr->prefix & PREFIX_WAIT) {
         printf("wait ");
     }
 
-    if (instr->vex)
+    if (instr->vex_sse)
         printf("v");
-    printf("%s", instr->op.name);
-
-    if (instr->args[0].string[0] || instr->args[1].string[0])
-        printf("\t");
+    printf("%s", name);
 
-    if (asm_syntax == GAS) {
-        /* fixme: are all of these orderings correct? */
-        if (instr->args[1].string[0])
-            printf("%s,", instr->args[1].string);
-        if (instr->vex_reg)
-            printf("%%ymm%d, ", instr->vex_reg);
-        if (instr->args[0].string[0])
-            printf("%s", instr->args[0].string);
-        if (instr->args[2].string[0])
-            printf(",%s", instr->args[2].string);
-    } else {
-        if (instr->args[0].string[0])
-            printf("%s", instr->args[0].string);
-        if (instr->args[1].string[0])
-            printf(", ");
-        if (instr->vex_reg)
-            printf("ymm%d, ", instr->vex_reg);
-        if (instr->args[1].string[0])
-            printf("%s", instr->args[1].string);
-        if (instr->args[2].string[0])
-            printf(", %s", instr->args[2].string);
+    if (instr->vex)
+        print_vex_args(instr, args, syntax);
+    else {
+        if (args[0][0] || args[1][0])
+            printf("\t");
+
+        if (syntax == GAS) {
+            /* operands are simply reversed, immediate first */
+            if (args[2][0])
+                printf("%s,", args[2]);
+            if (args[1][0])
+                printf("%s,", args[1]);
+            if (args[0][0])
+                printf("%s", args[0]);
+        } else {
+            if (args[0][0])
+                printf("%s", args[0]);
+            if (args[1][0])
+                printf(", %s", args[1]);
+            if (args[2][0])
+                printf(", %s", args[2]);
+        }
     }
     if (comment) {
-        printf(asm_syntax == GAS ? "\t// " : "\t;");
+        printf(syntax == GAS ? ((opts & COMPILABLE) ? "\t# " : "\t// ") : "\t;");
         printf(" <%s>", comment);
     }
 
@@ -2573,3 +3577,109 @@ void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *ins
     }
     printf("\n");
 }
+
+/* Writes the label for the byte at addr, which has the given flags. */
+void get_label(char *out, dword addr, byte flags, addr_func addr_str, const void *ctx) {
+    char buffer[32], *p;
+
+    addr_str(buffer, addr, ctx);
+    strcpy(out, (flags & INSTR_FUNC) ? "sub_" : (flags & INSTR_JUMP) ? "loc_" : "data_");
+    out += strlen(out);
+    for (p = buffer; *p; p++) {
+        if (*p != ' ')
+            *out++ = (*p == ':') ? '_' : *p;
+    }
+    *out = 0;
+}
+
+/* Renders argument i like print_instr() would, but with label in place of
+ * the address, into out, which holds ARG_LEN bytes. Falls back to the plain
+ * argument if the result won't fit. */
+void print_label_arg(const char *ip, const struct instr *instr, int i, int bits, enum asm_syntax syntax, const char *label, char *out) {
+    if (print_arg(ip, instr, i, bits, syntax, label, out, ARG_LEN) >= ARG_LEN)
+        print_arg(ip, instr, i, bits, syntax, NULL, out, ARG_LEN);
+}
+
+/* Prints the labels for an instruction of len bytes at addr: its own, and
+ * "equ" definitions for anything that branches into the middle of it. flags
+ * must cover all len bytes. */
+void print_labels(dword addr, const byte *flags, unsigned len, addr_func addr_str, const void *ctx, enum asm_syntax syntax) {
+    char label[48];
+    unsigned i;
+
+    if (flags[0] & INSTR_LABEL) {
+        get_label(label, addr, flags[0], addr_str, ctx);
+        if (flags[0] & INSTR_FUNC)
+            putchar('\n');
+        printf("%s:\n", label);
+    }
+    for (i = 1; i < len; i++) {
+        if (flags[i] & INSTR_LABEL) {
+            get_label(label, addr + i, flags[i], addr_str, ctx);
+            printf((syntax == GAS) ? "%s = . + %u\n" : "%s equ $+%u\n", label, i);
+        }
+    }
+}
+
+static void print_fill(dword len, enum asm_syntax syntax) {
+    if (syntax == GAS)
+        printf("\t.skip\t%u\n", len);
+    else if (syntax == MASM)
+        printf("\tdb\t%u dup (0)\n", len);
+    else
+        printf("\ttimes %u db 0\n", len);
+}
+
+/* Prints length bytes starting at file offset offset as data, splitting it
+ * wherever a byte needs a label. Only the first raw_length bytes are present
+ * in the file; the rest are zero. flags may be NULL. */
+void print_data_range(off_t offset, const byte *flags, dword addr, dword raw_length, dword length, addr_func addr_str, const void *ctx, enum asm_syntax syntax) {
+    char label[48];
+    dword i = 0, end;
+
+    while (i < length) {
+        if (flags && (flags[i] & INSTR_LABEL)) {
+            get_label(label, addr + i, flags[i], addr_str, ctx);
+            printf("%s:\n", label);
+        }
+
+        end = i + 1;
+        while (end < length && end != raw_length && !(flags && (flags[end] & INSTR_LABEL)))
+            end++;
+
+        if (i < raw_length)
+            print_db(read_data(offset + i), end - i, syntax);
+        else
+            print_fill(end - i, syntax);
+        i = end;
+    }
+}
+
+/* MASM doesn't allow dots in names, which PE sections are fond of */
+static void print_region_name(const char *name, enum asm_syntax syntax) {
+    for (; *name; name++)
+        putchar((syntax == MASM && *name == '.') ? '_' : *name);
+}
+
+void print_region_start(const char *name, int bits, enum asm_syntax syntax) {
+    putchar('\n');
+    if (syntax == GAS) {
+        printf("\t.section ");
+        print_region_name(name, syntax);
+        printf("\n\t.code%d\n", bits);
+    } else if (syntax == MASM) {
+        print_region_name(name, syntax);
+        printf(" segment%s\n", (bits == 16) ? " use16" : (bits == 32) ? " use32" : "");
+    } else {
+        printf("section ");
+        print_region_name(name, syntax);
+        printf("\nbits %d\n", bits);
+    }
+}
+
+void print_region_end(const char *name, enum asm_syntax syntax) {
+    if (syntax == MASM) {
+        print_region_name(name, syntax);
+        printf(" ends\n");
+    }
+}
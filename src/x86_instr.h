@@ -18,6 +18,7 @@ enum argtype {
 
     /* absolute or relative numbers, given as 1/2/4 bytes */
     IMM8, IMM16, IMM,   /* immediate number */
+    IS4,        /* SSE register in bits 7-4 of an imm8 (VEX) */
     REL8, REL,          /* relative to current instruction */
     SEGPTR,     /* absolute instruction, used for far calls/jumps */
     MOFFS,      /* absolute location in memory, for A0-A3 MOV */
@@ -29,6 +30,8 @@ enum argtype {
     RM,         /* register/memory */
     MM,         /* MMX register/memory */
     XM,         /* SSE register/memory */
+    XMH,        /* SSE register/memory, half the vector length (VEX) */
+    XM128,      /* SSE register/memory, always 128 bits (VEX) */
     MEM,        /* memory only (using 0x11xxxxxx is invalid) */
     REGONLY,    /* register only (not using 0x11xxxxxx is invalid) */
     MMXONLY,    /* MMX register only (not using 0x11xxxxxx is invalid) */
@@ -36,6 +39,8 @@ enum argtype {
     REG,        /* register */
     MMX,        /* MMX register */
     XMM,        /* SSE register */
+    XMMH,       /* SSE register, half the vector length (VEX) */
+    KREG,       /* AVX-512 mask register */
     SEG16,      /* segment register */
     REG32,      /* 32-bit only register, used for cr/dr/tr */
     CR32,       /* control register */
@@ -73,6 +78,20 @@ enum argtype {
 #define OP_STOP         0x4000  /* stop scanning (jmp, ret) */
 #define OP_BRANCH       0x8000  /* branch to target (jmp, jXX) */
 
+/* VEX/EVEX only. By default VEX.vvvv is the second operand if the first is an
+ * SSE register, and unused otherwise. */
+#define OP_NOVVVV       0x010000    /* vvvv is unused */
+#define OP_VVVV         0x020000    /* vvvv is the second operand */
+#define OP_VVVV_DST     0x040000    /* vvvv is the first operand */
+#define OP_VVVV_LAST    0x080000    /* vvvv is the last operand */
+#define OP_VVVV_REG     0x100000    /* vvvv is the second operand if ModRM is a register */
+#define OP_W1           0x200000    /* only with W set; precedes the W0 form */
+#define OP_SCALAR       0x400000    /* operates on one element; ignores L */
+
+#define OP_CALL         0x800000    /* call; marked along with OP_BRANCH or OP_FAR */
+#define OP_ARG2_IS4     0x1000000   /* has IS4 as third argument */
+#define OP_VSIB         0x2000000   /* memory operand's SIB index is a vector register */
+
 struct op {
     word opcode;
     byte subcode;
@@ -105,6 +124,14 @@ struct op {
 #define PREFIX_REXR     0x4000  /* 44 */
 #define PREFIX_REXW     0x8000  /* 48 */
 
+/* where VEX.vvvv goes among the operands */
+enum vvvvpos {
+    VVVV_NONE = 0,
+    VVVV_SECOND,
+    VVVV_FIRST,
+    VVVV_LAST,
+};
+
 enum disptype {
     DISP_NONE = 0,      /* no disp, i.e. mod == 0 && m != 6 */
     DISP_8    = 1,      /* one byte */
@@ -114,31 +141,78 @@ enum disptype {
 
 extern const char seg16[6][3];
 
-struct arg {
-    char string[32];
-    dword ip;
-    qword value;
-    enum argtype type;
-};
-
+/* The decoded form of an instruction. This is kept small, since the
+ * scanners decode every instruction at least once; operand strings are only
+ * produced by print_instr(). */
 struct instr {
+    const struct op *op;    /* table entry; never modified */
+    qword args[3];          /* operand values (immediate, displacement, register number...) */
+    dword ip;               /* address of the first byte (including prefixes) */
     word prefix;
-    struct op op;
-    struct arg args[3];
+    word opcode;            /* full opcode, e.g. 0x0FB6; may differ from op->opcode */
+    byte subcode;
+    char size;              /* operand size, with op->size == -1 resolved */
     byte addrsize;
-    enum disptype modrm_disp;
+    byte argtype[3];        /* enum argtype */
+    /* Offset of each operand's value from ip. The convention is that an arg
+     * whose value is one or more bytes points to that value, but otherwise
+     * to the beginning of the instruction. This way, we'll never think that
+     * e.g. a register value is supposed to be relocated. */
+    byte argoff[3];
     int8_t modrm_reg; /* This is a little ugly, but 16 is IP and -1 is none (aka IZ). */
     byte sib_scale;
-    char sib_index;
-    int usedmem:1;  /* used for error checking */
-
-    int vex:1;
-    unsigned int vex_reg:3;
-    int vex_256:1;
+    int8_t sib_index;
+    byte vex_reg;               /* VEX.vvvv, already inverted */
+    unsigned int modrm_disp:2;  /* enum disptype */
+    unsigned int usedmem:1;     /* used for error checking */
+    unsigned int vex:1;         /* VEX or EVEX encoded */
+    unsigned int evex:1;
+    unsigned int vex_sse:1;     /* SSE instruction, printed with a v */
+    unsigned int vex_w:1;
+    unsigned int vex_l:2;       /* vector length: 0, 1, 2 for 128, 256, 512 */
+    unsigned int vex_vvvv:2;    /* enum vvvvpos */
+    unsigned int evex_z:1;      /* zeroing-masking */
+    unsigned int evex_b:1;      /* broadcast, or rounding control */
+    unsigned int evex_aaa:3;    /* mask register */
+    unsigned int evex_r:1;      /* EVEX.R', the high bit of ModRM.reg */
 };
 
+STATIC_ASSERT(sizeof(struct instr) <= 64);
+
+/* address of the value of argument i */
+static inline dword arg_ip(const struct instr *instr, int i) {
+    return instr->ip + instr->argoff[i];
+}
+
+/* Target of a near branch. 16-bit relative targets wrap around at 64K, which
+ * is right for segmented code, but code addressed linearly (as in MZ files)
+ * can branch across the boundary. */
+static inline dword branch_target(const struct instr *instr, int len, int linear) {
+    dword end = instr->ip + len;
+    if (linear && instr->argtype[0] == REL && instr->size == 16)
+        return end + (int16_t)(instr->args[0] - end);
+    return instr->args[0];
+}
+
+extern void init_instr_tables(void);
 extern int get_instr(dword ip, const byte *p, struct instr *instr, int bits);
-extern void print_instr(char *ip, const byte *p, int len, byte flags, struct instr *instr, const char *comment, int bits);
+/* room for one rendered operand, e.g. "xmmword ptr fs:[r15+r15*8-7FFFFFFFh]",
+ * or a label with its decoration */
+#define ARG_LEN         64
+
+extern void get_instr_name(char *name, const struct instr *instr, int bits, enum asm_syntax syntax);
+extern void print_instr(const char *ip, const byte *p, int len, byte flags, const struct instr *instr, char argstr[3][ARG_LEN], const char *comment, int bits, enum asm_syntax syntax);
+
+/* Compilable output (-c). Labels are named after the address they mark, as
+ * formatted by the image's addr_func; addresses use the same scheme as the
+ * xref table. A byte gets a label if any of INSTR_LABEL is set on it, so the
+ * scanner's flags double as the label map. */
+extern void get_label(char *out, dword addr, byte flags, addr_func addr_str, const void *ctx);
+extern void print_label_arg(const char *ip, const struct instr *instr, int i, int bits, enum asm_syntax syntax, const char *label, char *out);
+extern void print_labels(dword addr, const byte *flags, unsigned len, addr_func addr_str, const void *ctx, enum asm_syntax syntax);
+extern void print_data_range(off_t offset, const byte *flags, dword addr, dword raw_length, dword length, addr_func addr_str, const void *ctx, enum asm_syntax syntax);
+extern void print_region_start(const char *name, int bits, enum asm_syntax syntax);
+extern void print_region_end(const char *name, enum asm_syntax syntax);
 
 /* 66 + 67 + seg + lock/rep + 2 bytes opcode + modrm + sib + 4 bytes displacement + 4 bytes immediate */
 #define MAX_INSTR       16
@@ -150,5 +224,8 @@ extern void print_instr(char *ip, const byte *p, int len, byte flags, struct ins
 #define INSTR_FUNC      0x08    /* instruction begins a function */
 #define INSTR_FAR       0x10    /* instruction is target of far call/jmp */
 #define INSTR_RELOC     0x20    /* byte has relocation data */
+#define INSTR_DATA      0x40    /* byte is referenced as data */
+
+#define INSTR_LABEL     (INSTR_JUMP | INSTR_FUNC | INSTR_DATA)
 
 #endif /* __X86_INSTR_H */
@@ -0,0 +1,135 @@
+/*
+ * Cross-reference tables
+ *
+ * Copyright 2026 Zebediah Figura
+ *
+ * This file is part of Semblance.
+ *
+ * Semblance is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Semblance is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Semblance; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "semblance.h"
+#include "xref.h"
+
+/* The scanners add references in whatever order they find them. Nobody looks
+ * them up until everything has been scanned, so we just append, and sort (by
+ * target) once scanning is done. */
+
+void xref_add(struct xref_table *table, dword from, dword to, byte type) {
+    struct xref *x;
+
+    if (table->count == table->size) {
+        table->size = table->size ? table->size * 2 : 256;
+        table->xrefs = realloc(table->xrefs, table->size * sizeof(*table->xrefs));
+    }
+
+    x = &table->xrefs[table->count++];
+    x->from = from;
+    x->to = to;
+    x->type = type;
+    table->sorted = 0;
+}
+
+static int xref_cmp(const void *a, const void *b) {
+    const struct xref *xa = a, *xb = b;
+
+    if (xa->to != xb->to)
+        return (xa->to < xb->to) ? -1 : 1;
+    if (xa->from != xb->from)
+        return (xa->from < xb->from) ? -1 : 1;
+    return xa->type - xb->type;
+}
+
+/* Sort by target, then by source, and drop duplicates. */
+void xref_sort(struct xref_table *table) {
+    unsigned i, j;
+
+    if (table->sorted)
+        return;
+
+    if (table->count)
+        qsort(table->xrefs, table->count, sizeof(*table->xrefs), xref_cmp);
+
+    for (i = j = 0; i < table->count; i++) {
+        if (j && !xref_cmp(&table->xrefs[j-1], &table->xrefs[i]))
+            continue;
+        table->xrefs[j++] = table->xrefs[i];
+    }
+    table->count = j;
+    table->sorted = 1;
+}
+
+/* Returns the first reference to "to" and stores the number of references
+ * in *count, or returns NULL if there are none. The table must be sorted. */
+const struct xref *xref_find(const struct xref_table *table, dword to, unsigned *count) {
+    unsigned lo = 0, hi, start;
+
+    /* find the first entry whose target is not below "to" */
+    hi = table->count;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (table->xrefs[mid].to < to)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    start = lo;
+    while (lo < table->count && table->xrefs[lo].to == to) lo++;
+
+    *count = lo - start;
+    return *count ? &table->xrefs[start] : NULL;
+}
+
+const char *xref_type_name(byte type) {
+    switch (type) {
+    case XREF_CALL:             return "call";
+    case XREF_JUMP:             return "jump";
+    case XREF_CALL | XREF_FAR:  return "far call";
+    case XREF_JUMP | XREF_FAR:  return "far jump";
+    case XREF_DATA:             return "data";
+    default:                    return "?";
+    }
+}
+
+/* Prints a comment line listing what refers to "to", if anything does. Long
+ * lists are cut short; --xrefs prints them in full at the end anyway. */
+void print_xref_comment(const struct xref_table *table, dword to, addr_func addr_str, const void *ctx, enum asm_syntax syntax) {
+    const struct xref *x;
+    unsigned count, i;
+    char buffer[32];
+
+    if (!(x = xref_find(table, to, &count)))
+        return;
+
+    printf(syntax == GAS ? ((opts & COMPILABLE) ? "\t# " : "\t// ") : "\t; ");
+    printf("referenced by");
+    for (i = 0; i < count && i < 8; i++) {
+        addr_str(buffer, x[i].from, ctx);
+        printf("%s %s (%s)", i ? "," : "", buffer, xref_type_name(x[i].type));
+    }
+    if (count > i)
+        printf(", and %u more", count - i);
+    putchar('\n');
+}
+
+void xref_free(struct xref_table *table) {
+    free(table->xrefs);
+    table->xrefs = NULL;
+    table->count = table->size = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef __XREF_H
+#define __XREF_H
+
+#include "semblance.h"
+
+/* Addresses are whatever the image format uses internally: linear for MZ,
+ * relative to the image base for PE, and (cs << 16) | ip for NE. */
+
+#define XREF_CALL       1
+#define XREF_JUMP       2
+#define XREF_DATA       3   /* address used as an operand (relocation, rip-relative...) */
+#define XREF_TYPE_MASK  0x0f
+#define XREF_FAR        0x10
+
+struct xref {
+    dword from;     /* address of the referencing instruction */
+    dword to;       /* address referenced */
+    byte type;
+};
+
+struct xref_table {
+    struct xref *xrefs;
+    unsigned count;
+    unsigned size;
+    int sorted;
+};
+
+extern void xref_add(struct xref_table *table, dword from, dword to, byte type);
+extern void xref_sort(struct xref_table *table);
+extern const struct xref *xref_find(const struct xref_table *table, dword to, unsigned *count);
+extern const char *xref_type_name(byte type);
+extern void print_xref_comment(const struct xref_table *table, dword to, addr_func addr_str, const void *ctx, enum asm_syntax syntax);
+extern void xref_free(struct xref_table *table);
+
+#endif /* __XREF_H */
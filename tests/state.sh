@@ -0,0 +1,17 @@
+#!/bin/sh
+# Check that loading saved scan results gives the same disassembly, cross-
+# references included, as scanning from scratch.
+
+dump=${DUMP:-./dump}
+tmp=state-test.$$
+trap 'rm -f $tmp.*' 0
+
+# a small DOS program: two calls to a function that exits
+printf 'MZ\054\000\001\000\000\000\002\000\000\000\377\377\000\000\000\001\000\000\000\000\000\000\034\000\000\000\000\000\000\000' > $tmp.exe
+printf '\350\004\000\350\001\000\303\264\114\315\041\303' >> $tmp.exe
+
+$dump -d --xrefs --save-state=$tmp.state $tmp.exe > $tmp.fresh || exit 1
+$dump -d --xrefs --load-state=$tmp.state $tmp.exe > $tmp.loaded || exit 1
+
+grep -q 'referenced by' $tmp.fresh || { echo "no cross-references found"; exit 1; }
+cmp $tmp.fresh $tmp.loaded || { diff $tmp.fresh $tmp.loaded; exit 1; }